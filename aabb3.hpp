@@ -0,0 +1,273 @@
+#ifndef AABB3_H
+#define AABB3_H
+
+#include <stddef.h>
+#include <limits>
+
+#include "vec3.hpp"
+#include "mat4.hpp"
+#include "affine3.hpp"
+#include "transform.hpp"
+#include "soa.hpp"
+#include "executor.hpp"
+#include "simd.hpp"
+
+namespace xxx
+{
+
+// Axis-aligned box from min to max, both inclusive. A box with min > max on
+// any axis contains nothing; empty() is the one that merges into anything
+// without changing it.
+template <typename T>
+struct basic_aabb3
+{
+	typedef T value_type;
+
+	basic_vec3<T> min, max;
+
+	basic_aabb3() = default;
+	explicit constexpr basic_aabb3(basic_vec3<T> const& min, basic_vec3<T> const& max) : min(min), max(max) {}
+	template <typename U>
+	explicit constexpr basic_aabb3(basic_aabb3<U> const& b) : min(b.min), max(b.max) {}
+
+	constexpr bool is_empty() const
+	{
+		return min.x > max.x || min.y > max.y || min.z > max.z;
+	}
+
+	constexpr basic_vec3<T> center() const
+	{
+		return (max + min) * static_cast<T>(0.5);
+	}
+
+	// Half the size along each axis.
+	constexpr basic_vec3<T> extent() const
+	{
+		return (max - min) * static_cast<T>(0.5);
+	}
+
+	constexpr basic_vec3<T> size() const
+	{
+		return max - min;
+	}
+
+	static constexpr basic_aabb3 empty()
+	{
+		return basic_aabb3(basic_vec3<T>(std::numeric_limits<T>::infinity()), basic_vec3<T>(-std::numeric_limits<T>::infinity()));
+	}
+};
+
+typedef basic_aabb3<scalar_t> aabb3;
+typedef basic_aabb3<double> daabb3;
+
+// The smallest box containing both.
+template <typename T>
+inline constexpr basic_aabb3<T> merge(basic_aabb3<T> const& a, basic_aabb3<T> const& b)
+{
+	return basic_aabb3<T>(min(a.min, b.min), max(a.max, b.max));
+}
+
+template <typename T>
+inline constexpr basic_aabb3<T> merge(basic_aabb3<T> const& a, basic_vec3<T> const& p)
+{
+	return basic_aabb3<T>(min(a.min, p), max(a.max, p));
+}
+
+// The overlap of a and b; empty where they are disjoint.
+template <typename T>
+inline constexpr basic_aabb3<T> intersection(basic_aabb3<T> const& a, basic_aabb3<T> const& b)
+{
+	return basic_aabb3<T>(max(a.min, b.min), min(a.max, b.max));
+}
+
+template <typename T>
+inline constexpr bool overlaps(basic_aabb3<T> const& a, basic_aabb3<T> const& b)
+{
+	return !intersection(a, b).is_empty();
+}
+
+template <typename T>
+inline constexpr bool contains(basic_aabb3<T> const& a, basic_vec3<T> const& p)
+{
+	return p.x >= a.min.x && p.x <= a.max.x && p.y >= a.min.y && p.y <= a.max.y && p.z >= a.min.z && p.z <= a.max.z;
+}
+
+// The box around the transformed corners of b, by Arvo's method ("Transforming
+// Axis-Aligned Bounding Boxes", Graphics Gems): each output axis sums the
+// smaller and the larger of every matrix element times the input min and max,
+// instead of transforming all 8 corners. Empty boxes stay empty.
+template <typename T>
+inline basic_aabb3<T> transform_bounds(basic_affine3<T> const& m, basic_aabb3<T> const& b)
+{
+	if (b.is_empty())
+	{
+		return b;
+	}
+	basic_vec3<T> const xa = m.x * b.min.x, xb = m.x * b.max.x;
+	basic_vec3<T> const ya = m.y * b.min.y, yb = m.y * b.max.y;
+	basic_vec3<T> const za = m.z * b.min.z, zb = m.z * b.max.z;
+	return basic_aabb3<T>(m.w + min(xa, xb) + min(ya, yb) + min(za, zb), m.w + max(xa, xb) + max(ya, yb) + max(za, zb));
+}
+
+// m must be affine, with a last row of (0, 0, 0, 1).
+template <typename T>
+inline basic_aabb3<T> transform_bounds(basic_mat4<T> const& m, basic_aabb3<T> const& b)
+{
+	return transform_bounds(basic_affine3<T>(m), b);
+}
+
+template <typename T>
+inline basic_aabb3<T> transform_bounds(basic_transform<T> const& t, basic_aabb3<T> const& b)
+{
+	return transform_bounds(basic_affine3<T>(t), b);
+}
+
+// compute_aabb: the box around points[0, n) or the points of a vec3_soa,
+// empty() where there are none. The SIMD loops keep a minimum and maximum per
+// lane and fold the lanes at the end; min and max are exact, so every form,
+// including the executor ones, returns the same box.
+
+namespace detail
+{
+
+template <typename P>
+inline float min_lanes(P v)
+{
+	float t[sizeof(P) / sizeof(float)];
+	simd::store(t, v);
+	float r = t[0];
+	for (size_t l = 1; l < sizeof(P) / sizeof(float); ++l)
+	{
+		r = t[l] < r ? t[l] : r;
+	}
+	return r;
+}
+
+template <typename P>
+inline float max_lanes(P v)
+{
+	float t[sizeof(P) / sizeof(float)];
+	simd::store(t, v);
+	float r = t[0];
+	for (size_t l = 1; l < sizeof(P) / sizeof(float); ++l)
+	{
+		r = t[l] > r ? t[l] : r;
+	}
+	return r;
+}
+
+template <typename T>
+inline basic_aabb3<T> bounds(basic_vec3<T> const* p, size_t begin, size_t end)
+{
+	basic_aabb3<T> b = basic_aabb3<T>::empty();
+	for (size_t i = begin; i < end; ++i)
+	{
+		b = merge(b, p[i]);
+	}
+	return b;
+}
+
+inline aabb3 bounds(vec3 const* p, size_t begin, size_t end)
+{
+	aabb3 b = aabb3::empty();
+	size_t i = begin;
+
+#if defined(XXX_SSE)
+	if (end - i >= 4)
+	{
+		simd::float4 lx = simd::splat<simd::float4>(b.min.x), ly = lx, lz = lx;
+		simd::float4 hx = simd::splat<simd::float4>(b.max.x), hy = hx, hz = hx;
+		for (; i + 4 <= end; i += 4)
+		{
+			simd::float4 x, y, z;
+			simd::load3(&p[i].x, x, y, z);
+			lx = simd::min(lx, x);
+			ly = simd::min(ly, y);
+			lz = simd::min(lz, z);
+			hx = simd::max(hx, x);
+			hy = simd::max(hy, y);
+			hz = simd::max(hz, z);
+		}
+		b = aabb3(vec3(min_lanes(lx), min_lanes(ly), min_lanes(lz)), vec3(max_lanes(hx), max_lanes(hy), max_lanes(hz)));
+	}
+#endif
+
+	for (; i < end; ++i)
+	{
+		b = merge(b, p[i]);
+	}
+	return b;
+}
+
+inline aabb3 bounds(vec3_soa const& s, size_t begin, size_t end)
+{
+	aabb3 b = aabb3::empty();
+	size_t i = begin;
+
+	if (end - i >= simd::width)
+	{
+		pack lo[3], hi[3];
+		for (size_t k = 0; k < 3; ++k)
+		{
+			lo[k] = simd::splat<pack>(b.min.x);
+			hi[k] = simd::splat<pack>(b.max.x);
+		}
+		for (; i + simd::width <= end; i += simd::width)
+		{
+			for (size_t k = 0; k < 3; ++k)
+			{
+				pack const v = simd::load<pack>(s.stream(k) + i);
+				lo[k] = simd::min(lo[k], v);
+				hi[k] = simd::max(hi[k], v);
+			}
+		}
+		b = aabb3(vec3(min_lanes(lo[0]), min_lanes(lo[1]), min_lanes(lo[2])), vec3(max_lanes(hi[0]), max_lanes(hi[1]), max_lanes(hi[2])));
+	}
+
+	for (; i < end; ++i)
+	{
+		b = merge(b, s.get(i));
+	}
+	return b;
+}
+
+template <typename T>
+inline basic_aabb3<T> merge_aabb(basic_aabb3<T> const& a, basic_aabb3<T> const& b)
+{
+	return merge(a, b);
+}
+
+}
+
+template <typename T>
+inline basic_aabb3<T> compute_aabb(basic_vec3<T> const* points, size_t n)
+{
+	return detail::bounds(points, 0, n);
+}
+
+inline aabb3 compute_aabb(vec3_soa const& points)
+{
+	return detail::bounds(points, 0, points.size());
+}
+
+// Executor forms (see executor.hpp): each chunk is bounded on its own and the
+// chunk boxes merged.
+
+template <typename T>
+inline basic_aabb3<T> compute_aabb(executor& ex, basic_vec3<T> const* points, size_t n)
+{
+	return parallel_reduce(ex, n, detail::parallel_grain(sizeof(*points)), basic_aabb3<T>::empty(), [&](size_t begin, size_t end) {
+		return detail::bounds(points, begin, end);
+	}, detail::merge_aabb<T>);
+}
+
+inline aabb3 compute_aabb(executor& ex, vec3_soa const& points)
+{
+	return parallel_reduce(ex, points.size(), detail::parallel_grain(3 * sizeof(float)), aabb3::empty(), [&](size_t begin, size_t end) {
+		return detail::bounds(points, begin, end);
+	}, detail::merge_aabb<float>);
+}
+
+}
+
+#endif
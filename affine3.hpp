@@ -0,0 +1,120 @@
+#ifndef AFFINE3_H
+#define AFFINE3_H
+
+#include "vec3.hpp"
+#include "mat3.hpp"
+#include "mat4.hpp"
+#include "transform.hpp"
+
+namespace xxx
+{
+
+// Affine transform stored as the upper 3x4 part of a mat4: columns x, y, z
+// hold the linear part and w the translation, the implied last row is
+// (0, 0, 0, 1). Conventions match mat4, including the order of operator *.
+template <typename T>
+struct basic_affine3
+{
+	typedef T value_type;
+
+	basic_vec3<T> x, y, z, w;
+
+	basic_affine3() = default;
+	explicit constexpr basic_affine3(basic_vec3<T> const& x, basic_vec3<T> const& y, basic_vec3<T> const& z, basic_vec3<T> const& w) : x(x), y(y), z(z), w(w) {}
+	explicit constexpr basic_affine3(basic_mat3<T> const& m, basic_vec3<T> const& w) : x(m.x), y(m.y), z(m.z), w(w) {}
+	// Drops the last row of m, which must be (0, 0, 0, 1) for the result to be meaningful.
+	explicit constexpr basic_affine3(basic_mat4<T> const& m) : x(m.x.to_vec3()), y(m.y.to_vec3()), z(m.z.to_vec3()), w(m.w.to_vec3()) {}
+	explicit basic_affine3(basic_transform<T> const& t) : basic_affine3(t.rotation.to_matrix(), t.position) {}
+	template <typename U>
+	explicit constexpr basic_affine3(basic_affine3<U> const& m) : x(m.x), y(m.y), z(m.z), w(m.w) {}
+
+	constexpr basic_mat3<T> to_mat3() const
+	{
+		return basic_mat3<T>(x, y, z);
+	}
+
+	constexpr basic_mat4<T> to_mat4() const
+	{
+		return basic_mat4<T>(basic_vec4<T>(x, 0), basic_vec4<T>(y, 0), basic_vec4<T>(z, 0), basic_vec4<T>(w, 1));
+	}
+
+	// The linear part must be a rotation; scale and shear are not representable.
+	basic_transform<T> to_transform() const
+	{
+		return basic_transform<T>(w, basic_quaternion<T>::from_matrix(to_mat3()));
+	}
+
+	static constexpr basic_affine3 identity()
+	{
+		return basic_affine3(basic_vec3<T>(1, 0, 0), basic_vec3<T>(0, 1, 0), basic_vec3<T>(0, 0, 1), basic_vec3<T>(0, 0, 0));
+	}
+};
+
+typedef basic_affine3<scalar_t> affine3;
+typedef basic_affine3<double> daffine3;
+
+template <typename T>
+inline constexpr basic_vec3<T> transform_point(basic_affine3<T> const& m, basic_vec3<T> const& p)
+{
+	return basic_vec3<T>(
+		p.x * m.x.x + p.y * m.y.x + p.z * m.z.x + m.w.x,
+		p.x * m.x.y + p.y * m.y.y + p.z * m.z.y + m.w.y,
+		p.x * m.x.z + p.y * m.y.z + p.z * m.z.z + m.w.z);
+}
+
+template <typename T>
+inline constexpr basic_vec3<T> transform_vector(basic_affine3<T> const& m, basic_vec3<T> const& v)
+{
+	return basic_vec3<T>(
+		v.x * m.x.x + v.y * m.y.x + v.z * m.z.x,
+		v.x * m.x.y + v.y * m.y.y + v.z * m.z.y,
+		v.x * m.x.z + v.y * m.y.z + v.z * m.z.z);
+}
+
+// Same as a.to_mat4() * b.to_mat4(): a is applied first.
+template <typename T>
+inline constexpr basic_affine3<T> operator * (basic_affine3<T> const& a, basic_affine3<T> const& b)
+{
+	return basic_affine3<T>(
+		transform_vector(b, a.x),
+		transform_vector(b, a.y),
+		transform_vector(b, a.z),
+		transform_point(b, a.w));
+}
+
+// Returns false and sets r to identity if the linear part is singular.
+template <typename T>
+inline constexpr bool inverse(basic_affine3<T> const& m, basic_affine3<T>& r)
+{
+	basic_mat3<T> a = basic_mat3<T>::identity();
+	if (inverse(m.to_mat3(), a))
+	{
+		r = basic_affine3<T>(a, inverse(a * m.w));
+		return true;
+	}
+	else
+	{
+		r = basic_affine3<T>::identity();
+		return false;
+	}
+}
+
+template <typename T>
+inline constexpr basic_affine3<T> inverse(basic_affine3<T> const& m)
+{
+	basic_affine3<T> r = basic_affine3<T>::identity();
+	inverse(m, r);
+	return r;
+}
+
+// Inverse of a rotation followed by a translation. m must not contain scale or shear.
+template <typename T>
+inline constexpr basic_affine3<T> inverse_rigid(basic_affine3<T> const& m)
+{
+	basic_mat3<T> const a = transpose(m.to_mat3());
+	return basic_affine3<T>(a, inverse(a * m.w));
+}
+
+}
+
+#endif
@@ -0,0 +1,526 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "vec3.hpp"
+#include "quaternion.hpp"
+#include "batch.hpp"
+#include "executor.hpp"
+#include "simd.hpp"
+
+namespace xxx
+{
+
+// How a track moves between its keys. linear uses mix() for vec3 and
+// slerp_approx() for quaternions. cubic runs a cubic Hermite curve through
+// the keys with the tangent at each key taken from its neighbours,
+// (next - previous) / (time of next - time of previous), and one-sided at the
+// first and last key. Tracks added with explicit tangents are Hermite curves
+// with those tangents. Cubic and Hermite quaternions are interpolated per
+// component and normalized, with every key flipped as needed to lie on the
+// same hemisphere as the one before.
+enum class interpolation
+{
+	linear,
+	cubic
+};
+
+class animation;
+
+// Playback state of one instance of an animation: the key every track was at
+// when it was last sampled. Sampling at increasing times moves each track
+// forward from there, O(1) per track amortized; going back, as when a loop
+// restarts, searches the track's keys. reset() before using a cursor with
+// another animation.
+class animation_cursor
+{
+public:
+	void reset()
+	{
+		keys.clear();
+	}
+
+private:
+	friend class animation;
+
+	std::vector<uint32_t> keys;
+};
+
+namespace detail
+{
+
+// The tracks of one kind with their keys back to back: track i has the keys
+// [first[i], first[i + 1]) of times and of the N float streams, writes output
+// outputs[i] and keeps its key at slots[i] in a cursor. Hermite lists store
+// the value, in tangent and out tangent of every key, N / 3 streams each.
+template <size_t N>
+struct track_list
+{
+	// Floats of a value, the rest of a key being its tangents.
+	static size_t const values = N > 4 ? N / 3 : N;
+
+	track_list() : first(1, 0) {}
+
+	size_t size() const
+	{
+		return outputs.size();
+	}
+
+	std::vector<uint32_t> first;
+	std::vector<uint32_t> outputs;
+	std::vector<uint32_t> slots;
+	std::vector<float> times;
+	std::vector<float> streams[N];
+};
+
+// A track_list as raw pointers for sampling, with the streams to read from
+// the key before a time, a, and from the one after it, b: the value, and for
+// Hermite lists the out tangent of a and the in tangent of b.
+struct track_view
+{
+	template <size_t N>
+	explicit track_view(track_list<N> const& list)
+		: first(list.first.data()), outputs(list.outputs.data()), slots(list.slots.data()), times(list.times.data()), count(N > 4 ? 2 * N / 3 : N)
+	{
+		size_t const v = track_list<N>::values;
+		for (size_t c = 0; c < v; ++c)
+		{
+			a[c] = b[c] = list.streams[c].data();
+		}
+		for (size_t c = v; c < count; ++c)
+		{
+			a[c] = list.streams[v + c].data();
+			b[c] = list.streams[c].data();
+		}
+	}
+
+	uint32_t const* first;
+	uint32_t const* outputs;
+	uint32_t const* slots;
+	float const* times;
+	float const* a[8];
+	float const* b[8];
+	size_t count;
+};
+
+// Keys a and b around a time, u the time past a and dt the time from a to b.
+// Before the first key and from the last key on, a and b are that key, u is 0
+// and dt 1, so that u / dt is 0 either way.
+struct track_key
+{
+	uint32_t a, b;
+	float u, dt;
+};
+
+inline bool increasing(float const* times, size_t n)
+{
+	for (size_t i = 1; i < n; ++i)
+	{
+		if (!(times[i - 1] < times[i]))
+		{
+			return false;
+		}
+	}
+	return n > 0 && n < 0xffffffffu;
+}
+
+// Finds the keys of track j around time, starting from the key the cursor
+// keys holds for it and leaving the new one there.
+inline track_key locate(track_view const& v, uint32_t* keys, size_t j, float time)
+{
+	uint32_t const first = v.first[j];
+	float const* const t = v.times + first;
+	uint32_t const last = v.first[j + 1] - first - 1;
+	uint32_t& key = keys[v.slots[j]];
+	uint32_t k = key < last ? key : last;
+	if (time < t[k])
+	{
+		k = static_cast<uint32_t>(std::upper_bound(t, t + k, time) - t);
+		k = k > 0 ? k - 1 : 0;
+	}
+	else
+	{
+		// A few steps forward, then a search for longer jumps.
+		uint32_t const steps = last - k < 4 ? last : k + 4;
+		while (k < steps && t[k + 1] <= time)
+		{
+			++k;
+		}
+		if (k < last && t[k + 1] <= time)
+		{
+			k = static_cast<uint32_t>(std::upper_bound(t + k + 1, t + last + 1, time) - t) - 1;
+		}
+	}
+	key = k;
+
+	track_key r;
+	r.a = first + k;
+	if (k == last || time <= t[k])
+	{
+		r.b = r.a;
+		r.u = 0;
+		r.dt = 1;
+	}
+	else
+	{
+		r.b = r.a + 1;
+		r.u = time - t[k];
+		r.dt = t[k + 1] - t[k];
+	}
+	return r;
+}
+
+// Tangents for interpolation::cubic, of n keys of c floats each.
+inline void cubic_tangents(float const* times, float const* values, size_t n, size_t c, float* tangents)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		size_t const a = i > 0 ? i - 1 : 0;
+		size_t const b = i + 1 < n ? i + 1 : i;
+		float const dt = times[b] - times[a];
+		for (size_t k = 0; k < c; ++k)
+		{
+			tangents[i * c + k] = b > a ? (values[b * c + k] - values[a * c + k]) / dt : 0;
+		}
+	}
+}
+
+// Weights of p0, m0, p1 and m1 on the cubic Hermite curve at s, those of the
+// tangents scaled by dt.
+template <typename P>
+inline void hermite_weights(P s, P dt, P* h)
+{
+	P const two = simd::splat<P>(2);
+	P const s2 = simd::mul(s, s);
+	P const s3 = simd::mul(s2, s);
+	h[2] = simd::sub(simd::mul(simd::splat<P>(3), s2), simd::mul(two, s3));
+	h[0] = simd::sub(simd::splat<P>(1), h[2]);
+	h[1] = simd::mul(simd::add(simd::sub(s3, simd::mul(two, s2)), s), dt);
+	h[3] = simd::mul(simd::sub(s3, s2), dt);
+}
+
+template <typename P>
+inline P hermite(P p0, P m0, P p1, P m1, P const* h)
+{
+	return simd::madd(m1, h[3], simd::madd(p1, h[2], simd::madd(m0, h[1], simd::mul(p0, h[0]))));
+}
+
+// sample_tracks evaluates tracks [i, i + width of P) of a list: the keys are
+// gathered lane by lane into g, as u, dt and then the streams of key a and of
+// key b.
+
+template <typename P>
+inline void gather_keys(track_view const& v, uint32_t* keys, float time, size_t i, float (*g)[8])
+{
+	size_t const n = v.count;
+	for (size_t k = 0; k < sizeof(P) / sizeof(float); ++k)
+	{
+		track_key const p = locate(v, keys, i + k, time);
+		g[0][k] = p.u;
+		g[1][k] = p.dt;
+		for (size_t c = 0; c < n; ++c)
+		{
+			g[2 + c][k] = v.a[c][p.a];
+			g[2 + n + c][k] = v.b[c][p.b];
+		}
+	}
+}
+
+template <typename P>
+inline void sample_tracks(track_list<3> const&, track_view const& v, uint32_t* keys, float time, size_t i, vec3* out)
+{
+	float g[8][8];
+	gather_keys<P>(v, keys, time, i, g);
+	P const s = simd::div(simd::load<P>(g[0]), simd::load<P>(g[1]));
+	float o[3][8];
+	for (size_t c = 0; c < 3; ++c)
+	{
+		P const a = simd::load<P>(g[2 + c]);
+		simd::store(o[c], simd::madd(simd::sub(simd::load<P>(g[5 + c]), a), s, a));
+	}
+	for (size_t k = 0; k < sizeof(P) / sizeof(float); ++k)
+	{
+		out[v.outputs[i + k]] = vec3(o[0][k], o[1][k], o[2][k]);
+	}
+}
+
+template <typename P>
+inline void sample_tracks(track_list<9> const&, track_view const& v, uint32_t* keys, float time, size_t i, vec3* out)
+{
+	float g[14][8];
+	gather_keys<P>(v, keys, time, i, g);
+	P const dt = simd::load<P>(g[1]);
+	P h[4];
+	hermite_weights(simd::div(simd::load<P>(g[0]), dt), dt, h);
+	float o[3][8];
+	for (size_t c = 0; c < 3; ++c)
+	{
+		simd::store(o[c], hermite(simd::load<P>(g[2 + c]), simd::load<P>(g[5 + c]), simd::load<P>(g[8 + c]), simd::load<P>(g[11 + c]), h));
+	}
+	for (size_t k = 0; k < sizeof(P) / sizeof(float); ++k)
+	{
+		out[v.outputs[i + k]] = vec3(o[0][k], o[1][k], o[2][k]);
+	}
+}
+
+template <typename P>
+inline void sample_tracks(track_list<4> const&, track_view const& v, uint32_t* keys, float time, size_t i, quaternion* out)
+{
+	float g[10][8];
+	gather_keys<P>(v, keys, time, i, g);
+	P a[4], b[4], q[4];
+	for (size_t c = 0; c < 4; ++c)
+	{
+		a[c] = simd::load<P>(g[2 + c]);
+		b[c] = simd::load<P>(g[6 + c]);
+	}
+	slerp_op()(a, b, simd::div(simd::load<P>(g[0]), simd::load<P>(g[1])), q);
+	float o[4][8];
+	for (size_t c = 0; c < 4; ++c)
+	{
+		simd::store(o[c], q[c]);
+	}
+	for (size_t k = 0; k < sizeof(P) / sizeof(float); ++k)
+	{
+		out[v.outputs[i + k]] = quaternion(o[0][k], o[1][k], o[2][k], o[3][k]);
+	}
+}
+
+template <typename P>
+inline void sample_tracks(track_list<12> const&, track_view const& v, uint32_t* keys, float time, size_t i, quaternion* out)
+{
+	float g[18][8];
+	gather_keys<P>(v, keys, time, i, g);
+	P const dt = simd::load<P>(g[1]);
+	P h[4];
+	hermite_weights(simd::div(simd::load<P>(g[0]), dt), dt, h);
+	P q[4];
+	for (size_t c = 0; c < 4; ++c)
+	{
+		q[c] = hermite(simd::load<P>(g[2 + c]), simd::load<P>(g[6 + c]), simd::load<P>(g[10 + c]), simd::load<P>(g[14 + c]), h);
+	}
+	P const in = simd::div(simd::splat<P>(1), simd::sqrt(dot4(q, q)));
+	float o[4][8];
+	for (size_t c = 0; c < 4; ++c)
+	{
+		simd::store(o[c], simd::mul(q[c], in));
+	}
+	for (size_t k = 0; k < sizeof(P) / sizeof(float); ++k)
+	{
+		out[v.outputs[i + k]] = quaternion(o[0][k], o[1][k], o[2][k], o[3][k]);
+	}
+}
+
+template <size_t N, typename T>
+inline void sample_range(track_list<N> const& list, uint32_t* keys, float time, size_t begin, size_t end, T* out)
+{
+	track_view const v(list);
+	size_t const w = simd::width;
+	size_t i = begin;
+	for (; i + w <= end; i += w)
+	{
+		sample_tracks<simd::floatn>(list, v, keys, time, i, out);
+	}
+	for (; i < end; ++i)
+	{
+		sample_tracks<float>(list, v, keys, time, i, out);
+	}
+}
+
+}
+
+// Keyframed vec3 and quaternion tracks, sampled all at once. Keys are stored
+// as SoA streams, tracks grouped by type and interpolation; sample() finds
+// each track's keys from a cursor and interpolates whole SIMD packs of tracks,
+// and the executor form splits the tracks over threads. Results are the same
+// for every form and for tracks in a pack or not (see mat4.hpp for the FMA
+// caveat).
+class animation
+{
+public:
+	static size_t const none = ~size_t(0);
+
+	animation() : vec3_count(0), quaternion_count(0), end_time(0) {}
+
+	size_t vec3_tracks() const
+	{
+		return vec3_count;
+	}
+
+	size_t quaternion_tracks() const
+	{
+		return quaternion_count;
+	}
+
+	// The time of the last key of any track.
+	float duration() const
+	{
+		return end_time;
+	}
+
+	void clear()
+	{
+		*this = animation();
+	}
+
+	// Adds a track of n keys at increasing times and returns its index among
+	// the tracks of its type, or none if n is 0 or the times do not increase.
+	size_t add(float const* times, vec3 const* values, size_t n, interpolation mode = interpolation::linear)
+	{
+		if (!detail::increasing(times, n))
+		{
+			return none;
+		}
+		if (mode == interpolation::linear)
+		{
+			return add_track(linear_vec3s, vec3_count, times, n, &values[0].x, 0, 0);
+		}
+		std::vector<float> tangents(3 * n);
+		detail::cubic_tangents(times, &values[0].x, n, 3, tangents.data());
+		return add_track(hermite_vec3s, vec3_count, times, n, &values[0].x, tangents.data(), tangents.data());
+	}
+
+	size_t add(float const* times, quaternion const* values, size_t n, interpolation mode = interpolation::linear)
+	{
+		if (!detail::increasing(times, n))
+		{
+			return none;
+		}
+		if (mode == interpolation::linear)
+		{
+			return add_track(linear_quaternions, quaternion_count, times, n, &values[0].x, 0, 0);
+		}
+		std::vector<float> q(&values[0].x, &values[0].x + 4 * n);
+		std::vector<float> tangents(4 * n);
+		align(q.data(), 0, 0, n);
+		detail::cubic_tangents(times, q.data(), n, 4, tangents.data());
+		return add_track(hermite_quaternions, quaternion_count, times, n, q.data(), tangents.data(), tangents.data());
+	}
+
+	// Hermite tracks: in_tangents[i] and out_tangents[i] are the derivatives
+	// with respect to time coming into and going out of key i.
+	size_t add(float const* times, vec3 const* values, vec3 const* in_tangents, vec3 const* out_tangents, size_t n)
+	{
+		if (!detail::increasing(times, n))
+		{
+			return none;
+		}
+		return add_track(hermite_vec3s, vec3_count, times, n, &values[0].x, &in_tangents[0].x, &out_tangents[0].x);
+	}
+
+	size_t add(float const* times, quaternion const* values, quaternion const* in_tangents, quaternion const* out_tangents, size_t n)
+	{
+		if (!detail::increasing(times, n))
+		{
+			return none;
+		}
+		std::vector<float> q(&values[0].x, &values[0].x + 4 * n);
+		std::vector<float> in(&in_tangents[0].x, &in_tangents[0].x + 4 * n);
+		std::vector<float> out(&out_tangents[0].x, &out_tangents[0].x + 4 * n);
+		align(q.data(), in.data(), out.data(), n);
+		return add_track(hermite_quaternions, quaternion_count, times, n, q.data(), in.data(), out.data());
+	}
+
+	// Every track at time, into vectors[vec3_tracks()] and
+	// rotations[quaternion_tracks()], by track index. Tracks hold their first
+	// key before it and their last key after it.
+	void sample(animation_cursor& cursor, float time, vec3* vectors, quaternion* rotations) const
+	{
+		uint32_t* const keys = prepare(cursor);
+		detail::sample_range(linear_vec3s, keys, time, 0, linear_vec3s.size(), vectors);
+		detail::sample_range(hermite_vec3s, keys, time, 0, hermite_vec3s.size(), vectors);
+		detail::sample_range(linear_quaternions, keys, time, 0, linear_quaternions.size(), rotations);
+		detail::sample_range(hermite_quaternions, keys, time, 0, hermite_quaternions.size(), rotations);
+	}
+
+	void sample(executor& ex, animation_cursor& cursor, float time, vec3* vectors, quaternion* rotations) const
+	{
+		uint32_t* const keys = prepare(cursor);
+		size_t const grain = detail::parallel_grain(2 * sizeof(quaternion));
+		parallel_for(ex, linear_vec3s.size(), grain, [&](size_t begin, size_t end) {
+			detail::sample_range(linear_vec3s, keys, time, begin, end, vectors);
+		});
+		parallel_for(ex, hermite_vec3s.size(), grain, [&](size_t begin, size_t end) {
+			detail::sample_range(hermite_vec3s, keys, time, begin, end, vectors);
+		});
+		parallel_for(ex, linear_quaternions.size(), grain, [&](size_t begin, size_t end) {
+			detail::sample_range(linear_quaternions, keys, time, begin, end, rotations);
+		});
+		parallel_for(ex, hermite_quaternions.size(), grain, [&](size_t begin, size_t end) {
+			detail::sample_range(hermite_quaternions, keys, time, begin, end, rotations);
+		});
+	}
+
+private:
+	// Appends a track with n keys of values, and of in and out tangents for
+	// Hermite lists, N / 3 floats each.
+	template <size_t N>
+	size_t add_track(detail::track_list<N>& list, size_t& count, float const* times, size_t n, float const* values, float const* in, float const* out)
+	{
+		size_t const c = in ? N / 3 : N;
+		list.times.insert(list.times.end(), times, times + n);
+		for (size_t k = 0; k < c; ++k)
+		{
+			for (size_t i = 0; i < n; ++i)
+			{
+				list.streams[k].push_back(values[i * c + k]);
+				if (in)
+				{
+					list.streams[c + k].push_back(in[i * c + k]);
+					list.streams[2 * c + k].push_back(out[i * c + k]);
+				}
+			}
+		}
+		list.first.push_back(static_cast<uint32_t>(list.times.size()));
+		list.outputs.push_back(static_cast<uint32_t>(count));
+		list.slots.push_back(static_cast<uint32_t>(vec3_count + quaternion_count));
+		end_time = vec3_count + quaternion_count == 0 || times[n - 1] > end_time ? times[n - 1] : end_time;
+		return count++;
+	}
+
+	// Flips keys, and their tangents, onto the hemisphere of the key before.
+	static void align(float* q, float* in, float* out, size_t n)
+	{
+		for (size_t i = 1; i < n; ++i)
+		{
+			float* const a = q + 4 * (i - 1);
+			float* const b = q + 4 * i;
+			if (a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3] < 0)
+			{
+				for (size_t k = 0; k < 4; ++k)
+				{
+					b[k] = -b[k];
+					if (in)
+					{
+						in[4 * i + k] = -in[4 * i + k];
+						out[4 * i + k] = -out[4 * i + k];
+					}
+				}
+			}
+		}
+	}
+
+	uint32_t* prepare(animation_cursor& cursor) const
+	{
+		cursor.keys.resize(vec3_count + quaternion_count);
+		return cursor.keys.data();
+	}
+
+	size_t vec3_count;
+	size_t quaternion_count;
+	float end_time;
+
+	detail::track_list<3> linear_vec3s;
+	detail::track_list<9> hermite_vec3s;
+	detail::track_list<4> linear_quaternions;
+	detail::track_list<12> hermite_quaternions;
+};
+
+}
+
+#endif
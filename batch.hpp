@@ -0,0 +1,981 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+
+#include "mat4.hpp"
+#include "affine3.hpp"
+#include "dual_quaternion.hpp"
+#include "executor.hpp"
+#include "simd.hpp"
+
+namespace xxx
+{
+
+// Batch transforms. The matrix is loaded once and kept in registers for the
+// whole array; results match the per-element operators (see mat4.hpp for the FMA
+// caveat). in and out may be the same array, other overlaps are not allowed.
+// The generic versions are plain loops; the single-precision overloads below
+// are the vectorized ones.
+
+// m * vec4(in[i]) for every element.
+template <typename T>
+inline void transform_vectors(basic_mat4<T> const& m, basic_vec4<T> const* in, basic_vec4<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = m * in[i];
+	}
+}
+
+// m * in[i] for every element.
+template <typename T>
+inline void transform_vectors(basic_mat3<T> const& m, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = m * in[i];
+	}
+}
+
+// (m * vec4(in[i], 1)).to_vec3() for every element; no perspective divide.
+template <typename T>
+inline void transform_points(basic_mat4<T> const& m, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = (m * basic_vec4<T>(in[i], 1)).to_vec3();
+	}
+}
+
+// (m * vec4(in[i], 0)).to_vec3() for every element.
+template <typename T>
+inline void transform_directions(basic_mat4<T> const& m, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = (m * basic_vec4<T>(in[i], 0)).to_vec3();
+	}
+}
+
+template <typename T>
+inline void transform_points(basic_affine3<T> const& m, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = transform_point(m, in[i]);
+	}
+}
+
+template <typename T>
+inline void transform_directions(basic_affine3<T> const& m, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = transform_vector(m, in[i]);
+	}
+}
+
+// rotate(in[i], q) for every element; q must be unit length.
+template <typename T>
+inline void rotate_vectors(basic_quaternion<T> const& q, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = rotate(in[i], q);
+	}
+}
+
+// t * in[i] for every element.
+template <typename T>
+inline void transform_points(basic_transform<T> const& t, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = t * in[i];
+	}
+}
+
+// slerp_approx(a[i], b[i], t[i]) for every element.
+template <typename T>
+inline void slerp_n(basic_quaternion<T> const* a, basic_quaternion<T> const* b, T const* t, basic_quaternion<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = slerp_approx(a[i], b[i], t[i]);
+	}
+}
+
+// nlerp(a[i], b[i], t[i]) for every element.
+template <typename T>
+inline void nlerp_n(basic_quaternion<T> const* a, basic_quaternion<T> const* b, T const* t, basic_quaternion<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = nlerp(a[i], b[i], t[i]);
+	}
+}
+
+// normalize<Q>(in[i]) for every element.
+template <precision Q = default_precision, typename T>
+inline void normalize_n(basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = normalize<Q>(in[i]);
+	}
+}
+
+template <precision Q = default_precision, typename T>
+inline void normalize_n(basic_vec4<T> const* in, basic_vec4<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = normalize<Q>(in[i]);
+	}
+}
+
+// a[i] * b[i] for every element, e.g. parent and local matrices into world
+// matrices. out may be the same array as a or b.
+template <typename T>
+inline void mul_n(basic_mat4<T> const* a, basic_mat4<T> const* b, basic_mat4<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = a[i] * b[i];
+	}
+}
+
+template <typename T>
+inline void mul_n(basic_affine3<T> const* a, basic_affine3<T> const* b, basic_affine3<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = a[i] * b[i];
+	}
+}
+
+template <typename T>
+inline void mul_n(basic_transform<T> const* a, basic_transform<T> const* b, basic_transform<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = a[i] * b[i];
+	}
+}
+
+// dlb(a[i], b[i], t[i]) for every element.
+template <typename T>
+inline void dlb_n(basic_dual_quaternion<T> const* a, basic_dual_quaternion<T> const* b, T const* t, basic_dual_quaternion<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = dlb(a[i], b[i], t[i]);
+	}
+}
+
+// sclerp(a[i], b[i], t[i]) for every element.
+template <typename T>
+inline void sclerp_n(basic_dual_quaternion<T> const* a, basic_dual_quaternion<T> const* b, T const* t, basic_dual_quaternion<T>* out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = sclerp(a[i], b[i], t[i]);
+	}
+}
+
+// transform_point(q, in[i]) for every element.
+template <typename T>
+inline void transform_points(basic_dual_quaternion<T> const& q, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	basic_vec3<T> const t = q.translation();
+	for (size_t i = 0; i < n; ++i)
+	{
+		out[i] = rotate(in[i], q.real) + t;
+	}
+}
+
+namespace detail
+{
+
+#if defined(XXX_SSE)
+
+template <typename P>
+inline void transform3(P const* m, P& x, P& y, P& z)
+{
+	P const ox = simd::madd(z, m[6], simd::madd(y, m[3], simd::mul(x, m[0])));
+	P const oy = simd::madd(z, m[7], simd::madd(y, m[4], simd::mul(x, m[1])));
+	P const oz = simd::madd(z, m[8], simd::madd(y, m[5], simd::mul(x, m[2])));
+	x = ox;
+	y = oy;
+	z = oz;
+}
+
+// Same operation order as rotate(); q holds splats of x, y, z, w and 2.
+template <typename P>
+inline void rotate3(P const* q, P& x, P& y, P& z)
+{
+	P const tx = simd::mul(simd::sub(simd::mul(q[1], z), simd::mul(q[2], y)), q[4]);
+	P const ty = simd::mul(simd::sub(simd::mul(q[2], x), simd::mul(q[0], z)), q[4]);
+	P const tz = simd::mul(simd::sub(simd::mul(q[0], y), simd::mul(q[1], x)), q[4]);
+	x = simd::add(simd::madd(tx, q[3], x), simd::sub(simd::mul(q[1], tz), simd::mul(q[2], ty)));
+	y = simd::add(simd::madd(ty, q[3], y), simd::sub(simd::mul(q[2], tx), simd::mul(q[0], tz)));
+	z = simd::add(simd::madd(tz, q[3], z), simd::sub(simd::mul(q[0], ty), simd::mul(q[1], tx)));
+}
+
+#endif
+
+// Quaternion blends over x, y, z, w lanes, in the operation order of the
+// scalar functions.
+
+template <typename P>
+inline P dot4(P const* a, P const* b)
+{
+	return simd::madd(a[3], b[3], simd::madd(a[2], b[2], simd::madd(a[1], b[1], simd::mul(a[0], b[0]))));
+}
+
+struct slerp_op
+{
+	template <typename P>
+	void operator () (P const* a, P const* b, P t, P* o) const
+	{
+		P const one = simd::splat<P>(1);
+		P const cosine = dot4(a, b);
+		P const xm1 = simd::sub(simd::abs(cosine), one);
+		P const d = simd::sub(one, t);
+		P const tt = simd::mul(t, t);
+		P const dd = simd::mul(d, d);
+
+		P upper_weight = one;
+		P lower_weight = one;
+		for (int i = slerp_table<float>::size - 1; i >= 0; --i)
+		{
+			P const u = simd::splat<P>(slerp_table<float>::u[i]);
+			P const v = simd::splat<P>(slerp_table<float>::v[i]);
+			upper_weight = simd::madd(simd::mul(simd::sub(simd::mul(u, tt), v), xm1), upper_weight, one);
+			lower_weight = simd::madd(simd::mul(simd::sub(simd::mul(u, dd), v), xm1), lower_weight, one);
+		}
+		upper_weight = simd::mul(upper_weight, simd::flipsign(t, cosine));
+		lower_weight = simd::mul(lower_weight, d);
+
+		for (int k = 0; k < 4; ++k)
+		{
+			o[k] = simd::madd(b[k], upper_weight, simd::mul(a[k], lower_weight));
+		}
+	}
+
+	quaternion operator () (quaternion const& a, quaternion const& b, float t) const
+	{
+		return slerp_approx(a, b, t);
+	}
+};
+
+struct nlerp_op
+{
+	template <typename P>
+	void operator () (P const* a, P const* b, P t, P* o) const
+	{
+		P const lower_weight = simd::sub(simd::splat<P>(1), t);
+		P const upper_weight = simd::flipsign(t, dot4(a, b));
+		for (int k = 0; k < 4; ++k)
+		{
+			o[k] = simd::madd(b[k], upper_weight, simd::mul(a[k], lower_weight));
+		}
+		// The blend of two unit quaternions on the same hemisphere has length
+		// of at least 1/sqrt(2), so the zero check of normalize() is not needed.
+		// Normalized at the default precision, as nlerp() does.
+		P const in = rsqrt<default_precision>(dot4(o, o));
+		for (int k = 0; k < 4; ++k)
+		{
+			o[k] = simd::mul(o[k], in);
+		}
+	}
+
+	quaternion operator () (quaternion const& a, quaternion const& b, float t) const
+	{
+		return nlerp(a, b, t);
+	}
+};
+
+// out[i] = op(a[i], b[i], t[i]); quaternions are transposed into x, y, z, w lanes.
+template <typename Op>
+inline void blend_n(Op const& op, quaternion const* a, quaternion const* b, float const* t, quaternion* out, size_t n)
+{
+	size_t i = 0;
+
+#if defined(XXX_AVX)
+	for (; i + 8 <= n; i += 8)
+	{
+		simd::float4 a4[8], b4[8];
+		for (int k = 0; k < 8; ++k)
+		{
+			a4[k] = simd::load(&a[i + k].x);
+			b4[k] = simd::load(&b[i + k].x);
+		}
+		simd::transpose(a4[0], a4[1], a4[2], a4[3]);
+		simd::transpose(a4[4], a4[5], a4[6], a4[7]);
+		simd::transpose(b4[0], b4[1], b4[2], b4[3]);
+		simd::transpose(b4[4], b4[5], b4[6], b4[7]);
+
+		simd::float8 a8[4], b8[4], o8[4];
+		for (int k = 0; k < 4; ++k)
+		{
+			a8[k] = simd::combine(a4[k], a4[k + 4]);
+			b8[k] = simd::combine(b4[k], b4[k + 4]);
+		}
+		op(a8, b8, simd::load<simd::float8>(t + i), o8);
+
+		simd::float4 o4[8];
+		for (int k = 0; k < 4; ++k)
+		{
+			o4[k] = simd::low(o8[k]);
+			o4[k + 4] = simd::high(o8[k]);
+		}
+		simd::transpose(o4[0], o4[1], o4[2], o4[3]);
+		simd::transpose(o4[4], o4[5], o4[6], o4[7]);
+		for (int k = 0; k < 8; ++k)
+		{
+			simd::store(&out[i + k].x, o4[k]);
+		}
+	}
+#endif
+
+#if defined(XXX_SSE)
+	for (; i + 4 <= n; i += 4)
+	{
+		simd::float4 a4[4], b4[4], o4[4];
+		for (int k = 0; k < 4; ++k)
+		{
+			a4[k] = simd::load(&a[i + k].x);
+			b4[k] = simd::load(&b[i + k].x);
+		}
+		simd::transpose(a4[0], a4[1], a4[2], a4[3]);
+		simd::transpose(b4[0], b4[1], b4[2], b4[3]);
+		op(a4, b4, simd::load<simd::float4>(t + i), o4);
+		simd::transpose(o4[0], o4[1], o4[2], o4[3]);
+		for (int k = 0; k < 4; ++k)
+		{
+			simd::store(&out[i + k].x, o4[k]);
+		}
+	}
+#endif
+
+	for (; i < n; ++i)
+	{
+		out[i] = op(a[i], b[i], t[i]);
+	}
+}
+
+#if defined(XXX_SSE)
+
+// Loads the quaternions at p, p + stride, p + 2 * stride... into x, y, z, w
+// lanes, and the reverse.
+inline void load_lanes(float const* p, size_t stride, simd::float4* v)
+{
+	for (size_t k = 0; k < 4; ++k)
+	{
+		v[k] = simd::load(p + k * stride);
+	}
+	simd::transpose(v[0], v[1], v[2], v[3]);
+}
+
+inline void store_lanes(float* p, size_t stride, simd::float4 const* v)
+{
+	simd::float4 o[4] = { v[0], v[1], v[2], v[3] };
+	simd::transpose(o[0], o[1], o[2], o[3]);
+	for (size_t k = 0; k < 4; ++k)
+	{
+		simd::store(p + k * stride, o[k]);
+	}
+}
+
+#endif
+
+#if defined(XXX_AVX)
+
+inline void load_lanes(float const* p, size_t stride, simd::float8* v)
+{
+	simd::float4 lo[4], hi[4];
+	load_lanes(p, stride, lo);
+	load_lanes(p + 4 * stride, stride, hi);
+	for (size_t k = 0; k < 4; ++k)
+	{
+		v[k] = simd::combine(lo[k], hi[k]);
+	}
+}
+
+inline void store_lanes(float* p, size_t stride, simd::float8 const* v)
+{
+	simd::float4 lo[4], hi[4];
+	for (size_t k = 0; k < 4; ++k)
+	{
+		lo[k] = simd::low(v[k]);
+		hi[k] = simd::high(v[k]);
+	}
+	store_lanes(p, stride, lo);
+	store_lanes(p + 4 * stride, stride, hi);
+}
+
+#endif
+
+// dlb() over lanes, in its operation order; like nlerp_op, the blend of two
+// poses on the same hemisphere cannot have a zero real part.
+template <typename P>
+inline void dlb_pack(dual_quaternion const* a, dual_quaternion const* b, float const* t, dual_quaternion* out)
+{
+	P ra[4], da[4], rb[4], db[4], r[4], d[4];
+	load_lanes(&a->real.x, 8, ra);
+	load_lanes(&a->dual.x, 8, da);
+	load_lanes(&b->real.x, 8, rb);
+	load_lanes(&b->dual.x, 8, db);
+
+	P const tt = simd::load<P>(t);
+	P const lower_weight = simd::sub(simd::splat<P>(1), tt);
+	P const upper_weight = simd::flipsign(tt, dot4(ra, rb));
+	for (int k = 0; k < 4; ++k)
+	{
+		r[k] = simd::madd(rb[k], upper_weight, simd::mul(ra[k], lower_weight));
+		d[k] = simd::madd(db[k], upper_weight, simd::mul(da[k], lower_weight));
+	}
+
+	P const in = simd::div(simd::splat<P>(1), simd::sqrt(dot4(r, r)));
+	for (int k = 0; k < 4; ++k)
+	{
+		r[k] = simd::mul(r[k], in);
+		d[k] = simd::mul(d[k], in);
+	}
+	P const rd = dot4(r, d);
+	for (int k = 0; k < 4; ++k)
+	{
+		d[k] = simd::sub(d[k], simd::mul(r[k], rd));
+	}
+
+	store_lanes(&out->real.x, 8, r);
+	store_lanes(&out->dual.x, 8, d);
+}
+
+inline void dlb_n(dual_quaternion const* a, dual_quaternion const* b, float const* t, dual_quaternion* out, size_t n)
+{
+	size_t i = 0;
+
+#if defined(XXX_AVX)
+	for (; i + 8 <= n; i += 8)
+	{
+		dlb_pack<simd::float8>(a + i, b + i, t + i, out + i);
+	}
+#endif
+
+#if defined(XXX_SSE)
+	for (; i + 4 <= n; i += 4)
+	{
+		dlb_pack<simd::float4>(a + i, b + i, t + i, out + i);
+	}
+#endif
+
+	for (; i < n; ++i)
+	{
+		out[i] = dlb(a[i], b[i], t[i]);
+	}
+}
+
+template <precision Q>
+inline void normalize3_n(vec3 const* in, vec3* out, size_t n)
+{
+	size_t i = 0;
+
+#if defined(XXX_AVX)
+	for (; i + 8 <= n; i += 8)
+	{
+		simd::float4 x0, y0, z0, x1, y1, z1;
+		simd::load3(&in[i].x, x0, y0, z0);
+		simd::load3(&in[i + 4].x, x1, y1, z1);
+		simd::float8 const x = simd::combine(x0, x1);
+		simd::float8 const y = simd::combine(y0, y1);
+		simd::float8 const z = simd::combine(z0, z1);
+		simd::float8 const s = rsqrt<Q>(simd::madd(z, z, simd::madd(y, y, simd::mul(x, x))));
+		simd::float8 const ox = simd::mul(x, s);
+		simd::float8 const oy = simd::mul(y, s);
+		simd::float8 const oz = simd::mul(z, s);
+		simd::store3(&out[i].x, simd::low(ox), simd::low(oy), simd::low(oz));
+		simd::store3(&out[i + 4].x, simd::high(ox), simd::high(oy), simd::high(oz));
+	}
+#endif
+
+#if defined(XXX_SSE)
+	for (; i + 4 <= n; i += 4)
+	{
+		simd::float4 x, y, z;
+		simd::load3(&in[i].x, x, y, z);
+		simd::float4 const s = rsqrt<Q>(simd::madd(z, z, simd::madd(y, y, simd::mul(x, x))));
+		simd::store3(&out[i].x, simd::mul(x, s), simd::mul(y, s), simd::mul(z, s));
+	}
+#endif
+
+	for (; i < n; ++i)
+	{
+		out[i] = normalize<Q>(in[i]);
+	}
+}
+
+template <precision Q>
+inline void normalize4_n(vec4 const* in, vec4* out, size_t n)
+{
+	size_t i = 0;
+
+#if defined(XXX_SSE)
+	for (; i + 4 <= n; i += 4)
+	{
+		simd::float4 v[4];
+		for (int k = 0; k < 4; ++k)
+		{
+			v[k] = simd::load(&in[i + k].x);
+		}
+		simd::transpose(v[0], v[1], v[2], v[3]);
+		simd::float4 const s = rsqrt<Q>(simd::madd(v[3], v[3], simd::madd(v[2], v[2], simd::madd(v[1], v[1], simd::mul(v[0], v[0])))));
+		for (int k = 0; k < 4; ++k)
+		{
+			v[k] = simd::mul(v[k], s);
+		}
+		simd::transpose(v[0], v[1], v[2], v[3]);
+		for (int k = 0; k < 4; ++k)
+		{
+			simd::store(&out[i + k].x, v[k]);
+		}
+	}
+#endif
+
+	for (; i < n; ++i)
+	{
+		out[i] = normalize<Q>(in[i]);
+	}
+}
+
+// out[i] = rotate(in[i], q) (+ t)
+inline void rotate_n(quaternion const& q, vec3 const* t, vec3 const* in, vec3* out, size_t n)
+{
+	size_t i = 0;
+
+#if defined(XXX_SSE)
+	float const e[8] = { q.x, q.y, q.z, q.w, 2, t ? t->x : 0, t ? t->y : 0, t ? t->z : 0 };
+
+#if defined(XXX_AVX)
+	simd::float8 q8[8];
+	for (int k = 0; k < 8; ++k)
+	{
+		q8[k] = simd::splat<simd::float8>(e[k]);
+	}
+
+	for (; i + 8 <= n; i += 8)
+	{
+		simd::float4 x0, y0, z0, x1, y1, z1;
+		simd::load3(&in[i].x, x0, y0, z0);
+		simd::load3(&in[i + 4].x, x1, y1, z1);
+		simd::float8 x = simd::combine(x0, x1);
+		simd::float8 y = simd::combine(y0, y1);
+		simd::float8 z = simd::combine(z0, z1);
+		rotate3(q8, x, y, z);
+		if (t)
+		{
+			x = simd::add(x, q8[5]);
+			y = simd::add(y, q8[6]);
+			z = simd::add(z, q8[7]);
+		}
+		simd::store3(&out[i].x, simd::low(x), simd::low(y), simd::low(z));
+		simd::store3(&out[i + 4].x, simd::high(x), simd::high(y), simd::high(z));
+	}
+#endif
+
+	simd::float4 q4[8];
+	for (int k = 0; k < 8; ++k)
+	{
+		q4[k] = simd::splat<simd::float4>(e[k]);
+	}
+
+	for (; i + 4 <= n; i += 4)
+	{
+		simd::float4 x, y, z;
+		simd::load3(&in[i].x, x, y, z);
+		rotate3(q4, x, y, z);
+		if (t)
+		{
+			x = simd::add(x, q4[5]);
+			y = simd::add(y, q4[6]);
+			z = simd::add(z, q4[7]);
+		}
+		simd::store3(&out[i].x, x, y, z);
+	}
+#endif
+
+	for (; i < n; ++i)
+	{
+		vec3 o = rotate(in[i], q);
+		if (t)
+		{
+			o += *t;
+		}
+		out[i] = o;
+	}
+}
+
+// out[i] = cx * in[i].x + cy * in[i].y + cz * in[i].z (+ t)
+inline void transform3_n(vec3 const& cx, vec3 const& cy, vec3 const& cz, vec3 const* t, vec3 const* in, vec3* out, size_t n)
+{
+	size_t i = 0;
+
+#if defined(XXX_SSE)
+	float const e[12] =
+	{
+		cx.x, cx.y, cx.z,
+		cy.x, cy.y, cy.z,
+		cz.x, cz.y, cz.z,
+		t ? t->x : 0, t ? t->y : 0, t ? t->z : 0
+	};
+
+#if defined(XXX_AVX)
+	simd::float8 m8[12];
+	for (int k = 0; k < 12; ++k)
+	{
+		m8[k] = simd::splat<simd::float8>(e[k]);
+	}
+
+	for (; i + 8 <= n; i += 8)
+	{
+		simd::float4 x0, y0, z0, x1, y1, z1;
+		simd::load3(&in[i].x, x0, y0, z0);
+		simd::load3(&in[i + 4].x, x1, y1, z1);
+		simd::float8 x = simd::combine(x0, x1);
+		simd::float8 y = simd::combine(y0, y1);
+		simd::float8 z = simd::combine(z0, z1);
+		transform3(m8, x, y, z);
+		if (t)
+		{
+			x = simd::add(x, m8[9]);
+			y = simd::add(y, m8[10]);
+			z = simd::add(z, m8[11]);
+		}
+		simd::store3(&out[i].x, simd::low(x), simd::low(y), simd::low(z));
+		simd::store3(&out[i + 4].x, simd::high(x), simd::high(y), simd::high(z));
+	}
+#endif
+
+	simd::float4 m4[12];
+	for (int k = 0; k < 12; ++k)
+	{
+		m4[k] = simd::splat<simd::float4>(e[k]);
+	}
+
+	for (; i + 4 <= n; i += 4)
+	{
+		simd::float4 x, y, z;
+		simd::load3(&in[i].x, x, y, z);
+		transform3(m4, x, y, z);
+		if (t)
+		{
+			x = simd::add(x, m4[9]);
+			y = simd::add(y, m4[10]);
+			z = simd::add(z, m4[11]);
+		}
+		simd::store3(&out[i].x, x, y, z);
+	}
+#endif
+
+	for (; i < n; ++i)
+	{
+		vec3 const v = in[i];
+		vec3 o(
+			v.x * cx.x + v.y * cy.x + v.z * cz.x,
+			v.x * cx.y + v.y * cy.y + v.z * cz.y,
+			v.x * cx.z + v.y * cy.z + v.z * cz.z);
+		if (t)
+		{
+			o += *t;
+		}
+		out[i] = o;
+	}
+}
+
+}
+
+inline void transform_vectors(mat4 const& m, vec4 const* in, vec4* out, size_t n)
+{
+	size_t i = 0;
+
+#if defined(XXX_AVX)
+	simd::float8 const mx = simd::combine(simd::load(&m.x.x));
+	simd::float8 const my = simd::combine(simd::load(&m.y.x));
+	simd::float8 const mz = simd::combine(simd::load(&m.z.x));
+	simd::float8 const mw = simd::combine(simd::load(&m.w.x));
+
+	for (; i + 8 <= n; i += 8)
+	{
+		simd::float8 v[4];
+		for (int k = 0; k < 4; ++k)
+		{
+			v[k] = simd::load<simd::float8>(&in[i + 2 * k].x);
+		}
+		for (int k = 0; k < 4; ++k)
+		{
+			simd::float8 r = simd::mul(simd::splat<0>(v[k]), mx);
+			r = simd::madd(simd::splat<1>(v[k]), my, r);
+			r = simd::madd(simd::splat<2>(v[k]), mz, r);
+			v[k] = simd::madd(simd::splat<3>(v[k]), mw, r);
+		}
+		for (int k = 0; k < 4; ++k)
+		{
+			simd::store(&out[i + 2 * k].x, v[k]);
+		}
+	}
+#endif
+
+#if defined(XXX_SSE)
+	simd::float4 const cx = simd::load(&m.x.x);
+	simd::float4 const cy = simd::load(&m.y.x);
+	simd::float4 const cz = simd::load(&m.z.x);
+	simd::float4 const cw = simd::load(&m.w.x);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		simd::float4 v[4];
+		for (int k = 0; k < 4; ++k)
+		{
+			v[k] = simd::load(&in[i + k].x);
+		}
+		for (int k = 0; k < 4; ++k)
+		{
+			simd::float4 r = simd::mul(simd::splat<0>(v[k]), cx);
+			r = simd::madd(simd::splat<1>(v[k]), cy, r);
+			r = simd::madd(simd::splat<2>(v[k]), cz, r);
+			v[k] = simd::madd(simd::splat<3>(v[k]), cw, r);
+		}
+		for (int k = 0; k < 4; ++k)
+		{
+			simd::store(&out[i + k].x, v[k]);
+		}
+	}
+#endif
+
+	for (; i < n; ++i)
+	{
+		out[i] = m * in[i];
+	}
+}
+
+inline void transform_vectors(mat3 const& m, vec3 const* in, vec3* out, size_t n)
+{
+	detail::transform3_n(m.x, m.y, m.z, 0, in, out, n);
+}
+
+inline void transform_points(mat4 const& m, vec3 const* in, vec3* out, size_t n)
+{
+	vec3 const t = m.w.to_vec3();
+	detail::transform3_n(m.x.to_vec3(), m.y.to_vec3(), m.z.to_vec3(), &t, in, out, n);
+}
+
+inline void transform_directions(mat4 const& m, vec3 const* in, vec3* out, size_t n)
+{
+	detail::transform3_n(m.x.to_vec3(), m.y.to_vec3(), m.z.to_vec3(), 0, in, out, n);
+}
+
+inline void transform_points(affine3 const& m, vec3 const* in, vec3* out, size_t n)
+{
+	detail::transform3_n(m.x, m.y, m.z, &m.w, in, out, n);
+}
+
+inline void transform_directions(affine3 const& m, vec3 const* in, vec3* out, size_t n)
+{
+	detail::transform3_n(m.x, m.y, m.z, 0, in, out, n);
+}
+
+template <precision Q = default_precision>
+inline void normalize_n(vec3 const* in, vec3* out, size_t n)
+{
+	detail::normalize3_n<Q>(in, out, n);
+}
+
+template <precision Q = default_precision>
+inline void normalize_n(vec4 const* in, vec4* out, size_t n)
+{
+	detail::normalize4_n<Q>(in, out, n);
+}
+
+inline void rotate_vectors(quaternion const& q, vec3 const* in, vec3* out, size_t n)
+{
+	detail::rotate_n(q, 0, in, out, n);
+}
+
+inline void transform_points(transform const& t, vec3 const* in, vec3* out, size_t n)
+{
+	detail::rotate_n(t.rotation, &t.position, in, out, n);
+}
+
+inline void slerp_n(quaternion const* a, quaternion const* b, float const* t, quaternion* out, size_t n)
+{
+	detail::blend_n(detail::slerp_op(), a, b, t, out, n);
+}
+
+inline void nlerp_n(quaternion const* a, quaternion const* b, float const* t, quaternion* out, size_t n)
+{
+	detail::blend_n(detail::nlerp_op(), a, b, t, out, n);
+}
+
+inline void dlb_n(dual_quaternion const* a, dual_quaternion const* b, float const* t, dual_quaternion* out, size_t n)
+{
+	detail::dlb_n(a, b, t, out, n);
+}
+
+inline void transform_points(dual_quaternion const& q, vec3 const* in, vec3* out, size_t n)
+{
+	vec3 const t = q.translation();
+	detail::rotate_n(q.real, &t, in, out, n);
+}
+
+// Executor forms: the operations above split into chunks and run through ex
+// (see executor.hpp). Results are identical to the single-threaded forms.
+
+template <typename T>
+inline void transform_vectors(executor& ex, basic_mat4<T> const& m, basic_vec4<T> const* in, basic_vec4<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		transform_vectors(m, in + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void transform_vectors(executor& ex, basic_mat3<T> const& m, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		transform_vectors(m, in + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void transform_points(executor& ex, basic_mat4<T> const& m, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		transform_points(m, in + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void transform_directions(executor& ex, basic_mat4<T> const& m, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		transform_directions(m, in + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void transform_points(executor& ex, basic_affine3<T> const& m, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		transform_points(m, in + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void transform_directions(executor& ex, basic_affine3<T> const& m, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		transform_directions(m, in + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void rotate_vectors(executor& ex, basic_quaternion<T> const& q, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		rotate_vectors(q, in + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void transform_points(executor& ex, basic_transform<T> const& t, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		transform_points(t, in + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void slerp_n(executor& ex, basic_quaternion<T> const* a, basic_quaternion<T> const* b, T const* t, basic_quaternion<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(3 * sizeof(*a) + sizeof(*t)), [&](size_t begin, size_t end) {
+		slerp_n(a + begin, b + begin, t + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void nlerp_n(executor& ex, basic_quaternion<T> const* a, basic_quaternion<T> const* b, T const* t, basic_quaternion<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(3 * sizeof(*a) + sizeof(*t)), [&](size_t begin, size_t end) {
+		nlerp_n(a + begin, b + begin, t + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void dlb_n(executor& ex, basic_dual_quaternion<T> const* a, basic_dual_quaternion<T> const* b, T const* t, basic_dual_quaternion<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(3 * sizeof(*a) + sizeof(*t)), [&](size_t begin, size_t end) {
+		dlb_n(a + begin, b + begin, t + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void sclerp_n(executor& ex, basic_dual_quaternion<T> const* a, basic_dual_quaternion<T> const* b, T const* t, basic_dual_quaternion<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(3 * sizeof(*a) + sizeof(*t)), [&](size_t begin, size_t end) {
+		sclerp_n(a + begin, b + begin, t + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void transform_points(executor& ex, basic_dual_quaternion<T> const& q, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		transform_points(q, in + begin, out + begin, end - begin);
+	});
+}
+
+template <precision Q = default_precision, typename T>
+inline void normalize_n(executor& ex, basic_vec3<T> const* in, basic_vec3<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		normalize_n<Q>(in + begin, out + begin, end - begin);
+	});
+}
+
+template <precision Q = default_precision, typename T>
+inline void normalize_n(executor& ex, basic_vec4<T> const* in, basic_vec4<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		normalize_n<Q>(in + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void mul_n(executor& ex, basic_mat4<T> const* a, basic_mat4<T> const* b, basic_mat4<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(3 * sizeof(*a)), [&](size_t begin, size_t end) {
+		mul_n(a + begin, b + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void mul_n(executor& ex, basic_affine3<T> const* a, basic_affine3<T> const* b, basic_affine3<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(3 * sizeof(*a)), [&](size_t begin, size_t end) {
+		mul_n(a + begin, b + begin, out + begin, end - begin);
+	});
+}
+
+template <typename T>
+inline void mul_n(executor& ex, basic_transform<T> const* a, basic_transform<T> const* b, basic_transform<T>* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(3 * sizeof(*a)), [&](size_t begin, size_t end) {
+		mul_n(a + begin, b + begin, out + begin, end - begin);
+	});
+}
+
+}
+
+#endif
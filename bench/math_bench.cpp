@@ -0,0 +1,1163 @@
+// Microbenchmarks for the hot functions of the library, in scalar (one call
+// per element) and batch (one call per array) form. Results go to stdout, or
+// to a file with --out, as JSON:
+//
+//   math_bench [--filter <substring>] [--min-time <seconds>] [--count <n>]
+//              [--threads <n>] [--parallel-count <n>] [--out <file>]
+//
+// Every case runs over arrays of --count elements (default 1024, which keeps
+// the data in L1/L2 for most cases). The parallel cases run the executor forms
+// of the batch functions on a thread_pool of 1, 2, 4... up to --threads
+// threads (default: every hardware thread) over --parallel-count elements
+// (default 4M, an eighth of that for matrices and culling, a sixteenth for the
+// hierarchy, a 256th for animation tracks and a quarter for skinning, bvh
+// builds and decoding), to show the scaling. ns_per_op is wall time per
+// element, a vertex for the skinning cases, so 1e9 / ns_per_op is vertices per
+// second there. cycles_per_op and ops_per_cycle use the time stamp counter,
+// which ticks at a constant reference rate and not at the current core clock;
+// they are null where no TSC is available. Pin the CPU frequency when
+// comparing runs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define MATH_BENCH_TSC
+#endif
+
+#include "batch.hpp"
+#include "soa.hpp"
+#include "hierarchy.hpp"
+#include "cached_transform.hpp"
+#include "skinning.hpp"
+#include "frustum.hpp"
+#include "ray.hpp"
+#include "bvh.hpp"
+#include "quantize.hpp"
+#include "stream.hpp"
+#include "animation.hpp"
+#include "thread_pool.hpp"
+
+using namespace xxx;
+
+namespace
+{
+
+// Keeps the compiler from dropping or hoisting work whose result is only
+// written to memory.
+inline void clobber()
+{
+#if defined(_MSC_VER)
+	_ReadWriteBarrier();
+#else
+	asm volatile("" : : : "memory");
+#endif
+}
+
+inline uint64_t ticks()
+{
+#if defined(MATH_BENCH_TSC)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+struct result
+{
+	std::string name;
+	char const* form;
+	size_t threads;
+	double ns_per_op;
+	double cycles_per_op;
+};
+
+class suite
+{
+public:
+	suite(char const* filter, double min_time) : filter(filter), min_time(min_time) {}
+
+	// Times f, which processes items elements per call on the given number of
+	// threads.
+	void add(char const* name, char const* form, size_t items, std::function<void()> const& f)
+	{
+		add(name, form, items, 1, f);
+	}
+
+	void add(char const* name, char const* form, size_t items, size_t threads, std::function<void()> const& f)
+	{
+		if (filter && !strstr(name, filter))
+		{
+			return;
+		}
+
+		f();
+		clobber();
+
+		typedef std::chrono::steady_clock clock;
+		size_t reps = 1;
+		for (;;)
+		{
+			clock::time_point const t0 = clock::now();
+			uint64_t const c0 = ticks();
+			for (size_t r = 0; r < reps; ++r)
+			{
+				f();
+				clobber();
+			}
+			uint64_t const c1 = ticks();
+			double const seconds = std::chrono::duration<double>(clock::now() - t0).count();
+
+			if (seconds >= min_time)
+			{
+				double const ops = static_cast<double>(reps) * static_cast<double>(items);
+				result r = { name, form, threads, seconds * 1e9 / ops, static_cast<double>(c1 - c0) / ops };
+				results.push_back(r);
+				fprintf(stderr, "%-40s %-8s %3u %9.3f ns/op\n", name, form, static_cast<unsigned>(threads), r.ns_per_op);
+				return;
+			}
+			reps = seconds > min_time / 100 ? static_cast<size_t>(static_cast<double>(reps) * min_time * 1.2 / seconds) + 1 : reps * 10;
+		}
+	}
+
+	void write(FILE* f) const
+	{
+		fprintf(f, "{\n");
+		fprintf(f, "  \"simd\": \"%s\",\n", simd_name());
+		fprintf(f, "  \"compiler\": \"%s\",\n", compiler_name());
+		fprintf(f, "  \"results\": [\n");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			result const& r = results[i];
+			fprintf(f, "    { \"name\": \"%s\", \"form\": \"%s\", \"threads\": %u, \"ns_per_op\": %.4f, ", r.name.c_str(), r.form, static_cast<unsigned>(r.threads), r.ns_per_op);
+#if defined(MATH_BENCH_TSC)
+			fprintf(f, "\"cycles_per_op\": %.4f, \"ops_per_cycle\": %.4f }", r.cycles_per_op, 1 / r.cycles_per_op);
+#else
+			fprintf(f, "\"cycles_per_op\": null, \"ops_per_cycle\": null }");
+#endif
+			fprintf(f, "%s\n", i + 1 < results.size() ? "," : "");
+		}
+		fprintf(f, "  ]\n");
+		fprintf(f, "}\n");
+	}
+
+private:
+	static char const* simd_name()
+	{
+#if defined(XXX_FMA)
+		return "avx+fma";
+#elif defined(XXX_AVX)
+		return "avx";
+#elif defined(XXX_SSE)
+		return "sse2";
+#else
+		return "none";
+#endif
+	}
+
+	static char const* compiler_name()
+	{
+#if defined(__clang__)
+		return "clang " __clang_version__;
+#elif defined(__GNUC__)
+		return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+		return "msvc";
+#else
+		return "unknown";
+#endif
+	}
+
+	char const* filter;
+	double min_time;
+	std::vector<result> results;
+};
+
+// Deterministic inputs, so runs are comparable.
+class generator
+{
+public:
+	explicit generator(uint32_t seed) : state(seed) {}
+
+	// Uniform in [-1, 1).
+	float next()
+	{
+		state = state * 1664525u + 1013904223u;
+		return static_cast<float>(state >> 8) * (2.0f / 16777216.0f) - 1;
+	}
+
+	vec3 next_vec3()
+	{
+		float const x = next();
+		float const y = next();
+		return vec3(x, y, next());
+	}
+
+	vec4 next_vec4()
+	{
+		vec3 const v = next_vec3();
+		return vec4(v, next());
+	}
+
+	quaternion next_rotation()
+	{
+		vec4 const v = next_vec4();
+		return normalize(quaternion(v.x, v.y, v.z, v.w + 2));
+	}
+
+	transform next_transform()
+	{
+		vec3 const p = next_vec3();
+		return transform(p * 10, next_rotation());
+	}
+
+	mat4 next_mat4()
+	{
+		vec4 const x = next_vec4();
+		vec4 const y = next_vec4();
+		vec4 const z = next_vec4();
+		return mat4(x + vec4(2, 0, 0, 0), y + vec4(0, 2, 0, 0), z + vec4(0, 0, 2, 0), next_vec4() + vec4(0, 0, 0, 2));
+	}
+
+private:
+	uint32_t state;
+};
+
+// A wide, shallow random tree (every node's parent is uniform among the
+// earlier nodes; depth about ln n), as a hierarchy and as child lists for the
+// recursive walk it replaces.
+struct scene
+{
+	hierarchy nodes;
+	std::vector<transform> locals;
+	std::vector<std::vector<size_t> > children;
+	std::vector<size_t> roots;
+	std::vector<transform> worlds;
+	std::vector<mat4> matrices;
+
+	scene(generator& rng, size_t count) : locals(count), children(count), worlds(count), matrices(count)
+	{
+		nodes.reserve(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			size_t const parent = i == 0 ? hierarchy::none : static_cast<size_t>((rng.next() * 0.5f + 0.5f) * static_cast<float>(i));
+			locals[i] = rng.next_transform();
+			nodes.add(parent, locals[i]);
+			if (parent == hierarchy::none)
+			{
+				roots.push_back(i);
+			}
+			else
+			{
+				children[parent].push_back(i);
+			}
+		}
+		nodes.update();
+	}
+
+	void walk(size_t i, transform const& parent)
+	{
+		worlds[i] = locals[i] * parent;
+		matrices[i] = worlds[i].model_matrix();
+		for (size_t k = 0; k < children[i].size(); ++k)
+		{
+			walk(children[i][k], worlds[i]);
+		}
+	}
+
+	void walk()
+	{
+		for (size_t k = 0; k < roots.size(); ++k)
+		{
+			worlds[roots[k]] = locals[roots[k]];
+			matrices[roots[k]] = worlds[roots[k]].model_matrix();
+			for (size_t c = 0; c < children[roots[k]].size(); ++c)
+			{
+				walk(children[roots[k]][c], worlds[roots[k]]);
+			}
+		}
+	}
+};
+
+// A mesh of random vertices, each with the given number of influences among 64
+// random rigid bones (the size of a character rig), as SoA streams and as a
+// palette of both kinds.
+struct mesh
+{
+	static size_t const bones = 64;
+	size_t const influences;
+
+	std::vector<affine3> affines;
+	std::vector<mat4> matrices;
+	std::vector<uint16_t> indices;
+	std::vector<float> weights;
+	vec3_soa positions, normals, out_positions, out_normals;
+
+	mesh(generator& rng, size_t count, size_t per_vertex)
+		: influences(per_vertex), indices(count * per_vertex), weights(count * per_vertex), positions(count), normals(count), out_positions(count), out_normals(count)
+	{
+		for (size_t i = 0; i < bones; ++i)
+		{
+			matrices.push_back(rng.next_transform().model_matrix());
+			affines.push_back(affine3(matrices.back()));
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			float sum = 0;
+			for (size_t k = 0; k < influences; ++k)
+			{
+				indices[i * influences + k] = static_cast<uint16_t>((rng.next() * 0.5f + 0.5f) * (bones - 1));
+				weights[i * influences + k] = rng.next() + 1;
+				sum += weights[i * influences + k];
+			}
+			for (size_t k = 0; k < influences; ++k)
+			{
+				weights[i * influences + k] /= sum;
+			}
+			positions.set(i, rng.next_vec3());
+			normals.set(i, normalize(rng.next_vec3()));
+		}
+	}
+
+	// The per-vertex loop skin() replaces: every influence transforms the
+	// vertex, and the results are blended.
+	void skin_scalar()
+	{
+		for (size_t i = 0; i < positions.size(); ++i)
+		{
+			vec3 const p = positions.get(i);
+			vec3 const n = normals.get(i);
+			vec3 sp(0), sn(0);
+			for (size_t k = 0; k < influences; ++k)
+			{
+				affine3 const& b = affines[indices[i * influences + k]];
+				float const w = weights[i * influences + k];
+				sp = sp + transform_point(b, p) * w;
+				sn = sn + transform_vector(b, n) * w;
+			}
+			out_positions.set(i, sp);
+			out_normals.set(i, sn);
+		}
+	}
+};
+
+// Random spheres and boxes around a camera, about a sixth of them in view.
+struct field
+{
+	frustum view;
+	vec3_soa centers, mins, maxs;
+	scalar_soa radii;
+	std::vector<unsigned char> visible, last_plane;
+
+	field(generator& rng, size_t count)
+		: view(mat4::look_at(vec3(0), vec3(0, 0, -1), vec3(0, 1, 0)) * mat4::perspective(16, 9, 1.0f, 0.1f, 100))
+		, centers(count), mins(count), maxs(count), radii(count), visible(count), last_plane(count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			vec3 const c = rng.next_vec3() * 100;
+			vec3 const e = abs(rng.next_vec3()) + vec3(0.5f);
+			centers.set(i, c);
+			radii[i] = length(e);
+			mins.set(i, c - e);
+			maxs.set(i, c + e);
+		}
+	}
+
+	void cull_scalar()
+	{
+		for (size_t i = 0; i < centers.size(); ++i)
+		{
+			visible[i] = intersects(view, centers.get(i), radii[i]);
+		}
+	}
+};
+
+// Coherent rays from a camera through a grid of pixels, cast against a few
+// triangles and boxes in front of it; every ray tests every primitive.
+struct cast
+{
+	static size_t const primitives = 16;
+
+	std::vector<ray3> rays;
+	std::vector<ray_packet8> packets;
+	std::vector<vec3> vertices;
+	std::vector<aabb3> boxes;
+	std::vector<float> t;
+
+	cast(generator& rng, size_t count) : rays((count / primitives + 7) / 8 * 8), t(rays.size())
+	{
+		for (size_t i = 0; i < rays.size(); ++i)
+		{
+			rays[i] = ray3(vec3(0), vec3((i % 64) / 32.0f - 1, (i / 64 % 64) / 32.0f - 1, -1));
+		}
+		for (size_t i = 0; i < rays.size(); i += 8)
+		{
+			packets.push_back(ray_packet8(&rays[i]));
+		}
+		for (size_t k = 0; k < primitives; ++k)
+		{
+			vec3 const c(rng.next() * 3, rng.next() * 3, rng.next() - 4);
+			for (size_t j = 0; j < 3; ++j)
+			{
+				vertices.push_back(c + rng.next_vec3());
+			}
+			vec3 const e = abs(rng.next_vec3()) * 0.5f + vec3(0.1f);
+			boxes.push_back(aabb3(c - e, c + e));
+		}
+	}
+
+	void triangles()
+	{
+		for (size_t i = 0; i < rays.size(); ++i)
+		{
+			float h = std::numeric_limits<float>::infinity();
+			for (size_t k = 0; k < primitives; ++k)
+			{
+				intersects(rays[i], vertices[3 * k], vertices[3 * k + 1], vertices[3 * k + 2], h);
+			}
+			t[i] = h;
+		}
+	}
+
+	void triangle_packets()
+	{
+		for (size_t p = 0; p < packets.size(); ++p)
+		{
+			float* const h = &t[8 * p];
+			std::fill(h, h + 8, std::numeric_limits<float>::infinity());
+			for (size_t k = 0; k < primitives; ++k)
+			{
+				intersects(packets[p], vertices[3 * k], vertices[3 * k + 1], vertices[3 * k + 2], h);
+			}
+		}
+	}
+
+	void boxes_scalar()
+	{
+		for (size_t i = 0; i < rays.size(); ++i)
+		{
+			float h = std::numeric_limits<float>::infinity();
+			for (size_t k = 0; k < primitives; ++k)
+			{
+				intersects(rays[i], boxes[k], h);
+			}
+			t[i] = h;
+		}
+	}
+
+	void box_packets()
+	{
+		for (size_t p = 0; p < packets.size(); ++p)
+		{
+			float* const h = &t[8 * p];
+			std::fill(h, h + 8, std::numeric_limits<float>::infinity());
+			for (size_t k = 0; k < primitives; ++k)
+			{
+				intersects(packets[p], boxes[k], h);
+			}
+		}
+	}
+};
+
+// Static level geometry: a soup of small random triangles spread over a wide,
+// flat slab, with a bvh over their boxes. Rays are cast down onto it from a
+// grid above, and boxes and spheres of a few triangles' size queried around
+// random points in it.
+struct level
+{
+	std::vector<vec3> vertices;
+	std::vector<aabb3> boxes;
+	std::vector<ray3> rays;
+	std::vector<ray_packet8> packets;
+	std::vector<aabb3> regions;
+	std::vector<sphere3> spheres;
+	std::vector<float> t;
+	bvh tree;
+	size_t found;
+
+	level(generator& rng, size_t count, size_t queries) : boxes(count), rays((queries + 7) / 8 * 8), t(rays.size()), found(0)
+	{
+		float const side = xxx::sqrt(static_cast<float>(count));
+		for (size_t k = 0; k < count; ++k)
+		{
+			vec3 const c(rng.next() * side, rng.next(), rng.next() * side);
+			aabb3 b = aabb3::empty();
+			for (size_t j = 0; j < 3; ++j)
+			{
+				vertices.push_back(c + rng.next_vec3());
+				b = merge(b, vertices.back());
+			}
+			boxes[k] = b;
+		}
+		size_t const grid = static_cast<size_t>(xxx::sqrt(static_cast<float>(rays.size()))) + 1;
+		for (size_t i = 0; i < rays.size(); ++i)
+		{
+			vec3 const o((i % grid) * 2.0f / grid - 1, 0, (i / grid) * 2.0f / grid - 1);
+			rays[i] = ray3(o * side + vec3(0, 4, 0), vec3(o.x * 0.1f, -1, o.z * 0.1f));
+		}
+		for (size_t i = 0; i < rays.size(); i += 8)
+		{
+			packets.push_back(ray_packet8(&rays[i]));
+		}
+		for (size_t i = 0; i < queries; ++i)
+		{
+			vec3 const c(rng.next() * side, rng.next(), rng.next() * side);
+			regions.push_back(aabb3(c - vec3(1.5f), c + vec3(1.5f)));
+			spheres.push_back(sphere3(c, 1.5f));
+		}
+		tree.build(boxes.data(), count);
+	}
+
+	void raycast()
+	{
+		for (size_t i = 0; i < rays.size(); ++i)
+		{
+			ray3 const& r = rays[i];
+			t[i] = std::numeric_limits<float>::infinity();
+			tree.raycast(r, t[i], [&](size_t p, float& h) {
+				return intersects(r, vertices[3 * p], vertices[3 * p + 1], vertices[3 * p + 2], h);
+			});
+		}
+	}
+
+	void raycast_packets()
+	{
+		for (size_t p = 0; p < packets.size(); ++p)
+		{
+			ray_packet8 const& r = packets[p];
+			float* const h = &t[8 * p];
+			std::fill(h, h + 8, std::numeric_limits<float>::infinity());
+			tree.raycast(r, h, [&](size_t k, float* d) {
+				return intersects(r, vertices[3 * k], vertices[3 * k + 1], vertices[3 * k + 2], d);
+			});
+		}
+	}
+
+	void query_boxes()
+	{
+		found = 0;
+		for (size_t i = 0; i < regions.size(); ++i)
+		{
+			tree.query(regions[i], [&](size_t) { ++found; });
+		}
+	}
+
+	void query_spheres()
+	{
+		found = 0;
+		for (size_t i = 0; i < spheres.size(); ++i)
+		{
+			tree.query(spheres[i], [&](size_t) { ++found; });
+		}
+	}
+};
+
+// count position and count rotation tracks of random keys at 30 Hz, played at
+// 60 Hz and looping, in an animation with the given interpolation.
+// sample_search() is the one-track-at-a-time way: a binary search, then mix()
+// or slerp_approx(), for every track.
+struct clip
+{
+	static size_t const keys = 16;
+
+	std::vector<float> times;
+	std::vector<vec3> positions;
+	std::vector<quaternion> rotations;
+	animation tracks;
+	animation_cursor cursor;
+	std::vector<vec3> out_positions;
+	std::vector<quaternion> out_rotations;
+	float time;
+
+	clip(generator& rng, size_t count, interpolation mode) : times(keys), positions(count * keys), rotations(count * keys), out_positions(count), out_rotations(count), time(0)
+	{
+		for (size_t k = 0; k < keys; ++k)
+		{
+			times[k] = k / 30.0f;
+		}
+		for (size_t i = 0; i < count * keys; ++i)
+		{
+			positions[i] = rng.next_vec3();
+			rotations[i] = rng.next_rotation();
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			tracks.add(times.data(), &positions[i * keys], keys, mode);
+			tracks.add(times.data(), &rotations[i * keys], keys, mode);
+		}
+	}
+
+	float next_frame()
+	{
+		time += 1 / 60.0f;
+		if (time > tracks.duration())
+		{
+			time = 0;
+		}
+		return time;
+	}
+
+	void sample()
+	{
+		tracks.sample(cursor, next_frame(), out_positions.data(), out_rotations.data());
+	}
+
+	void sample(executor& ex)
+	{
+		tracks.sample(ex, cursor, next_frame(), out_positions.data(), out_rotations.data());
+	}
+
+	void sample_search()
+	{
+		float const t = next_frame();
+		for (size_t i = 0; i < out_positions.size(); ++i)
+		{
+			float const* const k = std::upper_bound(times.data() + 1, times.data() + keys - 1, t) - 1;
+			size_t const a = i * keys + (k - times.data());
+			float const s = clamp((t - k[0]) / (k[1] - k[0]), 0, 1);
+			out_positions[i] = mix(positions[a], positions[a + 1], s);
+			out_rotations[i] = slerp_approx(rotations[a], rotations[a + 1], s);
+		}
+	}
+};
+
+template <typename T>
+struct array
+{
+	std::vector<T> in0, in1, out;
+
+	template <typename F>
+	array(size_t count, F make) : out(count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			in0.push_back(make());
+			in1.push_back(make());
+		}
+	}
+};
+
+void run(suite& s, size_t count)
+{
+	generator rng(1);
+
+	array<mat4> m4(count, [&] { return rng.next_mat4(); });
+	array<mat4> rigid(count, [&] { return rng.next_transform().model_matrix(); });
+	array<affine3> a3(count, [&] { return affine3(rng.next_transform()); });
+	array<transform> tr(count, [&] { return rng.next_transform(); });
+	array<quaternion> q(count, [&] { return rng.next_rotation(); });
+	array<dual_quaternion> dq(count, [&] { return dual_quaternion(rng.next_transform()); });
+	array<vec3> v3(count, [&] { return rng.next_vec3(); });
+	array<vec4> v4(count, [&] { return rng.next_vec4(); });
+	array<float> f(count, [&] { return rng.next(); });
+	array<mat3> m3(count, [&] { return mat3::identity(); });
+	array<float> f2(count, [&] { return rng.next() * 100; });
+	for (size_t i = 0; i < count; ++i)
+	{
+		f.in0[i] = f.in0[i] * 0.5f + 0.5f;
+	}
+	mat4 const m = m4.in0[0];
+	affine3 const a = a3.in0[0];
+	transform const t = tr.in0[0];
+	quaternion const r = q.in0[0];
+	dual_quaternion const d = dq.in0[0];
+
+	// Scalar forms: one call per element.
+
+	s.add("mat4*mat4", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) m4.out[i] = m4.in0[i] * m4.in1[i];
+	});
+	s.add("mat4*vec4", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) v4.out[i] = m * v4.in0[i];
+	});
+	s.add("inverse(mat4)", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) m4.out[i] = inverse(m4.in0[i]);
+	});
+	s.add("inverse<float>(mat4)", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) m4.out[i] = inverse<float>(m4.in0[i]);
+	});
+	s.add("inverse_affine(mat4)", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) m4.out[i] = inverse_affine(rigid.in0[i]);
+	});
+	s.add("inverse_rigid(mat4)", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) m4.out[i] = inverse_rigid(rigid.in0[i]);
+	});
+	s.add("affine3*affine3", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) a3.out[i] = a3.in0[i] * a3.in1[i];
+	});
+	s.add("inverse(affine3)", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) a3.out[i] = inverse(a3.in0[i]);
+	});
+	s.add("transform_point(affine3)", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) v3.out[i] = transform_point(a, v3.in0[i]);
+	});
+	s.add("rotate", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) v3.out[i] = rotate(v3.in0[i], r);
+	});
+	s.add("transform*vec3", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) v3.out[i] = t * v3.in0[i];
+	});
+	s.add("transform*transform", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) tr.out[i] = tr.in0[i] * tr.in1[i];
+	});
+	s.add("transform::model_matrix", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) m4.out[i] = tr.in0[i].model_matrix();
+	});
+	s.add("transform::view_matrix", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) m4.out[i] = tr.in0[i].view_matrix();
+	});
+	std::vector<cached_transform> ct(tr.in0.begin(), tr.in0.end());
+	s.add("cached_transform::model_matrix", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) m4.out[i] = ct[i].model_matrix();
+	});
+	s.add("cached_transform::view_matrix", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) m4.out[i] = ct[i].view_matrix();
+	});
+	s.add("dual_quaternion*dual_quaternion", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) dq.out[i] = dq.in0[i] * dq.in1[i];
+	});
+	s.add("transform_point(dual_quaternion)", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) v3.out[i] = transform_point(d, v3.in0[i]);
+	});
+	s.add("dlb", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) dq.out[i] = dlb(dq.in0[i], dq.in1[i], f.in0[i]);
+	});
+	s.add("sclerp", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) dq.out[i] = sclerp(dq.in0[i], dq.in1[i], f.in0[i]);
+	});
+	s.add("slerp", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) q.out[i] = slerp(q.in0[i], q.in1[i], f.in0[i]);
+	});
+	s.add("slerp_approx", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) q.out[i] = slerp_approx(q.in0[i], q.in1[i], f.in0[i]);
+	});
+	s.add("nlerp", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) q.out[i] = nlerp(q.in0[i], q.in1[i], f.in0[i]);
+	});
+	s.add("normalize(vec3)", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) v3.out[i] = normalize<precision::full>(v3.in0[i]);
+	});
+	s.add("normalize<high>(vec3)", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) v3.out[i] = normalize<precision::high>(v3.in0[i]);
+	});
+	s.add("normalize<fast>(vec3)", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) v3.out[i] = normalize<precision::fast>(v3.in0[i]);
+	});
+	s.add("normalize(quaternion)", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) q.out[i] = normalize<precision::full>(q.in0[i]);
+	});
+	s.add("quaternion::to_matrix", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) m3.out[i] = q.in0[i].to_matrix();
+	});
+	s.add("mat4::look_at", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) m4.out[i] = mat4::look_at(v3.in0[i] * 10, v3.in1[i], vec3(0, 1, 0));
+	});
+	s.add("sincos", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) sincos<precision::full>(f2.in0[i], f2.out[i], f.out[i]);
+	});
+	s.add("sincos<high>", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) sincos<precision::high>(f2.in0[i], f2.out[i], f.out[i]);
+	});
+	s.add("sincos<fast>", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) sincos<precision::fast>(f2.in0[i], f2.out[i], f.out[i]);
+	});
+
+	scene sc(rng, count);
+	s.add("hierarchy", "scalar", count, [&] {
+		sc.walk();
+	});
+
+	field fi(rng, count);
+	s.add("cull spheres", "scalar", count, [&] {
+		fi.cull_scalar();
+	});
+
+	std::vector<aabb3> boxes, bounds(count);
+	for (size_t i = 0; i < count; ++i) boxes.push_back(aabb3(min(v3.in0[i], v3.in1[i]), max(v3.in0[i], v3.in1[i])));
+	sphere3 sphere;
+	s.add("transform_bounds(affine3, aabb3)", "scalar", count, [&] {
+		for (size_t i = 0; i < count; ++i) bounds[i] = transform_bounds(a, boxes[i]);
+	});
+	s.add("merge(aabb3, vec3)", "scalar", count, [&] {
+		aabb3 b = aabb3::empty();
+		for (size_t i = 0; i < count; ++i) b = merge(b, v3.in0[i]);
+		bounds[0] = b;
+	});
+
+	cast ca(rng, count);
+	size_t const casts = ca.rays.size() * cast::primitives;
+	s.add("intersects(ray3, triangle)", "scalar", casts, [&] {
+		ca.triangles();
+	});
+	s.add("intersects(ray3, aabb3)", "scalar", casts, [&] {
+		ca.boxes_scalar();
+	});
+
+	level le(rng, count, count);
+	s.add("bvh raycast", "scalar", le.rays.size(), [&] {
+		le.raycast();
+	});
+	s.add("bvh query(aabb3)", "scalar", le.regions.size(), [&] {
+		le.query_boxes();
+	});
+	s.add("bvh query(sphere3)", "scalar", le.spheres.size(), [&] {
+		le.query_spheres();
+	});
+
+	clip li(rng, count, interpolation::linear);
+	s.add("animation sample (binary search)", "scalar", 2 * count, [&] {
+		li.sample_search();
+	});
+
+	mesh me(rng, count, 4);
+	s.add("skin<4>(affine3) normals", "scalar", count, [&] {
+		me.skin_scalar();
+	});
+
+	// Batch forms: one call per array.
+
+	s.add("transform_vectors(mat4)", "batch", count, [&] {
+		transform_vectors(m, v4.in0.data(), v4.out.data(), count);
+	});
+	s.add("transform_points(mat4)", "batch", count, [&] {
+		transform_points(m, v3.in0.data(), v3.out.data(), count);
+	});
+	s.add("transform_points(affine3)", "batch", count, [&] {
+		transform_points(a, v3.in0.data(), v3.out.data(), count);
+	});
+	s.add("transform_points(transform)", "batch", count, [&] {
+		transform_points(t, v3.in0.data(), v3.out.data(), count);
+	});
+	s.add("rotate_vectors", "batch", count, [&] {
+		rotate_vectors(r, v3.in0.data(), v3.out.data(), count);
+	});
+	s.add("slerp_n", "batch", count, [&] {
+		slerp_n(q.in0.data(), q.in1.data(), f.in0.data(), q.out.data(), count);
+	});
+	s.add("nlerp_n", "batch", count, [&] {
+		nlerp_n(q.in0.data(), q.in1.data(), f.in0.data(), q.out.data(), count);
+	});
+	s.add("transform_points(dual_quaternion)", "batch", count, [&] {
+		transform_points(d, v3.in0.data(), v3.out.data(), count);
+	});
+	s.add("dlb_n", "batch", count, [&] {
+		dlb_n(dq.in0.data(), dq.in1.data(), f.in0.data(), dq.out.data(), count);
+	});
+	s.add("sclerp_n", "batch", count, [&] {
+		sclerp_n(dq.in0.data(), dq.in1.data(), f.in0.data(), dq.out.data(), count);
+	});
+	s.add("mul_n(mat4)", "batch", count, [&] {
+		mul_n(m4.in0.data(), m4.in1.data(), m4.out.data(), count);
+	});
+	s.add("mul_n(transform)", "batch", count, [&] {
+		mul_n(tr.in0.data(), tr.in1.data(), tr.out.data(), count);
+	});
+	s.add("normalize_n(vec3)", "batch", count, [&] {
+		normalize_n<precision::full>(v3.in0.data(), v3.out.data(), count);
+	});
+	s.add("normalize_n<high>(vec3)", "batch", count, [&] {
+		normalize_n<precision::high>(v3.in0.data(), v3.out.data(), count);
+	});
+	s.add("normalize_n<fast>(vec3)", "batch", count, [&] {
+		normalize_n<precision::fast>(v3.in0.data(), v3.out.data(), count);
+	});
+	s.add("normalize_n(vec4)", "batch", count, [&] {
+		normalize_n<precision::full>(v4.in0.data(), v4.out.data(), count);
+	});
+	s.add("sincos_n<high>", "batch", count, [&] {
+		sincos_n<precision::high>(f2.in0.data(), f2.out.data(), f.out.data(), count);
+	});
+	s.add("sincos_n<fast>", "batch", count, [&] {
+		sincos_n<precision::fast>(f2.in0.data(), f2.out.data(), f.out.data(), count);
+	});
+
+	s.add("hierarchy", "batch", count, [&] {
+		sc.nodes.invalidate();
+		sc.nodes.update();
+	});
+	s.add("hierarchy 1% dirty", "batch", count, [&] {
+		for (size_t i = 100; i < count; i += 100) sc.nodes.set_local(count - i, sc.locals[count - i]);
+		sc.nodes.update();
+	});
+
+	s.add("skin<4>(affine3)", "batch", count, [&] {
+		skin<4>(me.affines.data(), me.indices.data(), me.weights.data(), me.positions, me.out_positions);
+	});
+	s.add("skin<4>(affine3) normals", "batch", count, [&] {
+		skin<4>(me.affines.data(), me.indices.data(), me.weights.data(), me.positions, me.normals, me.out_positions, me.out_normals);
+	});
+	s.add("skin<4>(mat4) normals", "batch", count, [&] {
+		skin<4>(me.matrices.data(), me.indices.data(), me.weights.data(), me.positions, me.normals, me.out_positions, me.out_normals);
+	});
+	mesh me8(rng, count, 8);
+	s.add("skin<8>(affine3) normals", "batch", count, [&] {
+		skin<8>(me8.affines.data(), me8.indices.data(), me8.weights.data(), me8.positions, me8.normals, me8.out_positions, me8.out_normals);
+	});
+
+	s.add("cull_spheres", "batch", count, [&] {
+		cull_spheres(fi.view, fi.centers, fi.radii, fi.visible.data());
+	});
+	s.add("cull_spheres last_plane", "batch", count, [&] {
+		cull_spheres(fi.view, fi.centers, fi.radii, fi.visible.data(), fi.last_plane.data());
+	});
+	s.add("cull_boxes", "batch", count, [&] {
+		cull_boxes(fi.view, fi.mins, fi.maxs, fi.visible.data());
+	});
+	s.add("cull_boxes last_plane", "batch", count, [&] {
+		cull_boxes(fi.view, fi.mins, fi.maxs, fi.visible.data(), fi.last_plane.data());
+	});
+
+	s.add("intersects(ray_packet8, triangle)", "batch", casts, [&] {
+		ca.triangle_packets();
+	});
+	s.add("intersects(ray_packet8, aabb3)", "batch", casts, [&] {
+		ca.box_packets();
+	});
+
+	s.add("bvh build", "batch", count, [&] {
+		le.tree.build(le.boxes.data(), count);
+	});
+	s.add("bvh refit", "batch", count, [&] {
+		le.tree.refit(le.boxes.data());
+	});
+	s.add("bvh raycast(ray_packet8)", "batch", le.rays.size(), [&] {
+		le.raycast_packets();
+	});
+
+	aabb3 const range(vec3(-10), vec3(10));
+	std::vector<fixed_transform> ft(count);
+	s.add("encode_n(fixed_transform)", "batch", count, [&] {
+		encode_n(tr.in0.data(), range, ft.data(), count);
+	});
+	s.add("decode_n(fixed_transform)", "batch", count, [&] {
+		decode_n(ft.data(), range, tr.out.data(), count);
+	});
+	std::vector<quaternion32> q32(count);
+	s.add("encode_n(quaternion32)", "batch", count, [&] {
+		encode_n(q.in0.data(), q32.data(), count);
+	});
+	s.add("decode_n(quaternion32)", "batch", count, [&] {
+		decode_n(q32.data(), q.out.data(), count);
+	});
+	std::vector<octahedral32> o32(count);
+	s.add("encode_n(octahedral32)", "batch", count, [&] {
+		encode_n(v3.in0.data(), o32.data(), count);
+	});
+	s.add("decode_n(octahedral32)", "batch", count, [&] {
+		decode_n(o32.data(), v3.out.data(), count);
+	});
+	std::vector<half_vec3> h3(count);
+	s.add("encode_n(half_vec3)", "batch", count, [&] {
+		encode_n(v3.in0.data(), h3.data(), count);
+	});
+	s.add("decode_n(half_vec3)", "batch", count, [&] {
+		decode_n(h3.data(), v3.out.data(), count);
+	});
+	std::vector<unsigned char> bytes;
+	s.add("stream write(transform)", "batch", count, [&] {
+		bytes.clear();
+		stream_writer(bytes).write(0, tr.in0.data(), count);
+	});
+	s.add("stream write_quantized(transform)", "batch", count, [&] {
+		bytes.clear();
+		stream_writer(bytes).write_quantized(0, tr.in0.data(), count, range);
+	});
+	s.add("stream read(fixed_transform)", "batch", count, [&] {
+		stream_reader reader(bytes.data(), bytes.size());
+		stream_chunk c;
+		while (reader.next(c))
+		{
+			c.read(tr.out.data());
+		}
+	});
+
+	clip cu(rng, count, interpolation::cubic);
+	s.add("animation sample(linear)", "batch", 2 * count, [&] {
+		li.sample();
+	});
+	s.add("animation sample(cubic)", "batch", 2 * count, [&] {
+		cu.sample();
+	});
+
+	vec3_soa sa, sb, so;
+	to_soa(v3.in0.data(), count, sa);
+	to_soa(v3.in1.data(), count, sb);
+	s.add("compute_aabb", "batch", count, [&] {
+		bounds[0] = compute_aabb(v3.in0.data(), count);
+	});
+	s.add("compute_sphere", "batch", count, [&] {
+		sphere = compute_sphere(v3.in0.data(), count);
+	});
+	s.add("soa compute_aabb", "batch", count, [&] {
+		bounds[0] = compute_aabb(sa);
+	});
+	scalar_soa sd;
+	s.add("soa cross", "batch", count, [&] {
+		cross(sa, sb, so);
+	});
+	s.add("soa dot", "batch", count, [&] {
+		dot(sa, sb, sd);
+	});
+	s.add("soa normalize", "batch", count, [&] {
+		normalize<precision::full>(sa, so);
+	});
+	s.add("soa normalize<high>", "batch", count, [&] {
+		normalize<precision::high>(sa, so);
+	});
+}
+
+// Executor forms over arrays much larger than the caches, for 1, 2, 4... up to
+// max_threads threads; ns_per_op stays wall time per element, so ideal scaling
+// halves it with every step until memory bandwidth runs out.
+void run_parallel(suite& s, size_t count, size_t max_threads)
+{
+	generator rng(2);
+
+	array<vec3> v3(count, [&] { return rng.next_vec3(); });
+	array<mat4> m4(count / 8 + 1, [&] { return rng.next_mat4(); });
+	mat4 const m = m4.in0[0];
+	quaternion const r = rng.next_rotation();
+	size_t const matrices = m4.out.size();
+	scene sc(rng, count / 16 + 1);
+	size_t const nodes = sc.nodes.size();
+	mesh me(rng, count / 4 + 1, 4);
+	size_t const vertices = me.positions.size();
+	field fi(rng, count / 8 + 1);
+	size_t const objects = fi.centers.size();
+	level le(rng, count / 4 + 1, 0);
+	size_t const primitives = le.boxes.size();
+	array<transform> tr(count / 4 + 1, [&] { return rng.next_transform(); });
+	size_t const transforms = tr.out.size();
+	aabb3 const range(vec3(-10), vec3(10));
+	std::vector<fixed_transform> ft(transforms);
+	encode_n(tr.in0.data(), range, ft.data(), transforms);
+	clip cu(rng, count / 256 + 1, interpolation::cubic);
+	size_t const tracks = 2 * cu.out_positions.size();
+	aabb3 box;
+
+	for (size_t threads = 1;; threads *= 2)
+	{
+		if (threads > max_threads)
+		{
+			threads = max_threads;
+		}
+		thread_pool pool(threads);
+
+		s.add("transform_points(mat4)", "parallel", count, threads, [&] {
+			transform_points(pool, m, v3.in0.data(), v3.out.data(), count);
+		});
+		s.add("rotate_vectors", "parallel", count, threads, [&] {
+			rotate_vectors(pool, r, v3.in0.data(), v3.out.data(), count);
+		});
+		s.add("normalize_n(vec3)", "parallel", count, threads, [&] {
+			normalize_n<precision::full>(pool, v3.in0.data(), v3.out.data(), count);
+		});
+		s.add("mul_n(mat4)", "parallel", matrices, threads, [&] {
+			mul_n(pool, m4.in0.data(), m4.in1.data(), m4.out.data(), matrices);
+		});
+		s.add("hierarchy", "parallel", nodes, threads, [&] {
+			sc.nodes.invalidate();
+			sc.nodes.update(pool);
+		});
+		s.add("cull_boxes last_plane", "parallel", objects, threads, [&] {
+			cull_boxes(pool, fi.view, fi.mins, fi.maxs, fi.visible.data(), fi.last_plane.data());
+		});
+		s.add("compute_aabb", "parallel", count, threads, [&] {
+			box = compute_aabb(pool, v3.in0.data(), count);
+		});
+		s.add("bvh build", "parallel", primitives, threads, [&] {
+			le.tree.build(pool, le.boxes.data(), primitives);
+		});
+		s.add("decode_n(fixed_transform)", "parallel", transforms, threads, [&] {
+			decode_n(pool, ft.data(), range, tr.out.data(), transforms);
+		});
+		s.add("animation sample(cubic)", "parallel", tracks, threads, [&] {
+			cu.sample(pool);
+		});
+		s.add("skin<4>(affine3) normals", "parallel", vertices, threads, [&] {
+			skin<4>(pool, me.affines.data(), me.indices.data(), me.weights.data(), me.positions, me.normals, me.out_positions, me.out_normals);
+		});
+
+		if (threads == max_threads)
+		{
+			break;
+		}
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	char const* filter = 0;
+	char const* out = 0;
+	double min_time = 0.2;
+	size_t count = 1024;
+	size_t threads = thread_pool::hardware_concurrency();
+	size_t parallel_count = size_t(1) << 22;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+		{
+			filter = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--min-time") && i + 1 < argc)
+		{
+			min_time = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--count") && i + 1 < argc)
+		{
+			count = static_cast<size_t>(atol(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+		{
+			threads = static_cast<size_t>(atol(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--parallel-count") && i + 1 < argc)
+		{
+			parallel_count = static_cast<size_t>(atol(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--out") && i + 1 < argc)
+		{
+			out = argv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [--filter <substring>] [--min-time <seconds>] [--count <n>] [--threads <n>] [--parallel-count <n>] [--out <file>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	suite s(filter, min_time);
+	run(s, count > 0 ? count : 1);
+	run_parallel(s, parallel_count > 0 ? parallel_count : 1, threads > 0 ? threads : 1);
+
+	FILE* f = out ? fopen(out, "w") : stdout;
+	if (!f)
+	{
+		fprintf(stderr, "cannot open %s\n", out);
+		return 1;
+	}
+	s.write(f);
+	if (out)
+	{
+		fclose(f);
+	}
+	return 0;
+}
@@ -0,0 +1,845 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "vec3.hpp"
+#include "aabb3.hpp"
+#include "sphere3.hpp"
+#include "ray.hpp"
+#include "executor.hpp"
+#include "simd.hpp"
+
+namespace xxx
+{
+
+// A node of a bvh: four children with their boxes stored as SoA, so that all
+// four are tested in one SIMD pass. Inner children hold the index of their
+// node and a count of 0; leaves hold count primitives from position child of
+// the leaf order (see bvh::primitives()); unused slots hold bvh::none and an
+// empty box.
+struct bvh_node
+{
+	float min_x[4], min_y[4], min_z[4];
+	float max_x[4], max_y[4], max_z[4];
+	uint32_t child[4];
+	uint32_t count[4];
+
+	aabb3 bounds(size_t k) const
+	{
+		return aabb3(vec3(min_x[k], min_y[k], min_z[k]), vec3(max_x[k], max_y[k], max_z[k]));
+	}
+
+	void set_bounds(size_t k, aabb3 const& b)
+	{
+		min_x[k] = b.min.x;
+		min_y[k] = b.min.y;
+		min_z[k] = b.min.z;
+		max_x[k] = b.max.x;
+		max_y[k] = b.max.y;
+		max_z[k] = b.max.z;
+	}
+};
+
+namespace detail
+{
+
+static size_t const bvh_bin_count = 16;
+
+struct bvh_range
+{
+	size_t begin, end;
+	aabb3 bounds, centroids;
+
+	size_t size() const
+	{
+		return end - begin;
+	}
+};
+
+// A primitive during the build, partitioned in place so that every pass over
+// a range reads it sequentially.
+struct bvh_ref
+{
+	aabb3 bounds;
+	uint32_t index;
+
+	vec3 centroid() const
+	{
+		return bounds.center();
+	}
+};
+
+struct bvh_bin
+{
+	aabb3 bounds;
+	size_t count;
+};
+
+// Only the first count bins of each axis are in use.
+struct bvh_binning
+{
+	bvh_bin bins[3][bvh_bin_count];
+	size_t count;
+
+	explicit bvh_binning(size_t count = bvh_bin_count) : count(count)
+	{
+		for (size_t a = 0; a < 3; ++a)
+		{
+			for (size_t k = 0; k < count; ++k)
+			{
+				bins[a][k].bounds = aabb3::empty();
+				bins[a][k].count = 0;
+			}
+		}
+	}
+};
+
+inline bvh_binning merge_binning(bvh_binning a, bvh_binning const& b)
+{
+	for (size_t x = 0; x < 3; ++x)
+	{
+		for (size_t k = 0; k < a.count; ++k)
+		{
+			a.bins[x][k].bounds = merge(a.bins[x][k].bounds, b.bins[x][k].bounds);
+			a.bins[x][k].count += b.bins[x][k].count;
+		}
+	}
+	return a;
+}
+
+inline bvh_range merge_range(bvh_range a, bvh_range const& b)
+{
+	a.bounds = merge(a.bounds, b.bounds);
+	a.centroids = merge(a.centroids, b.centroids);
+	return a;
+}
+
+inline size_t bvh_bin_index(float c, float lo, float scale, size_t count)
+{
+	int const k = static_cast<int>((c - lo) * scale);
+	return k < 0 ? 0 : (k < static_cast<int>(count) ? static_cast<size_t>(k) : count - 1);
+}
+
+// Half the surface area, in proportion to the chance that a random ray
+// through the parent hits b.
+inline float half_area(aabb3 const& b)
+{
+	vec3 const s = b.size();
+	return s.x * s.y + s.y * s.z + s.z * s.x;
+}
+
+inline float box_distance2(float const* lo, float const* hi, vec3 const& p)
+{
+	float d = 0;
+	for (size_t a = 0; a < 3; ++a)
+	{
+		float const c = (&p.x)[a];
+		float const e = max(max(lo[a] - c, c - hi[a]), 0.0f);
+		d += e * e;
+	}
+	return d;
+}
+
+// Bit k set where the ray from origin with reciprocal direction inverse
+// enters child k before t, at enter[k]; as intersects(ray3, aabb3).
+inline int slab4(bvh_node const& n, vec3 const& origin, vec3 const& inverse, float t, float* enter)
+{
+#if defined(XXX_SSE)
+	using simd::float4;
+	float4 const t0x = simd::mul(simd::sub(simd::load(n.min_x), simd::splat<float4>(origin.x)), simd::splat<float4>(inverse.x));
+	float4 const t0y = simd::mul(simd::sub(simd::load(n.min_y), simd::splat<float4>(origin.y)), simd::splat<float4>(inverse.y));
+	float4 const t0z = simd::mul(simd::sub(simd::load(n.min_z), simd::splat<float4>(origin.z)), simd::splat<float4>(inverse.z));
+	float4 const t1x = simd::mul(simd::sub(simd::load(n.max_x), simd::splat<float4>(origin.x)), simd::splat<float4>(inverse.x));
+	float4 const t1y = simd::mul(simd::sub(simd::load(n.max_y), simd::splat<float4>(origin.y)), simd::splat<float4>(inverse.y));
+	float4 const t1z = simd::mul(simd::sub(simd::load(n.max_z), simd::splat<float4>(origin.z)), simd::splat<float4>(inverse.z));
+	float4 const e = simd::max(simd::max(simd::max(simd::min(t0x, t1x), simd::min(t0y, t1y)), simd::min(t0z, t1z)), simd::splat<float4>(0));
+	float4 const l = simd::min(simd::min(simd::max(t0x, t1x), simd::max(t0y, t1y)), simd::max(t0z, t1z));
+	simd::store(enter, e);
+	return simd::less_equal_mask(e, l) & simd::less_mask(e, simd::splat<float4>(t));
+#else
+	int mask = 0;
+	for (size_t k = 0; k < 4; ++k)
+	{
+		enter[k] = t;
+		if (slab(origin, inverse, vec3(n.min_x[k], n.min_y[k], n.min_z[k]), vec3(n.max_x[k], n.max_y[k], n.max_z[k]), enter[k]))
+		{
+			mask |= 1 << k;
+		}
+	}
+	return mask;
+#endif
+}
+
+// Bit k set where child k overlaps b.
+inline int overlap4(bvh_node const& n, aabb3 const& b)
+{
+#if defined(XXX_SSE)
+	using simd::float4;
+	return simd::less_equal_mask(simd::load(n.min_x), simd::splat<float4>(b.max.x))
+		& simd::less_equal_mask(simd::load(n.min_y), simd::splat<float4>(b.max.y))
+		& simd::less_equal_mask(simd::load(n.min_z), simd::splat<float4>(b.max.z))
+		& simd::less_equal_mask(simd::splat<float4>(b.min.x), simd::load(n.max_x))
+		& simd::less_equal_mask(simd::splat<float4>(b.min.y), simd::load(n.max_y))
+		& simd::less_equal_mask(simd::splat<float4>(b.min.z), simd::load(n.max_z));
+#else
+	int mask = 0;
+	for (size_t k = 0; k < 4; ++k)
+	{
+		mask |= overlaps(n.bounds(k), b) << k;
+	}
+	return mask;
+#endif
+}
+
+// Bit k set where child k overlaps s.
+inline int overlap4(bvh_node const& n, sphere3 const& s)
+{
+#if defined(XXX_SSE)
+	using simd::float4;
+	float4 const zero = simd::splat<float4>(0);
+	float4 const cx = simd::splat<float4>(s.center.x);
+	float4 const cy = simd::splat<float4>(s.center.y);
+	float4 const cz = simd::splat<float4>(s.center.z);
+	float4 const x = simd::max(simd::max(simd::sub(simd::load(n.min_x), cx), simd::sub(cx, simd::load(n.max_x))), zero);
+	float4 const y = simd::max(simd::max(simd::sub(simd::load(n.min_y), cy), simd::sub(cy, simd::load(n.max_y))), zero);
+	float4 const z = simd::max(simd::max(simd::sub(simd::load(n.min_z), cz), simd::sub(cz, simd::load(n.max_z))), zero);
+	float4 const d = simd::add(simd::add(simd::mul(x, x), simd::mul(y, y)), simd::mul(z, z));
+	return simd::less_equal_mask(d, simd::splat<float4>(s.radius * s.radius));
+#else
+	int mask = 0;
+	for (size_t k = 0; k < 4; ++k)
+	{
+		aabb3 const b = n.bounds(k);
+		mask |= (box_distance2(&b.min.x, &b.max.x, s.center) <= s.radius * s.radius) << k;
+	}
+	return mask;
+#endif
+}
+
+struct bvh_slab_op
+{
+	aabb3 b;
+
+	template <typename P, typename R>
+	int test(R const& r, size_t i, float* t) const
+	{
+		P enter;
+		return slab_mask(r, i, b, t, enter);
+	}
+};
+
+}
+
+// Bounding volume hierarchy over the boxes of n primitives, for ray casts and
+// overlap queries. build() splits top-down by the surface area heuristic over
+// 16 centroid bins per axis into a flat array of 4-wide nodes (bvh_node), with
+// up to leaf_size primitives per leaf; the executor form bins the top levels
+// in parallel and then builds the subtrees below them as parallel tasks.
+// Below max_depth levels, or where the centroids cannot be binned apart, nodes
+// are split at the median instead, which bounds the depth.
+//
+// The primitives themselves stay with the caller: queries report primitive
+// indices (positions in the array given to build()) to a callback, which does
+// any exact test. refit() moves the boxes of a deforming mesh, keeping the
+// tree; queries stay correct, but slow down as primitives move far from where
+// they were at build().
+class bvh
+{
+public:
+	static uint32_t const none = ~uint32_t(0);
+	static size_t const leaf_size = 4;
+	static size_t const max_depth = 24;
+
+	bvh() {}
+
+	void build(aabb3 const* bounds, size_t n)
+	{
+		build(0, bounds, n);
+	}
+
+	void build(executor& ex, aabb3 const* bounds, size_t n)
+	{
+		build(&ex, bounds, n);
+	}
+
+	// Takes new primitive boxes, in the order of build(), and recomputes the
+	// node boxes bottom up.
+	void refit(aabb3 const* bounds)
+	{
+		for (size_t j = 0; j < order.size(); ++j)
+		{
+			boxes[j] = bounds[order[j]];
+		}
+		for (size_t i = tree.size(); i-- > 0;)
+		{
+			bvh_node& n = tree[i];
+			for (size_t k = 0; k < 4; ++k)
+			{
+				if (n.count[k])
+				{
+					n.set_bounds(k, leaf_bounds(n.child[k], n.count[k]));
+				}
+				else if (n.child[k] != none)
+				{
+					n.set_bounds(k, node_bounds(tree[n.child[k]]));
+				}
+			}
+		}
+	}
+
+	size_t size() const
+	{
+		return order.size();
+	}
+
+	aabb3 bounds() const
+	{
+		return tree.empty() ? aabb3::empty() : node_bounds(tree[0]);
+	}
+
+	// The nodes, root first, with parents before their children.
+	bvh_node const* nodes() const
+	{
+		return tree.data();
+	}
+
+	size_t node_count() const
+	{
+		return tree.size();
+	}
+
+	// Primitive indices and boxes in leaf order.
+	uint32_t const* primitives() const
+	{
+		return order.data();
+	}
+
+	aabb3 const* primitive_bounds() const
+	{
+		return boxes.data();
+	}
+
+	// Casts r against the primitives whose boxes it enters before t, nearest
+	// nodes first. f(primitive, t) tests one: where r hits it at a distance
+	// below t, f sets t to that distance and returns true, as the intersects()
+	// tests in ray.hpp do. Returns whether any call did; t is then the nearest
+	// hit.
+	template <typename F>
+	bool raycast(ray3 const& r, float& t, F f) const
+	{
+		if (tree.empty())
+		{
+			return false;
+		}
+		vec3 const inverse(1 / r.direction.x, 1 / r.direction.y, 1 / r.direction.z);
+		entry stack[stack_size];
+		size_t top = 0;
+		stack[top++] = entry(0, 0, 0);
+		bool hit = false;
+		while (top > 0)
+		{
+			entry const e = stack[--top];
+			if (e.t >= t)
+			{
+				continue;
+			}
+			if (e.count)
+			{
+				for (size_t j = e.child; j < e.child + e.count; ++j)
+				{
+					hit |= f(static_cast<size_t>(order[j]), t);
+				}
+				continue;
+			}
+
+			bvh_node const& n = tree[e.child];
+			float enter[4];
+			int const mask = detail::slab4(n, r.origin, inverse, t, enter);
+			entry hits[4];
+			size_t m = 0;
+			for (size_t k = 0; k < 4; ++k)
+			{
+				if ((mask >> k & 1) && n.child[k] != none)
+				{
+					// Insertion sort, farthest first.
+					size_t i = m++;
+					for (; i > 0 && hits[i - 1].t < enter[k]; --i)
+					{
+						hits[i] = hits[i - 1];
+					}
+					hits[i] = entry(n.child[k], n.count[k], enter[k]);
+				}
+			}
+			for (size_t i = 0; i < m; ++i)
+			{
+				stack[top++] = hits[i];
+			}
+		}
+		return hit;
+	}
+
+	// Packet form: casts the rays of r, with distances t[0, N), against the
+	// primitives whose boxes any of them enters. f(primitive, t) tests one for
+	// the whole packet, updating t where rays hit it nearer, and returns the
+	// mask of those rays, as the packet intersects() tests in ray.hpp do.
+	// Returns the mask of rays hit by any call.
+	template <size_t N, typename F>
+	uint32_t raycast(ray_packet<N> const& r, float* t, F f) const
+	{
+		if (tree.empty())
+		{
+			return 0;
+		}
+		vec3 const d(r.dx[0], r.dy[0], r.dz[0]);
+		entry stack[stack_size];
+		size_t top = 0;
+		stack[top++] = entry(0, 0, 0);
+		uint32_t hit = 0;
+		while (top > 0)
+		{
+			entry const e = stack[--top];
+			if (e.count)
+			{
+				for (size_t j = e.child; j < e.child + e.count; ++j)
+				{
+					hit |= f(static_cast<size_t>(order[j]), t);
+				}
+				continue;
+			}
+
+			// Children the packet enters, ordered along its first ray.
+			bvh_node const& n = tree[e.child];
+			entry hits[4];
+			size_t m = 0;
+			for (size_t k = 0; k < 4; ++k)
+			{
+				detail::bvh_slab_op const op = { n.bounds(k) };
+				if (n.child[k] != none && detail::trace(r, op, t))
+				{
+					float const key = dot(op.b.center(), d);
+					size_t i = m++;
+					for (; i > 0 && hits[i - 1].t < key; --i)
+					{
+						hits[i] = hits[i - 1];
+					}
+					hits[i] = entry(n.child[k], n.count[k], key);
+				}
+			}
+			for (size_t i = 0; i < m; ++i)
+			{
+				stack[top++] = hits[i];
+			}
+		}
+		return hit;
+	}
+
+	// Calls f(primitive) for every primitive whose box overlaps b.
+	template <typename F>
+	void query(aabb3 const& b, F f) const
+	{
+		if (!b.is_empty())
+		{
+			visit(b, f);
+		}
+	}
+
+	// Calls f(primitive) for every primitive whose box overlaps s.
+	template <typename F>
+	void query(sphere3 const& s, F f) const
+	{
+		if (!s.is_empty())
+		{
+			visit(s, f);
+		}
+	}
+
+private:
+	// Bounds the traversal stacks: every level below the root adds at most 3
+	// entries, over at most max_depth levels split by the heuristic and 32
+	// split at the median, each of which at least halves the largest part.
+	static size_t const stack_size = 3 * (max_depth + 32) + 1;
+
+	struct entry
+	{
+		uint32_t child, count;
+		float t;
+
+		entry() {}
+		entry(uint32_t child, uint32_t count, float t) : child(child), count(count), t(t) {}
+	};
+
+	struct build_state
+	{
+		detail::bvh_ref* refs;
+		executor* ex;
+		size_t task_size;
+	};
+
+	struct task
+	{
+		detail::bvh_range range;
+		size_t depth;
+		size_t parent, slot;
+		std::vector<bvh_node> nodes;
+	};
+
+	static bvh_node empty_node()
+	{
+		bvh_node n;
+		for (size_t k = 0; k < 4; ++k)
+		{
+			n.set_bounds(k, aabb3::empty());
+			n.child[k] = none;
+			n.count[k] = 0;
+		}
+		return n;
+	}
+
+	static aabb3 node_bounds(bvh_node const& n)
+	{
+		return merge(merge(n.bounds(0), n.bounds(1)), merge(n.bounds(2), n.bounds(3)));
+	}
+
+	aabb3 leaf_bounds(size_t first, size_t count) const
+	{
+		aabb3 b = aabb3::empty();
+		for (size_t j = first; j < first + count; ++j)
+		{
+			b = merge(b, boxes[j]);
+		}
+		return b;
+	}
+
+	void build(executor* ex, aabb3 const* bounds, size_t n)
+	{
+		tree.clear();
+		order.resize(n);
+		boxes.resize(n);
+		if (n == 0)
+		{
+			return;
+		}
+
+		std::vector<detail::bvh_ref> refs(n);
+		build_state s = { refs.data(), ex, 0 };
+		size_t const grain = detail::parallel_grain(sizeof(aabb3) + sizeof(detail::bvh_ref));
+		detail::bvh_range root = { 0, n, aabb3::empty(), aabb3::empty() };
+		auto const prepare = [&](size_t begin, size_t end) {
+			detail::bvh_range r = { begin, end, aabb3::empty(), aabb3::empty() };
+			for (size_t i = begin; i < end; ++i)
+			{
+				refs[i].bounds = bounds[i];
+				refs[i].index = static_cast<uint32_t>(i);
+				r.bounds = merge(r.bounds, bounds[i]);
+				r.centroids = merge(r.centroids, refs[i].centroid());
+			}
+			return r;
+		};
+		root = ex ? parallel_reduce(*ex, n, grain, root, prepare, detail::merge_range) : detail::merge_range(root, prepare(0, n));
+
+		if (n <= leaf_size)
+		{
+			tree.push_back(empty_node());
+			tree[0].set_bounds(0, root.bounds);
+			tree[0].child[0] = 0;
+			tree[0].count[0] = static_cast<uint32_t>(n);
+		}
+		else
+		{
+			std::vector<task> tasks;
+			if (ex)
+			{
+				s.task_size = std::max<size_t>(n / (16 * ex->concurrency()), 4096);
+			}
+			build_node(s, tree, root, 0, &tasks);
+			if (!tasks.empty())
+			{
+				s.ex = 0;
+				parallel_for(*ex, tasks.size(), 1, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; ++i)
+					{
+						build_node(s, tasks[i].nodes, tasks[i].range, tasks[i].depth, 0);
+					}
+				});
+				for (size_t i = 0; i < tasks.size(); ++i)
+				{
+					splice(tasks[i]);
+				}
+			}
+		}
+
+		for (size_t j = 0; j < n; ++j)
+		{
+			order[j] = refs[j].index;
+			boxes[j] = refs[j].bounds;
+		}
+	}
+
+	// Appends the node for r, which has more than leaf_size primitives, and its
+	// descendants to out, and returns its index there. Children of at most
+	// task_size primitives are left to tasks where there is a task list.
+	static size_t build_node(build_state const& s, std::vector<bvh_node>& out, detail::bvh_range const& r, size_t depth, std::vector<task>* tasks)
+	{
+		// Split the widest part that is not yet a leaf, until there are four.
+		detail::bvh_range parts[4] = { r };
+		size_t count = 1;
+		while (count < 4)
+		{
+			size_t widest = count;
+			float area = -1;
+			for (size_t k = 0; k < count; ++k)
+			{
+				if (parts[k].size() > leaf_size && detail::half_area(parts[k].bounds) > area)
+				{
+					widest = k;
+					area = detail::half_area(parts[k].bounds);
+				}
+			}
+			if (widest == count)
+			{
+				break;
+			}
+			split(s, parts[widest], depth, parts[widest], parts[count]);
+			++count;
+		}
+
+		size_t const index = out.size();
+		out.push_back(empty_node());
+		for (size_t k = 0; k < count; ++k)
+		{
+			detail::bvh_range const& p = parts[k];
+			out[index].set_bounds(k, p.bounds);
+			if (p.size() <= leaf_size)
+			{
+				out[index].child[k] = static_cast<uint32_t>(p.begin);
+				out[index].count[k] = static_cast<uint32_t>(p.size());
+			}
+			else if (tasks && p.size() <= s.task_size)
+			{
+				tasks->push_back(task());
+				tasks->back().range = p;
+				tasks->back().depth = depth + 1;
+				tasks->back().parent = index;
+				tasks->back().slot = k;
+			}
+			else
+			{
+				size_t const child = build_node(s, out, p, depth + 1, tasks);
+				out[index].child[k] = static_cast<uint32_t>(child);
+			}
+		}
+		return index;
+	}
+
+	// Appends the nodes a task built, relocating their child indices.
+	void splice(task const& t)
+	{
+		uint32_t const offset = static_cast<uint32_t>(tree.size());
+		for (size_t i = 0; i < t.nodes.size(); ++i)
+		{
+			bvh_node n = t.nodes[i];
+			for (size_t k = 0; k < 4; ++k)
+			{
+				if (n.count[k] == 0 && n.child[k] != none)
+				{
+					n.child[k] += offset;
+				}
+			}
+			tree.push_back(n);
+		}
+		tree[t.parent].child[t.slot] = offset;
+	}
+
+	static detail::bvh_range measure(build_state const& s, size_t begin, size_t end)
+	{
+		detail::bvh_range r = { begin, end, aabb3::empty(), aabb3::empty() };
+		for (size_t i = begin; i < end; ++i)
+		{
+			r.bounds = merge(r.bounds, s.refs[i].bounds);
+			r.centroids = merge(r.centroids, s.refs[i].centroid());
+		}
+		return r;
+	}
+
+	static detail::bvh_binning bin(build_state const& s, size_t begin, size_t end, float const* lo, float const* scale, size_t count)
+	{
+		detail::bvh_binning b(count);
+		for (size_t i = begin; i < end; ++i)
+		{
+			detail::bvh_ref const& p = s.refs[i];
+			vec3 const c = p.centroid();
+			for (size_t a = 0; a < 3; ++a)
+			{
+				detail::bvh_bin& x = b.bins[a][detail::bvh_bin_index((&c.x)[a], lo[a], scale[a], count)];
+				x.bounds = merge(x.bounds, p.bounds);
+				++x.count;
+			}
+		}
+		return b;
+	}
+
+	// Splits r in two by the surface area heuristic: the bin boundary that
+	// minimizes area * count summed over both sides. Ranges smaller than
+	// bvh_bin_count get a bin per primitive.
+	static void split(build_state const& s, detail::bvh_range const r, size_t depth, detail::bvh_range& left, detail::bvh_range& right)
+	{
+		float const* const lo = &r.centroids.min.x;
+		vec3 const extent = r.centroids.size();
+		size_t const count = std::min(r.size(), detail::bvh_bin_count);
+		float scale[3];
+		for (size_t a = 0; a < 3; ++a)
+		{
+			float const e = (&extent.x)[a];
+			scale[a] = e > 0 ? count / e : 0;
+		}
+
+		if (depth < max_depth && (scale[0] > 0 || scale[1] > 0 || scale[2] > 0))
+		{
+			detail::bvh_binning b(count);
+			if (s.ex && r.size() > s.task_size)
+			{
+				size_t const grain = std::max(detail::parallel_grain(sizeof(detail::bvh_ref)), r.size() / (8 * s.ex->concurrency()));
+				b = parallel_reduce(*s.ex, r.size(), grain, b, [&](size_t begin, size_t end) {
+					return bin(s, r.begin + begin, r.begin + end, lo, scale, count);
+				}, detail::merge_binning);
+			}
+			else
+			{
+				b = bin(s, r.begin, r.end, lo, scale, count);
+			}
+
+			float best = std::numeric_limits<float>::infinity();
+			size_t axis = 0, boundary = 0;
+			for (size_t a = 0; a < 3; ++a)
+			{
+				if (scale[a] == 0)
+				{
+					continue;
+				}
+				float right_cost[detail::bvh_bin_count];
+				aabb3 acc = aabb3::empty();
+				size_t n = 0;
+				for (size_t k = count - 1; k > 0; --k)
+				{
+					acc = merge(acc, b.bins[a][k].bounds);
+					n += b.bins[a][k].count;
+					right_cost[k] = n ? detail::half_area(acc) * n : -1;
+				}
+				acc = aabb3::empty();
+				n = 0;
+				for (size_t k = 1; k < count; ++k)
+				{
+					acc = merge(acc, b.bins[a][k - 1].bounds);
+					n += b.bins[a][k - 1].count;
+					float const cost = detail::half_area(acc) * n + right_cost[k];
+					if (n && right_cost[k] >= 0 && cost < best)
+					{
+						best = cost;
+						axis = a;
+						boundary = k;
+					}
+				}
+			}
+
+			if (boundary)
+			{
+				// Partition in place, bounding both sides on the way.
+				left = right = detail::bvh_range();
+				left.bounds = left.centroids = right.bounds = right.centroids = aabb3::empty();
+				size_t i = r.begin, j = r.end;
+				while (i < j)
+				{
+					detail::bvh_ref& p = s.refs[i];
+					vec3 const c = p.centroid();
+					if (detail::bvh_bin_index((&c.x)[axis], lo[axis], scale[axis], count) < boundary)
+					{
+						left.bounds = merge(left.bounds, p.bounds);
+						left.centroids = merge(left.centroids, c);
+						++i;
+					}
+					else
+					{
+						right.bounds = merge(right.bounds, p.bounds);
+						right.centroids = merge(right.centroids, c);
+						std::swap(p, s.refs[--j]);
+					}
+				}
+				left.begin = r.begin;
+				left.end = right.begin = i;
+				right.end = r.end;
+				return;
+			}
+		}
+
+		// Median of the longest centroid axis.
+		size_t const axis = extent.x >= extent.y ? (extent.x >= extent.z ? 0 : 2) : (extent.y >= extent.z ? 1 : 2);
+		size_t const middle = r.begin + r.size() / 2;
+		std::nth_element(s.refs + r.begin, s.refs + middle, s.refs + r.end, [&](detail::bvh_ref const& a, detail::bvh_ref const& b) {
+			vec3 const ca = a.centroid();
+			vec3 const cb = b.centroid();
+			return (&ca.x)[axis] < (&cb.x)[axis];
+		});
+		left = measure(s, r.begin, middle);
+		right = measure(s, middle, r.end);
+	}
+
+	template <typename Q, typename F>
+	void visit(Q const& q, F& f) const
+	{
+		if (tree.empty())
+		{
+			return;
+		}
+		uint32_t stack[stack_size];
+		size_t top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			bvh_node const& n = tree[stack[--top]];
+			int const mask = detail::overlap4(n, q);
+			for (size_t k = 0; k < 4; ++k)
+			{
+				if (!(mask >> k & 1) || n.child[k] == none)
+				{
+					continue;
+				}
+				if (n.count[k] == 0)
+				{
+					stack[top++] = n.child[k];
+					continue;
+				}
+				for (size_t j = n.child[k]; j < n.child[k] + n.count[k]; ++j)
+				{
+					if (touches(boxes[j], q))
+					{
+						f(static_cast<size_t>(order[j]));
+					}
+				}
+			}
+		}
+	}
+
+	static bool touches(aabb3 const& b, aabb3 const& q)
+	{
+		return overlaps(b, q);
+	}
+
+	static bool touches(aabb3 const& b, sphere3 const& s)
+	{
+		return detail::box_distance2(&b.min.x, &b.max.x, s.center) <= s.radius * s.radius;
+	}
+
+	std::vector<bvh_node> tree;
+	std::vector<uint32_t> order;
+	std::vector<aabb3> boxes;
+};
+
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef CACHED_TRANSFORM_H
+#define CACHED_TRANSFORM_H
+
+#include <atomic>
+
+#include "transform.hpp"
+
+namespace xxx
+{
+
+// A transform that keeps its model and view matrices. Each matrix is computed
+// on first use after a change, by transform::model_matrix() and view_matrix(),
+// and returned from the cache until position or rotation change again.
+//
+// The const functions may be called from any number of threads at once and
+// never block: a thread that finds a matrix missing computes it itself, and
+// one of them stores it. The setters need exclusive access, like any write.
+template <typename T>
+class basic_cached_transform
+{
+public:
+	typedef T value_type;
+
+	basic_cached_transform() : model(), view(), state(0) {}
+	explicit basic_cached_transform(basic_transform<T> const& t) : value(t), model(), view(), state(0) {}
+	explicit basic_cached_transform(basic_vec3<T> const& v, basic_quaternion<T> const& q) : value(v, q), model(), view(), state(0) {}
+
+	basic_cached_transform(basic_cached_transform const& c) : model(), view(), state(0)
+	{
+		*this = c;
+	}
+
+	basic_cached_transform& operator = (basic_cached_transform const& c)
+	{
+		if (this != &c)
+		{
+			unsigned const s = c.state.load(std::memory_order_acquire) & (model_valid | view_valid);
+			value = c.value;
+			if (s & model_valid)
+			{
+				model = c.model;
+			}
+			if (s & view_valid)
+			{
+				view = c.view;
+			}
+			state.store(s, std::memory_order_relaxed);
+		}
+		return *this;
+	}
+
+	basic_transform<T> const& get() const
+	{
+		return value;
+	}
+
+	basic_vec3<T> const& position() const
+	{
+		return value.position;
+	}
+
+	basic_quaternion<T> const& rotation() const
+	{
+		return value.rotation;
+	}
+
+	void set(basic_transform<T> const& t)
+	{
+		value = t;
+		state.store(0, std::memory_order_relaxed);
+	}
+
+	void set_position(basic_vec3<T> const& v)
+	{
+		value.position = v;
+		state.store(0, std::memory_order_relaxed);
+	}
+
+	void set_rotation(basic_quaternion<T> const& q)
+	{
+		value.rotation = q;
+		state.store(0, std::memory_order_relaxed);
+	}
+
+	basic_mat4<T> model_matrix() const
+	{
+		return cached(model, model_valid, &basic_transform<T>::model_matrix);
+	}
+
+	basic_mat4<T> view_matrix() const
+	{
+		return cached(view, view_valid, &basic_transform<T>::view_matrix);
+	}
+
+private:
+	// Each matrix has a valid bit and a busy bit (valid << 2); the thread that
+	// sets busy writes the matrix and then swaps busy for valid, with release
+	// order so readers that see valid also see the matrix.
+	static unsigned const model_valid = 1;
+	static unsigned const view_valid = 2;
+
+	basic_mat4<T> cached(basic_mat4<T>& m, unsigned valid, basic_mat4<T> (basic_transform<T>::*f)() const) const
+	{
+		unsigned s = state.load(std::memory_order_acquire);
+		if (s & valid)
+		{
+			return m;
+		}
+
+		basic_mat4<T> const r = (value.*f)();
+		unsigned const busy = valid << 2;
+		while (!(s & (valid | busy)))
+		{
+			if (state.compare_exchange_weak(s, s | busy, std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				m = r;
+				state.fetch_xor(valid | busy, std::memory_order_release);
+				break;
+			}
+		}
+		return r;
+	}
+
+	basic_transform<T> value;
+	mutable basic_mat4<T> model;
+	mutable basic_mat4<T> view;
+	mutable std::atomic<unsigned> state;
+};
+
+typedef basic_cached_transform<scalar_t> cached_transform;
+typedef basic_cached_transform<double> dcached_transform;
+
+}
+
+#endif
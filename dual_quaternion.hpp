@@ -0,0 +1,187 @@
+#ifndef DUAL_QUATERNION_H
+#define DUAL_QUATERNION_H
+
+#include "quaternion.hpp"
+#include "transform.hpp"
+#include "mat4.hpp"
+
+namespace xxx
+{
+
+// Rigid transform as a unit dual quaternion real + e dual, with
+// dual = 0.5 * position * real. Products are quaternion products, so as with
+// quaternion operator *, b * a applies a first: (b * a).to_transform() equals
+// a.to_transform() * b.to_transform().
+template <typename T>
+struct basic_dual_quaternion
+{
+	typedef T value_type;
+
+	basic_quaternion<T> real, dual;
+
+	basic_dual_quaternion() = default;
+	explicit constexpr basic_dual_quaternion(basic_quaternion<T> const& real, basic_quaternion<T> const& dual) : real(real), dual(dual) {}
+
+	explicit basic_dual_quaternion(basic_transform<T> const& t) : real(t.rotation)
+	{
+		basic_quaternion<T> const d = basic_quaternion<T>(t.position, 0) * t.rotation;
+		dual = basic_quaternion<T>(d.x * static_cast<T>(0.5), d.y * static_cast<T>(0.5), d.z * static_cast<T>(0.5), d.w * static_cast<T>(0.5));
+	}
+
+	// m must be a rotation and a translation.
+	explicit basic_dual_quaternion(basic_mat4<T> const& m)
+		: basic_dual_quaternion(basic_transform<T>(m.w.to_vec3(), basic_quaternion<T>::from_matrix(m.to_mat3())))
+	{
+	}
+
+	template <typename U>
+	explicit constexpr basic_dual_quaternion(basic_dual_quaternion<U> const& q) : real(q.real), dual(q.dual) {}
+
+	basic_vec3<T> translation() const
+	{
+		// The vector part of 2 * dual * conjugate(real).
+		basic_vec3<T> const r = real.vector();
+		basic_vec3<T> const d = dual.vector();
+		return (d * real.w - r * dual.w + cross(r, d)) * 2;
+	}
+
+	basic_transform<T> to_transform() const
+	{
+		return basic_transform<T>(translation(), real);
+	}
+
+	basic_mat4<T> to_mat4() const
+	{
+		return basic_mat4<T>(real.to_matrix(), basic_vec4<T>(translation(), 1));
+	}
+
+	static constexpr basic_dual_quaternion identity()
+	{
+		return basic_dual_quaternion(basic_quaternion<T>::identity(), basic_quaternion<T>(0, 0, 0, 0));
+	}
+};
+
+typedef basic_dual_quaternion<scalar_t> dual_quaternion;
+typedef basic_dual_quaternion<double> ddual_quaternion;
+
+template <typename T>
+inline constexpr basic_dual_quaternion<T> operator * (basic_dual_quaternion<T> const& a, basic_dual_quaternion<T> const& b)
+{
+	basic_quaternion<T> const rd = a.real * b.dual;
+	basic_quaternion<T> const dr = a.dual * b.real;
+	return basic_dual_quaternion<T>(a.real * b.real, basic_quaternion<T>(rd.x + dr.x, rd.y + dr.y, rd.z + dr.z, rd.w + dr.w));
+}
+
+// The inverse of a unit dual quaternion.
+template <typename T>
+inline constexpr basic_dual_quaternion<T> conjugate(basic_dual_quaternion<T> const& q)
+{
+	return basic_dual_quaternion<T>(conjugate(q.real), conjugate(q.dual));
+}
+
+// Scales to a unit real part and removes the component of dual along real, so
+// the result is a rigid transform again. A zero real part is returned
+// unchanged.
+template <typename T>
+inline basic_dual_quaternion<T> normalize(basic_dual_quaternion<T> const& q)
+{
+	T const n = q.real.norm();
+	T const in = n == 0 ? 1 : 1 / n;
+	basic_quaternion<T> const r(q.real.x * in, q.real.y * in, q.real.z * in, q.real.w * in);
+	basic_quaternion<T> const d(q.dual.x * in, q.dual.y * in, q.dual.z * in, q.dual.w * in);
+	T const rd = r.x * d.x + r.y * d.y + r.z * d.z + r.w * d.w;
+	return basic_dual_quaternion<T>(r, basic_quaternion<T>(d.x - r.x * rd, d.y - r.y * rd, d.z - r.z * rd, d.w - r.w * rd));
+}
+
+// q must be unit length.
+template <typename T>
+inline basic_vec3<T> transform_point(basic_dual_quaternion<T> const& q, basic_vec3<T> const& p)
+{
+	return rotate(p, q.real) + q.translation();
+}
+
+template <typename T>
+inline constexpr basic_vec3<T> transform_vector(basic_dual_quaternion<T> const& q, basic_vec3<T> const& v)
+{
+	return rotate(v, q.real);
+}
+
+// Dual quaternion linear blending (Kavan et al., "Geometric Skinning with
+// Approximate Dual Quaternion Blending"): the normalized weighted sum, along
+// the shorter path. Cheap, and close to sclerp for the small angles between
+// the poses of a joint; a and b must be unit length.
+template <typename T>
+inline basic_dual_quaternion<T> dlb(basic_dual_quaternion<T> const& a, basic_dual_quaternion<T> const& b, typename basic_dual_quaternion<T>::value_type t)
+{
+	T const cosine = a.real.x * b.real.x + a.real.y * b.real.y + a.real.z * b.real.z + a.real.w * b.real.w;
+	T const lower_weight = 1 - t;
+	T const upper_weight = signbit(cosine) ? -t : t;
+	return normalize(basic_dual_quaternion<T>(
+		basic_quaternion<T>(
+			a.real.x * lower_weight + b.real.x * upper_weight,
+			a.real.y * lower_weight + b.real.y * upper_weight,
+			a.real.z * lower_weight + b.real.z * upper_weight,
+			a.real.w * lower_weight + b.real.w * upper_weight),
+		basic_quaternion<T>(
+			a.dual.x * lower_weight + b.dual.x * upper_weight,
+			a.dual.y * lower_weight + b.dual.y * upper_weight,
+			a.dual.z * lower_weight + b.dual.z * upper_weight,
+			a.dual.w * lower_weight + b.dual.w * upper_weight)));
+}
+
+// Weighted blend of n unit dual quaternions; each is flipped onto the
+// hemisphere of q[0] first.
+template <typename T>
+inline basic_dual_quaternion<T> dlb(basic_dual_quaternion<T> const* q, T const* weights, size_t n)
+{
+	basic_dual_quaternion<T> s(basic_quaternion<T>(0, 0, 0, 0), basic_quaternion<T>(0, 0, 0, 0));
+	for (size_t i = 0; i < n; ++i)
+	{
+		basic_quaternion<T> const& r = q[i].real;
+		basic_quaternion<T> const& d = q[i].dual;
+		T const cosine = q[0].real.x * r.x + q[0].real.y * r.y + q[0].real.z * r.z + q[0].real.w * r.w;
+		T const w = signbit(cosine) ? -weights[i] : weights[i];
+		s.real = basic_quaternion<T>(s.real.x + r.x * w, s.real.y + r.y * w, s.real.z + r.z * w, s.real.w + r.w * w);
+		s.dual = basic_quaternion<T>(s.dual.x + d.x * w, s.dual.y + d.y * w, s.dual.z + d.z * w, s.dual.w + d.w * w);
+	}
+	return normalize(s);
+}
+
+// Screw linear interpolation: a constant-speed rotation about and translation
+// along the screw axis from a to b, the dual quaternion analog of slerp. a and
+// b must be unit length.
+template <typename T>
+inline basic_dual_quaternion<T> sclerp(basic_dual_quaternion<T> const& a, basic_dual_quaternion<T> const& b, typename basic_dual_quaternion<T>::value_type t)
+{
+	basic_dual_quaternion<T> d = conjugate(a) * b;
+	if (d.real.w < 0)
+	{
+		d = basic_dual_quaternion<T>(
+			basic_quaternion<T>(-d.real.x, -d.real.y, -d.real.z, -d.real.w),
+			basic_quaternion<T>(-d.dual.x, -d.dual.y, -d.dual.z, -d.dual.w));
+	}
+
+	// d turns by 2h about the screw axis and moves pitch along it; d^t turns
+	// by 2th and moves t pitch. The part of the translation across the axis
+	// is the chord of the turn, which scales by sin(th) / sin(h) and rotates
+	// by (1 - t) h. Everything stays bounded as h goes to 0, where d^t moves
+	// by t times the translation of d.
+	basic_vec3<T> const v = d.real.vector();
+	basic_vec3<T> const tr = d.translation();
+	T const s = length(v);
+	T const h = atan(s, d.real.w);
+	T sine, cosine;
+	sincos(h * t, sine, cosine);
+	T const k = s > 0 ? sine / s : t;
+	basic_vec3<T> const axis = s > 0 ? v * (1 / s) : basic_vec3<T>(0);
+	T const pitch = dot(tr, axis);
+	T sa, ca;
+	sincos(h * (1 - t), sa, ca);
+	basic_vec3<T> const chord = ((tr - axis * pitch) * ca - cross(axis, tr) * sa) * k;
+	basic_dual_quaternion<T> const p(basic_transform<T>(axis * (pitch * t) + chord, basic_quaternion<T>(v * k, cosine)));
+	return a * p;
+}
+
+}
+
+#endif
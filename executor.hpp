@@ -0,0 +1,105 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <stddef.h>
+
+#include <vector>
+
+namespace xxx
+{
+
+// Runs batch work on several threads. thread_pool (thread_pool.hpp) is the
+// default implementation; derive from executor to run the batch functions on
+// another job system.
+class executor
+{
+public:
+	virtual ~executor() {}
+
+	// Calls task(context, i) once for every i in [0, count) and returns when
+	// all calls have finished. Calls may run concurrently, in any order and on
+	// any thread, including the calling one. task does not throw.
+	virtual void run(size_t count, void (*task)(void*, size_t), void* context) = 0;
+
+	// Number of threads run() may use at once.
+	virtual size_t concurrency() const = 0;
+};
+
+namespace detail
+{
+
+// Elements per parallel chunk: about 32 KiB of input and output, so a chunk
+// streams through L1, in multiples of 16 elements so chunk boundaries fall on
+// cache lines and the SIMD loops only have a tail in the last chunk.
+inline size_t parallel_grain(size_t bytes_per_item)
+{
+	size_t const n = (32768 / bytes_per_item) & ~size_t(15);
+	return n ? n : 16;
+}
+
+template <typename F>
+struct parallel_context
+{
+	F const* f;
+	size_t n;
+	size_t grain;
+};
+
+template <typename F>
+inline void parallel_task(void* context, size_t i)
+{
+	parallel_context<F> const& c = *static_cast<parallel_context<F> const*>(context);
+	size_t const begin = i * c.grain;
+	size_t const end = c.n - begin < c.grain ? c.n : begin + c.grain;
+	(*c.f)(begin, end);
+}
+
+}
+
+// Calls f(begin, end) over [0, n) in chunks of grain elements, through ex.
+// Work that fits in one chunk runs on the calling thread without involving ex.
+template <typename F>
+inline void parallel_for(executor& ex, size_t n, size_t grain, F const& f)
+{
+	if (grain == 0)
+	{
+		grain = 1;
+	}
+	if (n <= grain)
+	{
+		if (n > 0)
+		{
+			f(size_t(0), n);
+		}
+		return;
+	}
+
+	detail::parallel_context<F> context = { &f, n, grain };
+	ex.run((n + grain - 1) / grain, &detail::parallel_task<F>, &context);
+}
+
+// Returns the chunk results r = f(begin, end) of parallel_for folded in chunk
+// order as r = merge(r, chunk), starting from identity.
+template <typename R, typename F, typename M>
+inline R parallel_reduce(executor& ex, size_t n, size_t grain, R const& identity, F const& f, M const& merge)
+{
+	if (grain == 0)
+	{
+		grain = 1;
+	}
+	std::vector<R> chunks((n + grain - 1) / grain, identity);
+	parallel_for(ex, n, grain, [&](size_t begin, size_t end) {
+		chunks[begin / grain] = f(begin, end);
+	});
+
+	R r = identity;
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		r = merge(r, chunks[i]);
+	}
+	return r;
+}
+
+}
+
+#endif
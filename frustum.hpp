@@ -0,0 +1,446 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vec3.hpp"
+#include "vec4.hpp"
+#include "mat4.hpp"
+#include "aabb3.hpp"
+#include "sphere3.hpp"
+#include "soa.hpp"
+#include "executor.hpp"
+#include "simd.hpp"
+
+namespace xxx
+{
+
+// The six planes of a view volume, in the order left, right, bottom, top,
+// near, far. A plane (n, d) is stored as vec4(n, d) with n of unit length
+// pointing inward, so dot(n, p) + d is the signed distance of p from the plane
+// and the volume is where every distance is at least 0.
+template <typename T>
+struct basic_frustum
+{
+	typedef T value_type;
+
+	static size_t const plane_count = 6;
+
+	basic_vec4<T> planes[plane_count];
+
+	basic_frustum() = default;
+
+	// The volume that m maps into clip space, -w <= x, y, z <= w, as frustum(),
+	// perspective() and ortho() build it: for world space planes pass
+	// view * projection (see mat4 operator *). Planes that degenerate, like
+	// the far plane of an infinite projection, are kept unnormalized and
+	// never reject anything.
+	explicit basic_frustum(basic_mat4<T> const& m)
+	{
+		basic_mat4<T> const r = transpose(m);
+		planes[0] = r.w + r.x;
+		planes[1] = r.w - r.x;
+		planes[2] = r.w + r.y;
+		planes[3] = r.w - r.y;
+		planes[4] = r.w + r.z;
+		planes[5] = r.w - r.z;
+		for (size_t k = 0; k < plane_count; ++k)
+		{
+			T const n = length(planes[k].to_vec3());
+			if (n > 0)
+			{
+				planes[k] = planes[k] * (1 / n);
+			}
+		}
+	}
+
+	template <typename U>
+	explicit basic_frustum(basic_frustum<U> const& f)
+	{
+		for (size_t k = 0; k < plane_count; ++k)
+		{
+			planes[k] = basic_vec4<T>(f.planes[k]);
+		}
+	}
+};
+
+typedef basic_frustum<scalar_t> frustum;
+typedef basic_frustum<double> dfrustum;
+
+namespace detail
+{
+
+// dot(n, p) + d and dot(abs(n), e), summed in the order of the batch kernels.
+
+template <typename T>
+inline T plane_distance(basic_vec4<T> const& plane, basic_vec3<T> const& p)
+{
+	return p.z * plane.z + (p.y * plane.y + (p.x * plane.x + plane.w));
+}
+
+template <typename T>
+inline T plane_extent(basic_vec4<T> const& plane, basic_vec3<T> const& e)
+{
+	return e.z * abs(plane.z) + (e.y * abs(plane.y) + e.x * abs(plane.x));
+}
+
+}
+
+// Conservative tests: false only where the bounds lie entirely outside one of
+// the planes. Boxes are tested in center and half extent form,
+// dot(n, center) + d < -dot(abs(n), extent).
+
+template <typename T>
+inline bool intersects(basic_frustum<T> const& f, basic_vec3<T> const& center, T radius)
+{
+	for (size_t k = 0; k < basic_frustum<T>::plane_count; ++k)
+	{
+		if (detail::plane_distance(f.planes[k], center) < -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+template <typename T>
+inline bool intersects(basic_frustum<T> const& f, basic_vec3<T> const& min, basic_vec3<T> const& max)
+{
+	basic_vec3<T> const center = (max + min) * static_cast<T>(0.5);
+	basic_vec3<T> const extent = (max - min) * static_cast<T>(0.5);
+	for (size_t k = 0; k < basic_frustum<T>::plane_count; ++k)
+	{
+		if (detail::plane_distance(f.planes[k], center) < -detail::plane_extent(f.planes[k], extent))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Hierarchical forms: only the planes in planes (bit k for plane k) are
+// tested, and those the bounds cross are left in it. Bounds nested in a node
+// need only test the node's remaining planes, and none once it is 0.
+
+template <typename T>
+inline bool intersects(basic_frustum<T> const& f, basic_vec3<T> const& center, T radius, unsigned& planes)
+{
+	for (size_t k = 0; k < basic_frustum<T>::plane_count; ++k)
+	{
+		if (planes & (1u << k))
+		{
+			T const d = detail::plane_distance(f.planes[k], center);
+			if (d < -radius)
+			{
+				return false;
+			}
+			if (d >= radius)
+			{
+				planes &= ~(1u << k);
+			}
+		}
+	}
+	return true;
+}
+
+template <typename T>
+inline bool intersects(basic_frustum<T> const& f, basic_vec3<T> const& min, basic_vec3<T> const& max, unsigned& planes)
+{
+	basic_vec3<T> const center = (max + min) * static_cast<T>(0.5);
+	basic_vec3<T> const extent = (max - min) * static_cast<T>(0.5);
+	for (size_t k = 0; k < basic_frustum<T>::plane_count; ++k)
+	{
+		if (planes & (1u << k))
+		{
+			T const d = detail::plane_distance(f.planes[k], center);
+			T const r = detail::plane_extent(f.planes[k], extent);
+			if (d < -r)
+			{
+				return false;
+			}
+			if (d >= r)
+			{
+				planes &= ~(1u << k);
+			}
+		}
+	}
+	return true;
+}
+
+// The same tests on aabb3 and sphere3; empty bounds intersect nothing.
+
+template <typename T>
+inline bool intersects(basic_frustum<T> const& f, basic_aabb3<T> const& b)
+{
+	return !b.is_empty() && intersects(f, b.min, b.max);
+}
+
+template <typename T>
+inline bool intersects(basic_frustum<T> const& f, basic_sphere3<T> const& s)
+{
+	return !s.is_empty() && intersects(f, s.center, s.radius);
+}
+
+template <typename T>
+inline bool intersects(basic_frustum<T> const& f, basic_aabb3<T> const& b, unsigned& planes)
+{
+	return !b.is_empty() && intersects(f, b.min, b.max, planes);
+}
+
+template <typename T>
+inline bool intersects(basic_frustum<T> const& f, basic_sphere3<T> const& s, unsigned& planes)
+{
+	return !s.is_empty() && intersects(f, s.center, s.radius, planes);
+}
+
+namespace detail
+{
+
+// Plane coefficients by component, with the negated absolute values of the
+// normals for the box extents.
+struct frustum_planes
+{
+	float n[7][basic_frustum<float>::plane_count];
+
+	explicit frustum_planes(basic_frustum<float> const& f)
+	{
+		for (size_t k = 0; k < basic_frustum<float>::plane_count; ++k)
+		{
+			n[0][k] = f.planes[k].x;
+			n[1][k] = f.planes[k].y;
+			n[2][k] = f.planes[k].z;
+			n[3][k] = f.planes[k].w;
+			n[4][k] = -abs(f.planes[k].x);
+			n[5][k] = -abs(f.planes[k].y);
+			n[6][k] = -abs(f.planes[k].z);
+		}
+	}
+};
+
+struct sphere_pack
+{
+	typedef pack P;
+
+	P cx, cy, cz, nr;
+
+	sphere_pack(vec3_soa const& centers, scalar_soa const& radii, size_t i)
+		: cx(simd::load<P>(centers.x() + i))
+		, cy(simd::load<P>(centers.y() + i))
+		, cz(simd::load<P>(centers.z() + i))
+		, nr(simd::sub(simd::splat<P>(0), simd::load<P>(radii.data() + i)))
+	{
+	}
+
+	P negative_extent(P const*) const
+	{
+		return nr;
+	}
+};
+
+struct box_pack
+{
+	typedef pack P;
+
+	P cx, cy, cz, ex, ey, ez;
+
+	box_pack(vec3_soa const& mins, vec3_soa const& maxs, size_t i)
+	{
+		P const half = simd::splat<P>(0.5f);
+		P const x0 = simd::load<P>(mins.x() + i);
+		P const y0 = simd::load<P>(mins.y() + i);
+		P const z0 = simd::load<P>(mins.z() + i);
+		P const x1 = simd::load<P>(maxs.x() + i);
+		P const y1 = simd::load<P>(maxs.y() + i);
+		P const z1 = simd::load<P>(maxs.z() + i);
+		cx = simd::mul(simd::add(x1, x0), half);
+		cy = simd::mul(simd::add(y1, y0), half);
+		cz = simd::mul(simd::add(z1, z0), half);
+		ex = simd::mul(simd::sub(x1, x0), half);
+		ey = simd::mul(simd::sub(y1, y0), half);
+		ez = simd::mul(simd::sub(z1, z0), half);
+	}
+
+	P negative_extent(P const* p) const
+	{
+		return simd::madd(ez, p[6], simd::madd(ey, p[5], simd::mul(ex, p[4])));
+	}
+};
+
+// 0 or 1 per bit of a 4 bit mask.
+static unsigned char const lane_bytes[16][4] =
+{
+	{ 0, 0, 0, 0 }, { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 1, 1, 0, 0 },
+	{ 0, 0, 1, 0 }, { 1, 0, 1, 0 }, { 0, 1, 1, 0 }, { 1, 1, 1, 0 },
+	{ 0, 0, 0, 1 }, { 1, 0, 0, 1 }, { 0, 1, 0, 1 }, { 1, 1, 0, 1 },
+	{ 0, 0, 1, 1 }, { 1, 0, 1, 1 }, { 0, 1, 1, 1 }, { 1, 1, 1, 1 }
+};
+
+// Sets p[l] to v for the lanes l of mask, 4 at a time in full packs.
+inline void set_lanes(unsigned char* p, int mask, size_t lanes, unsigned char v)
+{
+	if (simd::width >= 4 && lanes == simd::width)
+	{
+		for (size_t l = 0; l < lanes; l += 4)
+		{
+			uint32_t m, u;
+			memcpy(&m, lane_bytes[(mask >> l) & 15], 4);
+			memcpy(&u, p + l, 4);
+			m *= 0xff;
+			u = (u & ~m) | (v * 0x01010101u & m);
+			memcpy(p + l, &u, 4);
+		}
+	}
+	else
+	{
+		for (size_t l = 0; l < lanes; ++l)
+		{
+			if (mask & (1 << l))
+			{
+				p[l] = v;
+			}
+		}
+	}
+}
+
+// Lanes of b entirely outside the plane p (the 7 frustum_planes components).
+template <typename P, typename B>
+inline int outside(B const& b, P const* p)
+{
+	P const d = simd::madd(b.cz, p[2], simd::madd(b.cy, p[1], simd::madd(b.cx, p[0], p[3])));
+	return simd::less_mask(d, b.negative_extent(p));
+}
+
+// Objects [begin, end), begin a multiple of the pack width; the streams are
+// read up to the padded size. A pack stops testing planes once every lane is
+// out. With last, the plane that rejected the pack's first object before is
+// tested first, and the plane that rejects an object now is stored for it.
+template <typename B, typename S0, typename S1>
+inline void cull(basic_frustum<float> const& f, S0 const& s0, S1 const& s1, unsigned char* visible, unsigned char* last, size_t begin, size_t end)
+{
+	typedef pack P;
+	size_t const w = simd::width;
+	size_t const planes = basic_frustum<float>::plane_count;
+	int const all = (1 << w) - 1;
+
+	frustum_planes const fp(f);
+	P p[planes][7];
+	for (size_t k = 0; k < planes; ++k)
+	{
+		for (size_t c = 0; c < 7; ++c)
+		{
+			p[k][c] = simd::splat<P>(fp.n[c][k]);
+		}
+	}
+
+	for (size_t i = begin; i < end; i += w)
+	{
+		B const b(s0, s1, i);
+		size_t const lanes = end - i < w ? end - i : w;
+		int out = all & ~((1 << lanes) - 1);
+
+		auto const test = [&](size_t k) {
+			int const o = outside(b, p[k]) & ~out;
+			if (last && o)
+			{
+				set_lanes(last + i, o, lanes, static_cast<unsigned char>(k));
+			}
+			out |= o;
+		};
+		size_t const first = last && last[i] < planes ? last[i] : planes;
+		if (first < planes)
+		{
+			test(first);
+		}
+		for (size_t k = 0; k < planes && out != all; ++k)
+		{
+			if (k != first)
+			{
+				test(k);
+			}
+		}
+
+		int const in = ~out & all;
+		if (w >= 4 && lanes == w)
+		{
+			for (size_t l = 0; l < w; l += 4)
+			{
+				memcpy(visible + i + l, lane_bytes[(in >> l) & 15], 4);
+			}
+		}
+		else
+		{
+			for (size_t l = 0; l < lanes; ++l)
+			{
+				visible[i + l] = (in >> l) & 1;
+			}
+		}
+	}
+}
+
+template <typename B, typename S0, typename S1>
+inline void cull(executor& ex, basic_frustum<float> const& f, S0 const& s0, S1 const& s1, unsigned char* visible, unsigned char* last, size_t n)
+{
+	size_t const bytes = 6 * sizeof(float) + (last ? 2 : 1);
+	parallel_for(ex, n, parallel_grain(bytes), [&](size_t begin, size_t end) {
+		cull<B>(f, s0, s1, visible, last, begin, end);
+	});
+}
+
+}
+
+// Batch culling of SoA bounds: visible[i] is set to 1 where intersects() is
+// true for object i and to 0 elsewhere (see mat4.hpp for the FMA caveat).
+//
+// The forms with last_plane exploit temporal coherence: last_plane[i] holds
+// the plane that rejected object i in the previous call (any value at first),
+// and each SIMD pack tests the plane of its first object before the others.
+// Where nearby objects are stored together and stay out of view, a pack is
+// usually rejected by that single plane test.
+
+inline void cull_spheres(frustum const& f, vec3_soa const& centers, scalar_soa const& radii, unsigned char* visible)
+{
+	detail::cull<detail::sphere_pack>(f, centers, radii, visible, 0, 0, centers.size());
+}
+
+inline void cull_spheres(frustum const& f, vec3_soa const& centers, scalar_soa const& radii, unsigned char* visible, unsigned char* last_plane)
+{
+	detail::cull<detail::sphere_pack>(f, centers, radii, visible, last_plane, 0, centers.size());
+}
+
+inline void cull_boxes(frustum const& f, vec3_soa const& mins, vec3_soa const& maxs, unsigned char* visible)
+{
+	detail::cull<detail::box_pack>(f, mins, maxs, visible, 0, 0, mins.size());
+}
+
+inline void cull_boxes(frustum const& f, vec3_soa const& mins, vec3_soa const& maxs, unsigned char* visible, unsigned char* last_plane)
+{
+	detail::cull<detail::box_pack>(f, mins, maxs, visible, last_plane, 0, mins.size());
+}
+
+// Executor forms (see executor.hpp); results are identical.
+
+inline void cull_spheres(executor& ex, frustum const& f, vec3_soa const& centers, scalar_soa const& radii, unsigned char* visible)
+{
+	detail::cull<detail::sphere_pack>(ex, f, centers, radii, visible, 0, centers.size());
+}
+
+inline void cull_spheres(executor& ex, frustum const& f, vec3_soa const& centers, scalar_soa const& radii, unsigned char* visible, unsigned char* last_plane)
+{
+	detail::cull<detail::sphere_pack>(ex, f, centers, radii, visible, last_plane, centers.size());
+}
+
+inline void cull_boxes(executor& ex, frustum const& f, vec3_soa const& mins, vec3_soa const& maxs, unsigned char* visible)
+{
+	detail::cull<detail::box_pack>(ex, f, mins, maxs, visible, 0, mins.size());
+}
+
+inline void cull_boxes(executor& ex, frustum const& f, vec3_soa const& mins, vec3_soa const& maxs, unsigned char* visible, unsigned char* last_plane)
+{
+	detail::cull<detail::box_pack>(ex, f, mins, maxs, visible, last_plane, mins.size());
+}
+
+}
+
+#endif
@@ -0,0 +1,387 @@
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "transform.hpp"
+#include "soa.hpp"
+#include "executor.hpp"
+#include "simd.hpp"
+
+namespace xxx
+{
+
+// Transform hierarchy flattened for batch updates. Nodes are kept sorted by
+// depth, so every level is a contiguous range whose parents all lie in earlier
+// levels: update() walks the levels once, composing whole SIMD packs of nodes
+// with their parents, and the executor form runs each level's nodes in
+// parallel. Local transforms are stored as SoA, world transforms and matrices
+// as arrays in the same order.
+//
+// Only nodes whose local transform changed since the last update(), and their
+// descendants, are recomputed. World values match local * world(parent) and
+// world(n).model_matrix() (see mat4.hpp for the FMA caveat).
+class hierarchy
+{
+public:
+	static size_t const none = ~size_t(0);
+
+	hierarchy() : count(0), sorted(true), changed(false) {}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+	void reserve(size_t n)
+	{
+		parent_ids.reserve(n);
+		slots.reserve(n);
+		if (n > positions.size())
+		{
+			grow(n);
+		}
+	}
+
+	void clear()
+	{
+		*this = hierarchy();
+	}
+
+	// Adds a node under parent, or a root if parent is none, and returns its
+	// index. Indices are assigned in order, so a parent always has a smaller
+	// index than its children.
+	size_t add(size_t parent, transform const& local = transform())
+	{
+		size_t const n = count++;
+		if (n == positions.size())
+		{
+			grow(n < 8 ? 16 : 2 * n);
+		}
+		parent_ids.push_back(static_cast<uint32_t>(parent == none ? n : parent));
+		slots.push_back(static_cast<uint32_t>(n));
+		parents.push_back(static_cast<uint32_t>(parent == none ? n : slots[parent]));
+		dirty.push_back(1);
+		worlds.push_back(local);
+		matrices.push_back(local.model_matrix());
+		store_local(n, local);
+		sorted = false;
+		changed = true;
+		return n;
+	}
+
+	size_t parent(size_t n) const
+	{
+		return parent_ids[n] == n ? none : parent_ids[n];
+	}
+
+	transform local(size_t n) const
+	{
+		size_t const i = slots[n];
+		return transform(positions.get(i), quaternion(rotations.x()[i], rotations.y()[i], rotations.z()[i], rotations.w()[i]));
+	}
+
+	void set_local(size_t n, transform const& t)
+	{
+		size_t const i = slots[n];
+		store_local(i, t);
+		dirty[i] = 1;
+		changed = true;
+	}
+
+	// Recomputes every node on the next update().
+	void invalidate()
+	{
+		dirty.assign(count, 1);
+		changed = count > 0;
+	}
+
+	// World transform and matrix as of the last update().
+	transform const& world(size_t n) const
+	{
+		return worlds[slots[n]];
+	}
+
+	mat4 const& world_matrix(size_t n) const
+	{
+		return matrices[slots[n]];
+	}
+
+	// The world arrays in update order; slot(n) is the position of node n.
+	transform const* world_transforms() const
+	{
+		return worlds.data();
+	}
+
+	mat4 const* world_matrices() const
+	{
+		return matrices.data();
+	}
+
+	size_t slot(size_t n) const
+	{
+		return slots[n];
+	}
+
+	void update()
+	{
+		if (prepare())
+		{
+			for (size_t l = 0; l + 1 < level_begin.size(); ++l)
+			{
+				update_range(l, level_begin[l], level_begin[l + 1]);
+			}
+			finish();
+		}
+	}
+
+	void update(executor& ex)
+	{
+		if (prepare())
+		{
+			size_t const grain = detail::parallel_grain(2 * sizeof(transform) + sizeof(mat4));
+			for (size_t l = 0; l + 1 < level_begin.size(); ++l)
+			{
+				size_t const begin = level_begin[l];
+				parallel_for(ex, level_begin[l + 1] - begin, grain, [&](size_t b, size_t e) {
+					update_range(l, begin + b, begin + e);
+				});
+			}
+			finish();
+		}
+	}
+
+private:
+	void grow(size_t n)
+	{
+		positions.resize(n);
+		rotations.resize(n);
+	}
+
+	void store_local(size_t i, transform const& t)
+	{
+		positions.set(i, t.position);
+		rotations.set(i, vec4(t.rotation.x, t.rotation.y, t.rotation.z, t.rotation.w));
+	}
+
+	// Sorts the nodes by depth after nodes were added, and tells whether
+	// anything needs updating.
+	bool prepare()
+	{
+		if (!changed)
+		{
+			return false;
+		}
+		if (!sorted)
+		{
+			sort();
+		}
+		return true;
+	}
+
+	void finish()
+	{
+		memset(dirty.data(), 0, dirty.size());
+		changed = false;
+	}
+
+	void sort()
+	{
+		std::vector<uint32_t> depth(count);
+		size_t levels = 0;
+		for (size_t n = 0; n < count; ++n)
+		{
+			depth[n] = parent_ids[n] == n ? 0 : depth[parent_ids[n]] + 1;
+			levels = depth[n] + 1 > levels ? depth[n] + 1 : levels;
+		}
+
+		level_begin.assign(levels + 1, 0);
+		for (size_t n = 0; n < count; ++n)
+		{
+			++level_begin[depth[n] + 1];
+		}
+		for (size_t l = 1; l <= levels; ++l)
+		{
+			level_begin[l] += level_begin[l - 1];
+		}
+
+		std::vector<size_t> next(level_begin.begin(), level_begin.end() - 1);
+		vec3_soa p(positions.size());
+		vec4_soa r(rotations.size());
+		for (size_t n = 0; n < count; ++n)
+		{
+			size_t const from = slots[n];
+			size_t const to = next[depth[n]]++;
+			for (size_t k = 0; k < 3; ++k)
+			{
+				p.stream(k)[to] = positions.stream(k)[from];
+			}
+			for (size_t k = 0; k < 4; ++k)
+			{
+				r.stream(k)[to] = rotations.stream(k)[from];
+			}
+			slots[n] = static_cast<uint32_t>(to);
+		}
+		positions.swap(p);
+		rotations.swap(r);
+
+		for (size_t n = 0; n < count; ++n)
+		{
+			parents[slots[n]] = slots[parent_ids[n]];
+		}
+		dirty.assign(count, 1);
+		sorted = true;
+	}
+
+	// Level 0 holds the roots, whose world transform is the local one.
+	void update_range(size_t level, size_t begin, size_t end)
+	{
+		size_t const w = simd::width;
+		size_t i = begin;
+		for (; i + w <= end; i += w)
+		{
+			unsigned char any = 0;
+			for (size_t k = 0; k < w; ++k)
+			{
+				dirty[i + k] |= dirty[parents[i + k]];
+				any |= dirty[i + k];
+			}
+			if (any)
+			{
+				compose<simd::floatn>(level, i);
+			}
+		}
+		for (; i < end; ++i)
+		{
+			dirty[i] |= dirty[parents[i]];
+			if (dirty[i])
+			{
+				compose<float>(level, i);
+			}
+		}
+	}
+
+	// World transforms and matrices of the nodes in slots [i, i + width of P).
+	// Parents are gathered lane by lane; the arithmetic follows rotate(),
+	// quaternion operator * and to_matrix().
+	template <typename P>
+	void compose(size_t level, size_t i)
+	{
+		size_t const w = sizeof(P) / sizeof(float);
+
+		P px = simd::load<P>(positions.x() + i);
+		P py = simd::load<P>(positions.y() + i);
+		P pz = simd::load<P>(positions.z() + i);
+		P qx = simd::load<P>(rotations.x() + i);
+		P qy = simd::load<P>(rotations.y() + i);
+		P qz = simd::load<P>(rotations.z() + i);
+		P qw = simd::load<P>(rotations.w() + i);
+
+		if (level > 0)
+		{
+			float g[7][8];
+			for (size_t k = 0; k < w; ++k)
+			{
+				transform const& t = worlds[parents[i + k]];
+				g[0][k] = t.position.x;
+				g[1][k] = t.position.y;
+				g[2][k] = t.position.z;
+				g[3][k] = t.rotation.x;
+				g[4][k] = t.rotation.y;
+				g[5][k] = t.rotation.z;
+				g[6][k] = t.rotation.w;
+			}
+			P const ax = simd::load<P>(g[3]);
+			P const ay = simd::load<P>(g[4]);
+			P const az = simd::load<P>(g[5]);
+			P const aw = simd::load<P>(g[6]);
+
+			// rotate(position, a) + parent position
+			P const two = simd::splat<P>(2);
+			P const tx = simd::mul(simd::sub(simd::mul(ay, pz), simd::mul(az, py)), two);
+			P const ty = simd::mul(simd::sub(simd::mul(az, px), simd::mul(ax, pz)), two);
+			P const tz = simd::mul(simd::sub(simd::mul(ax, py), simd::mul(ay, px)), two);
+			px = simd::add(simd::add(simd::madd(tx, aw, px), simd::sub(simd::mul(ay, tz), simd::mul(az, ty))), simd::load<P>(g[0]));
+			py = simd::add(simd::add(simd::madd(ty, aw, py), simd::sub(simd::mul(az, tx), simd::mul(ax, tz))), simd::load<P>(g[1]));
+			pz = simd::add(simd::add(simd::madd(tz, aw, pz), simd::sub(simd::mul(ax, ty), simd::mul(ay, tx))), simd::load<P>(g[2]));
+
+			// a * rotation
+			P const bx = qx;
+			P const by = qy;
+			P const bz = qz;
+			P const bw = qw;
+			qx = simd::sub(simd::madd(ay, bz, simd::madd(ax, bw, simd::mul(aw, bx))), simd::mul(az, by));
+			qy = simd::sub(simd::madd(az, bx, simd::madd(ay, bw, simd::mul(aw, by))), simd::mul(ax, bz));
+			qz = simd::sub(simd::madd(ax, by, simd::madd(az, bw, simd::mul(aw, bz))), simd::mul(ay, bx));
+			qw = simd::sub(simd::sub(simd::sub(simd::mul(aw, bw), simd::mul(ax, bx)), simd::mul(ay, by)), simd::mul(az, bz));
+		}
+
+		P const s = simd::div(simd::splat<P>(2), simd::sqrt(simd::madd(qw, qw, simd::madd(qz, qz, simd::madd(qy, qy, simd::mul(qx, qx))))));
+		P const x2 = simd::mul(qx, s);
+		P const y2 = simd::mul(qy, s);
+		P const z2 = simd::mul(qz, s);
+		P const xx = simd::mul(qx, x2);
+		P const xy = simd::mul(qx, y2);
+		P const xz = simd::mul(qx, z2);
+		P const yy = simd::mul(qy, y2);
+		P const yz = simd::mul(qy, z2);
+		P const zz = simd::mul(qz, z2);
+		P const wx = simd::mul(qw, x2);
+		P const wy = simd::mul(qw, y2);
+		P const wz = simd::mul(qw, z2);
+		P const one = simd::splat<P>(1);
+
+		float o[16][8];
+		simd::store(o[0], px);
+		simd::store(o[1], py);
+		simd::store(o[2], pz);
+		simd::store(o[3], qx);
+		simd::store(o[4], qy);
+		simd::store(o[5], qz);
+		simd::store(o[6], qw);
+		simd::store(o[7], simd::sub(one, simd::add(yy, zz)));
+		simd::store(o[8], simd::add(xy, wz));
+		simd::store(o[9], simd::sub(xz, wy));
+		simd::store(o[10], simd::sub(xy, wz));
+		simd::store(o[11], simd::sub(one, simd::add(xx, zz)));
+		simd::store(o[12], simd::add(yz, wx));
+		simd::store(o[13], simd::add(xz, wy));
+		simd::store(o[14], simd::sub(yz, wx));
+		simd::store(o[15], simd::sub(one, simd::add(xx, yy)));
+
+		for (size_t k = 0; k < w; ++k)
+		{
+			worlds[i + k] = transform(vec3(o[0][k], o[1][k], o[2][k]), quaternion(o[3][k], o[4][k], o[5][k], o[6][k]));
+			matrices[i + k] = mat4(
+				vec4(o[7][k], o[8][k], o[9][k], 0),
+				vec4(o[10][k], o[11][k], o[12][k], 0),
+				vec4(o[13][k], o[14][k], o[15][k], 0),
+				vec4(o[0][k], o[1][k], o[2][k], 1));
+		}
+	}
+
+	size_t count;
+	bool sorted;
+	bool changed;
+
+	// By node index.
+	std::vector<uint32_t> parent_ids;
+	std::vector<uint32_t> slots;
+
+	// By slot, in level order once sorted.
+	std::vector<size_t> level_begin;
+	std::vector<uint32_t> parents;
+	std::vector<unsigned char> dirty;
+	vec3_soa positions;
+	vec4_soa rotations;
+	std::vector<transform> worlds;
+	std::vector<mat4> matrices;
+};
+
+}
+
+#endif
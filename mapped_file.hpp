@@ -0,0 +1,146 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#if !defined(NOMINMAX)
+#define NOMINMAX
+#endif
+#if !defined(WIN32_LEAN_AND_MEAN)
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace xxx
+{
+
+// A whole file mapped read-only into memory, for reading streams (stream.hpp)
+// in place: pages are loaded as they are first touched, and the mapping
+// starts on a page boundary, so stream payloads keep their alignment. Uses
+// mmap, or a file mapping on Windows. Empty files cannot be mapped and do not
+// open.
+class mapped_file
+{
+public:
+	mapped_file() : base(0), length(0) {}
+
+	explicit mapped_file(char const* path) : base(0), length(0)
+	{
+		open(path);
+	}
+
+	mapped_file(mapped_file&& f) : base(f.base), length(f.length)
+	{
+		f.base = 0;
+		f.length = 0;
+	}
+
+	mapped_file& operator = (mapped_file&& f)
+	{
+		if (this != &f)
+		{
+			close();
+			base = f.base;
+			length = f.length;
+			f.base = 0;
+			f.length = 0;
+		}
+		return *this;
+	}
+
+	mapped_file(mapped_file const&) = delete;
+	mapped_file& operator = (mapped_file const&) = delete;
+
+	~mapped_file()
+	{
+		close();
+	}
+
+	// Maps path, unmapping what was mapped before; false where it cannot.
+	bool open(char const* path)
+	{
+		close();
+#if defined(_WIN32)
+		HANDLE const file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && static_cast<unsigned long long>(size.QuadPart) <= static_cast<size_t>(-1))
+		{
+			// The view keeps the mapping and the file open.
+			HANDLE const mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+			if (mapping)
+			{
+				base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				length = base ? static_cast<size_t>(size.QuadPart) : 0;
+				CloseHandle(mapping);
+			}
+		}
+		CloseHandle(file);
+#else
+		int const fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+		struct stat s;
+		if (fstat(fd, &s) == 0 && s.st_size > 0 && static_cast<unsigned long long>(s.st_size) <= static_cast<size_t>(-1))
+		{
+			void* const p = mmap(0, static_cast<size_t>(s.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED)
+			{
+				base = p;
+				length = static_cast<size_t>(s.st_size);
+			}
+		}
+		::close(fd);
+#endif
+		return base != 0;
+	}
+
+	void close()
+	{
+		if (base)
+		{
+#if defined(_WIN32)
+			UnmapViewOfFile(base);
+#else
+			munmap(base, length);
+#endif
+		}
+		base = 0;
+		length = 0;
+	}
+
+	bool is_open() const
+	{
+		return base != 0;
+	}
+
+	void const* data() const
+	{
+		return base;
+	}
+
+	size_t size() const
+	{
+		return length;
+	}
+
+private:
+	void* base;
+	size_t length;
+};
+
+}
+
+#endif
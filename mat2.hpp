@@ -1,73 +1,96 @@
 #ifndef MAT2_H
 #define MAT2_H
 
-#include "vec2.h"
+#include "vec2.hpp"
 
 namespace xxx
 {
 
-struct mat2
+template <typename T>
+struct basic_mat2
 {
-	vec2 x, y;
+	typedef T value_type;
 
-	mat2() {}
-	explicit mat2(vec2 const& x, vec2 const& y) : x(x), y(y) {}
+	basic_vec2<T> x, y;
 
-	scalar_t determinant() const
+	basic_mat2() = default;
+	explicit constexpr basic_mat2(basic_vec2<T> const& x, basic_vec2<T> const& y) : x(x), y(y) {}
+	template <typename U>
+	explicit constexpr basic_mat2(basic_mat2<U> const& m) : x(m.x), y(m.y) {}
+
+	constexpr T determinant() const
 	{
 		return x.x * y.y - x.y * y.x;
 	}
 
-	static mat2 identity()
+	static constexpr basic_mat2 identity()
 	{
-		return mat2(vec2(1, 0), vec2(0, 1));
+		return basic_mat2(basic_vec2<T>(1, 0), basic_vec2<T>(0, 1));
 	}
 
-	static mat2 from_angle(scalar_t angle)
+	static basic_mat2 from_angle(T angle)
 	{
-		float sa, ca;
+		T sa, ca;
 		sincos(angle, sa, ca);
-		return mat2(vec2(ca, sa), vec2(-sa, ca));
+		return basic_mat2(basic_vec2<T>(ca, sa), basic_vec2<T>(-sa, ca));
 	}
 };
 
-inline mat2 transpose(mat2 const& m)
+typedef basic_mat2<scalar_t> mat2;
+typedef basic_mat2<double> dmat2;
+
+template <typename T>
+inline constexpr basic_mat2<T> transpose(basic_mat2<T> const& m)
 {
-	return mat2(
-		vec2(m.x.x, m.y.x),
-		vec2(m.x.y, m.y.y));
+	return basic_mat2<T>(
+		basic_vec2<T>(m.x.x, m.y.x),
+		basic_vec2<T>(m.x.y, m.y.y));
 }
 
-inline mat2 inverse(mat2 const& m)
+// Returns false and sets r to identity if m is singular.
+template <typename T>
+inline constexpr bool inverse(basic_mat2<T> const& m, basic_mat2<T>& r)
 {
-	scalar_t const d = 1 / m.determinant();
+	T const d = m.determinant();
 	if (d != 0)
 	{
-		scalar_t const id = 1 / d;
-		return mat2(
-			vec2( m.y.y, -m.x.y) * id,
-			vec2(-m.y.x,  m.x.x) * id);
+		T const id = 1 / d;
+		r = basic_mat2<T>(
+			basic_vec2<T>( m.y.y, -m.x.y) * id,
+			basic_vec2<T>(-m.y.x,  m.x.x) * id);
+		return true;
 	}
 	else
 	{
-		return mat2::identity();
+		r = basic_mat2<T>::identity();
+		return false;
 	}
 }
 
-inline vec2 operator * (mat2 const& m, vec2 const& v)
+template <typename T>
+inline constexpr basic_mat2<T> inverse(basic_mat2<T> const& m)
+{
+	basic_mat2<T> r = basic_mat2<T>::identity();
+	inverse(m, r);
+	return r;
+}
+
+template <typename T>
+inline constexpr basic_vec2<T> operator * (basic_mat2<T> const& m, basic_vec2<T> const& v)
 {
-	return vec2(
+	return basic_vec2<T>(
 		v.x * m.x.x + v.y * m.y.x,
 		v.x * m.x.y + v.y * m.y.y);
 }
 
-inline mat2 operator * (mat2 const& a, mat2 const& b)
+template <typename T>
+inline constexpr basic_mat2<T> operator * (basic_mat2<T> const& a, basic_mat2<T> const& b)
 {
-	return mat2(
-		vec2(
+	return basic_mat2<T>(
+		basic_vec2<T>(
 			a.x.x * b.x.x + a.x.y * b.y.x,
 			a.x.x * b.x.y + a.x.y * b.y.y),
-		vec2(
+		basic_vec2<T>(
 			a.y.x * b.x.x + a.y.y * b.y.x,
 			a.y.x * b.x.y + a.y.y * b.y.y));
 }
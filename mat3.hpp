@@ -1,21 +1,26 @@
 #ifndef MAT3_H
 #define MAT3_H
 
-#include "vec3.h"
-#include "mat2.h"
+#include "vec3.hpp"
+#include "mat2.hpp"
 
 namespace xxx
 {
 
-struct mat3
+template <typename T>
+struct basic_mat3
 {
-	vec3 x, y, z;
+	typedef T value_type;
 
-	mat3() {}
-	explicit mat3(vec3 const& x, vec3 const& y, vec3 const& z) : x(x), y(y), z(z) {}
-	explicit mat3(mat2 const& m, vec3 const& z) : x(m.x, 0), y(m.y, 0), z(z) {}
+	basic_vec3<T> x, y, z;
 
-	scalar_t determinant() const
+	basic_mat3() = default;
+	explicit constexpr basic_mat3(basic_vec3<T> const& x, basic_vec3<T> const& y, basic_vec3<T> const& z) : x(x), y(y), z(z) {}
+	explicit constexpr basic_mat3(basic_mat2<T> const& m, basic_vec3<T> const& z) : x(m.x, 0), y(m.y, 0), z(z) {}
+	template <typename U>
+	explicit constexpr basic_mat3(basic_mat3<U> const& m) : x(m.x), y(m.y), z(m.z) {}
+
+	constexpr T determinant() const
 	{
 		return
 			x.x * (y.y * z.z - y.z * z.y) -
@@ -23,105 +28,123 @@ struct mat3
 			x.z * (y.x * z.y - y.y * z.x);
 	}
 
-	static mat3 identity()
+	static constexpr basic_mat3 identity()
 	{
-		return mat3(vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1));
+		return basic_mat3(basic_vec3<T>(1, 0, 0), basic_vec3<T>(0, 1, 0), basic_vec3<T>(0, 0, 1));
 	}
 
-	static mat3 from_axis_angle(vec3 const& axis, scalar_t angle)
+	static basic_mat3 from_axis_angle(basic_vec3<T> const& axis, T angle)
 	{
-		scalar_t const xy = axis.x * axis.y;
-		scalar_t const xz = axis.x * axis.z;
-		scalar_t const yz = axis.y * axis.z;
+		T const xy = axis.x * axis.y;
+		T const xz = axis.x * axis.z;
+		T const yz = axis.y * axis.z;
 
-		scalar_t s, c;
+		T s, c;
 		sincos(angle, s, c);
 		c = 1 - c;
 
-		return mat3(
-			vec3(
+		return basic_mat3(
+			basic_vec3<T>(
 				1 + c * (axis.x * axis.x - 1),
 				-axis.z * s + c * xy,
 				axis.y * s + c * xz),
-			vec3(
+			basic_vec3<T>(
 				axis.z * s + c * xy,
 				1 + c * (axis.y * axis.y - 1),
 				-axis.x * s + c * yz),
-			vec3(
+			basic_vec3<T>(
 				-axis.y * s + c * xz,
 				axis.x * s + c * yz,
 				1 + c * (axis.z * axis.z - 1)));
 	}
 
-	static mat3 from_euler_angles(scalar_t x, scalar_t y, scalar_t z)
+	static basic_mat3 from_euler_angles(T x, T y, T z)
 	{
-		scalar_t cx, sx, cy, sy, cz, sz;
+		T cx, sx, cy, sy, cz, sz;
 		sincos(x, sx, cx);
 		sincos(y, sy, cy);
 		sincos(z, sz, cz);
-		return mat3(
-			vec3(cy * cz, sy * sx - cy * sz * cx, cy * sz * sx + sy * cx),
-			vec3(sz, cz * cx, -cz * sx),
-			vec3(-sy * cz, sy * sz * cx + cy * sx, cy * cx - sy * sz * sx));
+		return basic_mat3(
+			basic_vec3<T>(cy * cz, sy * sx - cy * sz * cx, cy * sz * sx + sy * cx),
+			basic_vec3<T>(sz, cz * cx, -cz * sx),
+			basic_vec3<T>(-sy * cz, sy * sz * cx + cy * sx, cy * cx - sy * sz * sx));
 	}
 };
 
-inline mat3 transpose(mat3 const& m)
+typedef basic_mat3<scalar_t> mat3;
+typedef basic_mat3<double> dmat3;
+
+template <typename T>
+inline constexpr basic_mat3<T> transpose(basic_mat3<T> const& m)
 {
-	return mat3(
-		vec3(m.x.x, m.y.x, m.z.x),
-		vec3(m.x.y, m.y.y, m.z.y),
-		vec3(m.x.z, m.y.z, m.z.z));
+	return basic_mat3<T>(
+		basic_vec3<T>(m.x.x, m.y.x, m.z.x),
+		basic_vec3<T>(m.x.y, m.y.y, m.z.y),
+		basic_vec3<T>(m.x.z, m.y.z, m.z.z));
 }
 
-inline mat3 inverse(mat3 const& m)
+// Returns false and sets r to identity if m is singular.
+template <typename T>
+inline constexpr bool inverse(basic_mat3<T> const& m, basic_mat3<T>& r)
 {
-	scalar_t const d = 1 / m.determinant();
+	T const d = m.determinant();
 	if (d != 0)
 	{
-		scalar_t const id = 1 / d;
-		return mat3(
-			vec3(
+		T const id = 1 / d;
+		r = basic_mat3<T>(
+			basic_vec3<T>(
 				 id * (m.y.y * m.z.z - m.y.z * m.z.y),
 				-id * (m.x.y * m.z.z - m.x.z * m.z.y),
 				 id * (m.x.y * m.y.z - m.x.z * m.y.y)),
 
-			 vec3(
+			 basic_vec3<T>(
 				-id * (m.y.x * m.z.z - m.y.z * m.z.x),
 				 id * (m.x.x * m.z.z - m.x.z * m.z.x),
 				-id * (m.x.x * m.y.z - m.x.z * m.y.x)),
 
-			vec3(
+			basic_vec3<T>(
 				 id * (m.y.x * m.z.y - m.y.y * m.z.x),
 				-id * (m.x.x * m.z.y - m.x.y * m.z.x),
 				 id * (m.x.x * m.y.y - m.x.y * m.y.x)));
+		return true;
 	}
 	else
 	{
-		return mat3::identity();
+		r = basic_mat3<T>::identity();
+		return false;
 	}
 }
 
-inline vec3 operator * (mat3 const& m, vec3 const& v)
+template <typename T>
+inline constexpr basic_mat3<T> inverse(basic_mat3<T> const& m)
+{
+	basic_mat3<T> r = basic_mat3<T>::identity();
+	inverse(m, r);
+	return r;
+}
+
+template <typename T>
+inline constexpr basic_vec3<T> operator * (basic_mat3<T> const& m, basic_vec3<T> const& v)
 {
-	return vec3(
+	return basic_vec3<T>(
 		v.x * m.x.x + v.y * m.y.x + v.z * m.z.x,
 		v.x * m.x.y + v.y * m.y.y + v.z * m.z.y,
 		v.x * m.x.z + v.y * m.y.z + v.z * m.z.z);
 }
 
-inline mat3 operator * (mat3 const& a, mat3 const& b)
+template <typename T>
+inline constexpr basic_mat3<T> operator * (basic_mat3<T> const& a, basic_mat3<T> const& b)
 {
-	return mat3(
-		vec3(
+	return basic_mat3<T>(
+		basic_vec3<T>(
 		a.x.x * b.x.x + a.x.y * b.y.x + a.x.z * b.z.x,
 		a.x.x * b.x.y + a.x.y * b.y.y + a.x.z * b.z.y,
 		a.x.x * b.x.z + a.x.y * b.y.z + a.x.z * b.z.z),
-		vec3(
+		basic_vec3<T>(
 		a.y.x * b.x.x + a.y.y * b.y.x + a.y.z * b.z.x,
 		a.y.x * b.x.y + a.y.y * b.y.y + a.y.z * b.z.y,
 		a.y.x * b.x.z + a.y.y * b.y.z + a.y.z * b.z.z),
-		vec3(
+		basic_vec3<T>(
 		a.z.x * b.x.x + a.z.y * b.y.x + a.z.z * b.z.x,
 		a.z.x * b.x.y + a.z.y * b.y.y + a.z.z * b.z.y,
 		a.z.x * b.x.z + a.z.y * b.y.z + a.z.z * b.z.z));
@@ -1,93 +1,100 @@
 #ifndef MAT4_H
 #define MAT4_H
 
-#include "vec4.h"
-#include "mat3.h"
+#include "vec4.hpp"
+#include "mat3.hpp"
+#include "simd.hpp"
 
 namespace xxx
 {
 
-struct mat4;
-
-mat4 operator * (mat4 const& a, mat4 const& b);
-
-struct mat4
+template <typename T>
+struct basic_mat4
 {
-	vec4 x, y, z, w;
+	typedef T value_type;
+
+	basic_vec4<T> x, y, z, w;
 
-	mat4() {}
-	explicit mat4(vec4 const& x, vec4 const& y, vec4 const& z, vec4 const& w) : x(x), y(y), z(z), w(w) {}
-	explicit mat4(mat3 const& m, vec4 const& w) : x(m.x, 0), y(m.y, 0), z(m.z, 0), w(w) {}
+	basic_mat4() = default;
+	explicit constexpr basic_mat4(basic_vec4<T> const& x, basic_vec4<T> const& y, basic_vec4<T> const& z, basic_vec4<T> const& w) : x(x), y(y), z(z), w(w) {}
+	explicit constexpr basic_mat4(basic_mat3<T> const& m, basic_vec4<T> const& w) : x(m.x, 0), y(m.y, 0), z(m.z, 0), w(w) {}
+	template <typename U>
+	explicit constexpr basic_mat4(basic_mat4<U> const& m) : x(m.x), y(m.y), z(m.z), w(m.w) {}
 
-	mat3 to_mat3() const
+	constexpr basic_mat3<T> to_mat3() const
 	{
-		return mat3(x.to_vec3(), y.to_vec3(), z.to_vec3());
+		return basic_mat3<T>(x.to_vec3(), y.to_vec3(), z.to_vec3());
 	}
 
-	static mat4 identity()
+	static constexpr basic_mat4 identity()
 	{
-		return mat4(vec4(1, 0, 0, 0), vec4(0, 1, 0, 0), vec4(0, 0, 1, 0), vec4(0, 0, 0, 1));
+		return basic_mat4(basic_vec4<T>(1, 0, 0, 0), basic_vec4<T>(0, 1, 0, 0), basic_vec4<T>(0, 0, 1, 0), basic_vec4<T>(0, 0, 0, 1));
 	}
 
-	static mat4 frustum(float left, float right, float bottom, float top, float znear, float zfar)
+	static constexpr basic_mat4 frustum(T left, T right, T bottom, T top, T znear, T zfar)
 	{
-		scalar_t const a = 2 * znear;
-		scalar_t const b = right - left;
-		scalar_t const c = top - bottom;
-		scalar_t const d = zfar - znear;
-		return mat4(
-			vec4(a / b, 0, 0, 0),
-			vec4(0, a / c, 0, 0),
-			vec4((right + left) / b, (top + bottom) / c, (-zfar - znear) / d, -1),
-			vec4(0, 0, (-a * zfar) / d, 0));
+		T const a = 2 * znear;
+		T const b = right - left;
+		T const c = top - bottom;
+		T const d = zfar - znear;
+		return basic_mat4(
+			basic_vec4<T>(a / b, 0, 0, 0),
+			basic_vec4<T>(0, a / c, 0, 0),
+			basic_vec4<T>((right + left) / b, (top + bottom) / c, (-zfar - znear) / d, -1),
+			basic_vec4<T>(0, 0, (-a * zfar) / d, 0));
 	}
 
-	static mat4 ortho(scalar_t width, scalar_t height, scalar_t znear, scalar_t zfar)
+	static constexpr basic_mat4 ortho(T width, T height, T znear, T zfar)
 	{
-		return mat4(
-			vec4(2 / width, 0, 0, -1),
-			vec4(0, 2 / height, 0, -1),
-			vec4(0, 0, -2 / (zfar - znear), -(zfar + znear) / (zfar - znear)),
-			vec4(0, 0, 0, -1));
+		return basic_mat4(
+			basic_vec4<T>(2 / width, 0, 0, -1),
+			basic_vec4<T>(0, 2 / height, 0, -1),
+			basic_vec4<T>(0, 0, -2 / (zfar - znear), -(zfar + znear) / (zfar - znear)),
+			basic_vec4<T>(0, 0, 0, -1));
 	}
 
-	static mat4 perspective(scalar_t width, scalar_t height, scalar_t fov_radians, scalar_t znear, scalar_t zfar)
+	static basic_mat4 perspective(T width, T height, T fov_radians, T znear, T zfar)
 	{
-		scalar_t const ymax = znear * tan(fov_radians / 2);
-		scalar_t const xmax = ymax * (width / height);
+		T const ymax = znear * tan(fov_radians / 2);
+		T const xmax = ymax * (width / height);
 		return frustum(-xmax, xmax, -ymax, ymax, znear, zfar);
 	}
 
-	static mat4 look_at(vec3 const& eye, vec3 const& target, vec3 const& up)
+	static basic_mat4 look_at(basic_vec3<T> const& eye, basic_vec3<T> const& target, basic_vec3<T> const& up)
 	{
 		// TODO: clean up
-		vec3 const z = normalize(eye - target);
-		vec3 const x = normalize(cross(up, z));
-		vec3 const y = normalize(cross(z, x));
+		basic_vec3<T> const z = normalize(eye - target);
+		basic_vec3<T> const x = normalize(cross(up, z));
+		basic_vec3<T> const y = normalize(cross(z, x));
 
-		mat4 r = mat4(vec4(x.x, y.x, z.x, 0), vec4(x.y, y.y, z.y, 0), vec4(x.z, y.z, z.z, 0), vec4(0,0,0,1));
-		mat4 t = mat4(vec4(1,0,0,0), vec4(0,1,0,0), vec4(0,0,1,0), vec4(eye * -1,1));
+		basic_mat4 r = basic_mat4(basic_vec4<T>(x.x, y.x, z.x, 0), basic_vec4<T>(x.y, y.y, z.y, 0), basic_vec4<T>(x.z, y.z, z.z, 0), basic_vec4<T>(0,0,0,1));
+		basic_mat4 t = basic_mat4(basic_vec4<T>(1,0,0,0), basic_vec4<T>(0,1,0,0), basic_vec4<T>(0,0,1,0), basic_vec4<T>(eye * -1,1));
 
 		return t * r;
 	}
 };
 
-inline mat4 transpose(mat4 const& m)
+typedef basic_mat4<scalar_t> mat4;
+typedef basic_mat4<double> dmat4;
+
+template <typename T>
+inline constexpr basic_mat4<T> transpose(basic_mat4<T> const& m)
 {
-	return mat4(
-		vec4(m.x.x, m.y.x, m.z.x, m.w.x),
-		vec4(m.x.y, m.y.y, m.z.y, m.w.y),
-		vec4(m.x.z, m.y.z, m.z.z, m.w.z),
-		vec4(m.x.w, m.y.w, m.z.w, m.w.w));
+	return basic_mat4<T>(
+		basic_vec4<T>(m.x.x, m.y.x, m.z.x, m.w.x),
+		basic_vec4<T>(m.x.y, m.y.y, m.z.y, m.w.y),
+		basic_vec4<T>(m.x.z, m.y.z, m.z.z, m.w.z),
+		basic_vec4<T>(m.x.w, m.y.w, m.z.w, m.w.w));
 }
 
-inline mat4 inverse(mat4 const& m)
+// Returns false and sets r to identity if m is singular.
+template <typename T>
+inline constexpr bool inverse(basic_mat4<T> const& m, basic_mat4<T>& r)
 {
-	mat4 r;
-	mat4 t = transpose(m);
+	basic_mat4<T> t = transpose(m);
 
 	{
-		scalar_t k[12] =
+		T k[12] =
 		{
 			t.z.z * t.w.w,
 			t.z.w * t.w.z,
@@ -114,7 +121,7 @@ inline mat4 inverse(mat4 const& m)
 		r.y.w = (k[4] * t.x.x + k[9] * t.x.y + k[10] * t.x.z) - (k[5] * t.x.x + k[8] * t.x.y + k[11] * t.x.z);
 	}
 	{
-		scalar_t k[12] =
+		T k[12] =
 		{
 			t.x.z * t.y.w,
 			t.x.w * t.y.z,
@@ -141,56 +148,267 @@ inline mat4 inverse(mat4 const& m)
 		r.w.w = (k[10] * t.z.z + k[4]  * t.z.x + k[9] * t.z.y)  - (k[8]  * t.z.y + k[11] * t.z.z + k[5]  * t.z.x);
 	}
 
-	scalar_t const d = t.x.x * r.x.x + t.x.y * r.x.y + t.x.z * r.x.z + t.x.w * r.x.w;
+	T const d = t.x.x * r.x.x + t.x.y * r.x.y + t.x.z * r.x.z + t.x.w * r.x.w;
 	if (d != 0)
 	{
-		scalar_t const id = 1 / d;
-		t.x *= id;
-		t.y *= id;
-		t.z *= id;
-		t.w *= id;
-		return r;
+		T const id = 1 / d;
+		r.x *= id;
+		r.y *= id;
+		r.z *= id;
+		r.w *= id;
+		return true;
+	}
+	else
+	{
+		r = basic_mat4<T>::identity();
+		return false;
+	}
+}
+
+template <typename T>
+inline constexpr basic_mat4<T> inverse(basic_mat4<T> const& m)
+{
+	basic_mat4<T> r = basic_mat4<T>::identity();
+	inverse(m, r);
+	return r;
+}
+
+// Inverse of an affine matrix, i.e. one whose last row is (0, 0, 0, 1): only
+// the 3x3 part is inverted and the translation is transformed by the result.
+// Returns false and sets r to identity if the 3x3 part is singular.
+template <typename T>
+inline constexpr bool inverse_affine(basic_mat4<T> const& m, basic_mat4<T>& r)
+{
+	basic_mat3<T> a = basic_mat3<T>::identity();
+	if (inverse(m.to_mat3(), a))
+	{
+		r = basic_mat4<T>(a, basic_vec4<T>(inverse(a * m.w.to_vec3()), 1));
+		return true;
 	}
 	else
 	{
-		return mat4::identity();
+		r = basic_mat4<T>::identity();
+		return false;
 	}
 }
 
-inline vec4 operator * (mat4 const& m, vec4 const& v)
+template <typename T>
+inline constexpr basic_mat4<T> inverse_affine(basic_mat4<T> const& m)
 {
-	return vec4(
+	basic_mat4<T> r = basic_mat4<T>::identity();
+	inverse_affine(m, r);
+	return r;
+}
+
+// Inverse of a rotation followed by a translation: the 3x3 part is transposed
+// and the negated translation rotated by it. m must not contain scale or shear.
+template <typename T>
+inline constexpr basic_mat4<T> inverse_rigid(basic_mat4<T> const& m)
+{
+	basic_mat3<T> const a = transpose(m.to_mat3());
+	return basic_mat4<T>(a, basic_vec4<T>(inverse(a * m.w.to_vec3()), 1));
+}
+
+template <typename T>
+inline constexpr basic_vec4<T> operator * (basic_mat4<T> const& m, basic_vec4<T> const& v)
+{
+	return basic_vec4<T>(
 		v.x * m.x.x + v.y * m.y.x + v.z * m.z.x + v.w * m.w.x,
 		v.x * m.x.y + v.y * m.y.y + v.z * m.z.y + v.w * m.w.y,
 		v.x * m.x.z + v.y * m.y.z + v.z * m.z.z + v.w * m.w.z,
 		v.x * m.x.w + v.y * m.y.w + v.z * m.z.w + v.w * m.w.w);
 }
 
-inline mat4 operator * (mat4 const& a, mat4 const& b)
+template <typename T>
+inline constexpr basic_mat4<T> operator * (basic_mat4<T> const& a, basic_mat4<T> const& b)
 {
-	return mat4(
-		vec4(
+	return basic_mat4<T>(
+		basic_vec4<T>(
 			a.x.x * b.x.x + a.x.y * b.y.x + a.x.z * b.z.x + a.x.w * b.w.x,
 			a.x.x * b.x.y + a.x.y * b.y.y + a.x.z * b.z.y + a.x.w * b.w.y,
 			a.x.x * b.x.z + a.x.y * b.y.z + a.x.z * b.z.z + a.x.w * b.w.z,
 			a.x.x * b.x.w + a.x.y * b.y.w + a.x.z * b.z.w + a.x.w * b.w.w),
-		vec4(
+		basic_vec4<T>(
 			a.y.x * b.x.x + a.y.y * b.y.x + a.y.z * b.z.x + a.y.w * b.w.x,
 			a.y.x * b.x.y + a.y.y * b.y.y + a.y.z * b.z.y + a.y.w * b.w.y,
 			a.y.x * b.x.z + a.y.y * b.y.z + a.y.z * b.z.z + a.y.w * b.w.z,
 			a.y.x * b.x.w + a.y.y * b.y.w + a.y.z * b.z.w + a.y.w * b.w.w),
-		vec4(
+		basic_vec4<T>(
 			a.z.x * b.x.x + a.z.y * b.y.x + a.z.z * b.z.x + a.z.w * b.w.x,
 			a.z.x * b.x.y + a.z.y * b.y.y + a.z.z * b.z.y + a.z.w * b.w.y,
 			a.z.x * b.x.z + a.z.y * b.y.z + a.z.z * b.z.z + a.z.w * b.w.z,
 			a.z.x * b.x.w + a.z.y * b.y.w + a.z.z * b.z.w + a.z.w * b.w.w),
-		vec4(
+		basic_vec4<T>(
 			a.w.x * b.x.x + a.w.y * b.y.x + a.w.z * b.z.x + a.w.w * b.w.x,
 			a.w.x * b.x.y + a.w.y * b.y.y + a.w.z * b.z.y + a.w.w * b.w.y,
 			a.w.x * b.x.z + a.w.y * b.y.z + a.w.z * b.z.z + a.w.w * b.w.z,
 			a.w.x * b.x.w + a.w.y * b.y.w + a.w.z * b.z.w + a.w.w * b.w.w));
 }
 
+#if defined(XXX_SSE)
+
+// Single-precision overloads. They evaluate each element in the same order as
+// the generic code and are bit-identical to it unless XXX_FMA is enabled; with
+// FMA every element may differ by at most 2^-21 times the sum of the magnitudes
+// of its four products. The inverse uses blockwise inversion instead of the
+// cofactor expansion, so it is not bit-identical to the generic version, but
+// its error is of the same size. During constant evaluation they defer to the generic
+// code where XXX_CONSTANT_EVALUATED is available (see simd.hpp).
+
+namespace detail
+{
+
+inline basic_vec4<float> mul_sse(basic_mat4<float> const& m, basic_vec4<float> const& v)
+{
+	simd::float4 const c = simd::load(&v.x);
+	simd::float4 r = simd::mul(simd::splat<0>(c), simd::load(&m.x.x));
+	r = simd::madd(simd::splat<1>(c), simd::load(&m.y.x), r);
+	r = simd::madd(simd::splat<2>(c), simd::load(&m.z.x), r);
+	r = simd::madd(simd::splat<3>(c), simd::load(&m.w.x), r);
+	basic_vec4<float> o;
+	simd::store(&o.x, r);
+	return o;
+}
+
+inline basic_mat4<float> mul_sse(basic_mat4<float> const& a, basic_mat4<float> const& b)
+{
+	simd::float4 const bx = simd::load(&b.x.x);
+	simd::float4 const by = simd::load(&b.y.x);
+	simd::float4 const bz = simd::load(&b.z.x);
+	simd::float4 const bw = simd::load(&b.w.x);
+	basic_mat4<float> o;
+	basic_vec4<float> const* ac = &a.x;
+	basic_vec4<float>* oc = &o.x;
+	for (int i = 0; i < 4; ++i)
+	{
+		simd::float4 const c = simd::load(&ac[i].x);
+		simd::float4 r = simd::mul(simd::splat<0>(c), bx);
+		r = simd::madd(simd::splat<1>(c), by, r);
+		r = simd::madd(simd::splat<2>(c), bz, r);
+		r = simd::madd(simd::splat<3>(c), bw, r);
+		simd::store(&oc[i].x, r);
+	}
+	return o;
+}
+
+// 2x2 blocks of a 4x4 matrix held as (m00, m01, m10, m11).
+
+inline simd::float4 mat2_mul(simd::float4 a, simd::float4 b)
+{
+	return _mm_add_ps(
+		_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+		_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+// adjugate(a) * b
+inline simd::float4 mat2_adj_mul(simd::float4 a, simd::float4 b)
+{
+	return _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+		_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+
+// a * adjugate(b)
+inline simd::float4 mat2_mul_adj(simd::float4 a, simd::float4 b)
+{
+	return _mm_sub_ps(
+		_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+		_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+// Blockwise inversion of [A B; C D] with 2x2 adjugates. It rounds differently
+// from the cofactor expansion of the generic inverse.
+inline bool inverse_sse(basic_mat4<float> const& m, basic_mat4<float>& r)
+{
+	simd::float4 const c0 = simd::load(&m.x.x);
+	simd::float4 const c1 = simd::load(&m.y.x);
+	simd::float4 const c2 = simd::load(&m.z.x);
+	simd::float4 const c3 = simd::load(&m.w.x);
+
+	simd::float4 const a = _mm_movelh_ps(c0, c1);
+	simd::float4 const b = _mm_movehl_ps(c1, c0);
+	simd::float4 const c = _mm_movelh_ps(c2, c3);
+	simd::float4 const d = _mm_movehl_ps(c3, c2);
+
+	// (|A|, |B|, |C|, |D|)
+	simd::float4 const dets = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+		_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0))));
+	simd::float4 const det_a = simd::splat<0>(dets);
+	simd::float4 const det_b = simd::splat<1>(dets);
+	simd::float4 const det_c = simd::splat<2>(dets);
+	simd::float4 const det_d = simd::splat<3>(dets);
+
+	simd::float4 const dc = mat2_adj_mul(d, c);
+	simd::float4 const ab = mat2_adj_mul(a, b);
+
+	simd::float4 x = _mm_sub_ps(_mm_mul_ps(det_d, a), mat2_mul(b, dc));
+	simd::float4 w = _mm_sub_ps(_mm_mul_ps(det_a, d), mat2_mul(c, ab));
+	simd::float4 y = _mm_sub_ps(_mm_mul_ps(det_b, c), mat2_mul_adj(d, ab));
+	simd::float4 z = _mm_sub_ps(_mm_mul_ps(det_c, b), mat2_mul_adj(a, dc));
+
+	// |M| = |A| |D| + |B| |C| - tr((A# B)(D# C))
+	simd::float4 tr = _mm_mul_ps(ab, _mm_shuffle_ps(dc, dc, _MM_SHUFFLE(3, 1, 2, 0)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(2, 3, 0, 1)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 0, 3, 2)));
+	simd::float4 const det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c)), tr);
+
+	if (_mm_cvtss_f32(det) == 0)
+	{
+		r = basic_mat4<float>::identity();
+		return false;
+	}
+
+	simd::float4 const id = _mm_div_ps(_mm_setr_ps(1, -1, -1, 1), det);
+	x = _mm_mul_ps(x, id);
+	y = _mm_mul_ps(y, id);
+	z = _mm_mul_ps(z, id);
+	w = _mm_mul_ps(w, id);
+
+	simd::store(&r.x.x, _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+	simd::store(&r.y.x, _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+	simd::store(&r.z.x, _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+	simd::store(&r.w.x, _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+	return true;
+}
+
+}
+
+inline XXX_SIMD_CONSTEXPR basic_vec4<float> operator * (basic_mat4<float> const& m, basic_vec4<float> const& v)
+{
+#if defined(XXX_CONSTANT_EVALUATED)
+	if (XXX_CONSTANT_EVALUATED())
+	{
+		return operator * <float>(m, v);
+	}
+#endif
+	return detail::mul_sse(m, v);
+}
+
+inline XXX_SIMD_CONSTEXPR basic_mat4<float> operator * (basic_mat4<float> const& a, basic_mat4<float> const& b)
+{
+#if defined(XXX_CONSTANT_EVALUATED)
+	if (XXX_CONSTANT_EVALUATED())
+	{
+		return operator * <float>(a, b);
+	}
+#endif
+	return detail::mul_sse(a, b);
+}
+
+inline XXX_SIMD_CONSTEXPR bool inverse(basic_mat4<float> const& m, basic_mat4<float>& r)
+{
+#if defined(XXX_CONSTANT_EVALUATED)
+	if (XXX_CONSTANT_EVALUATED())
+	{
+		return inverse<float>(m, r);
+	}
+#endif
+	return detail::inverse_sse(m, r);
+}
+
+#endif
+
 }
 
 #endif
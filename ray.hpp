@@ -0,0 +1,418 @@
+#ifndef RAY_H
+#define RAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vec3.hpp"
+#include "vec4.hpp"
+#include "aabb3.hpp"
+#include "sphere3.hpp"
+#include "simd.hpp"
+
+namespace xxx
+{
+
+// The half-line origin + direction * t, t >= 0. direction need not be unit
+// length; distances along the ray are in multiples of it.
+template <typename T>
+struct basic_ray3
+{
+	typedef T value_type;
+
+	basic_vec3<T> origin, direction;
+
+	basic_ray3() = default;
+	explicit constexpr basic_ray3(basic_vec3<T> const& origin, basic_vec3<T> const& direction) : origin(origin), direction(direction) {}
+	template <typename U>
+	explicit constexpr basic_ray3(basic_ray3<U> const& r) : origin(r.origin), direction(r.direction) {}
+
+	constexpr basic_vec3<T> at(T t) const
+	{
+		return origin + direction * t;
+	}
+};
+
+typedef basic_ray3<scalar_t> ray3;
+typedef basic_ray3<double> dray3;
+
+// Ray casts. Each test is true where r hits the primitive at a distance in
+// [0, t), and then sets t to the nearest such distance; on a miss t is left
+// alone. Starting from t = infinity and testing every primitive in turn leaves
+// the closest hit in t, and a finite t limits the ray to a segment.
+//
+// Triangles are hit from both sides, by Moller and Trumbore's method ("Fast,
+// Minimum Storage Ray/Triangle Intersection"); u and v are the barycentric
+// weights of b and c at the hit. Rays in the plane of a triangle miss it.
+// Boxes are tested by slabs and report the entry distance, 0 for an origin
+// inside. Spheres report the nearer of their two hits that is not behind the
+// origin. Planes are (normal, d) as in frustum.hpp and are hit from both
+// sides. Degenerate cases (NaN along the way) are misses.
+
+namespace detail
+{
+
+template <typename T>
+inline bool slab(basic_vec3<T> const& origin, basic_vec3<T> const& inverse, basic_vec3<T> const& lo, basic_vec3<T> const& hi, T& t)
+{
+	basic_vec3<T> const t0 = (lo - origin) * inverse;
+	basic_vec3<T> const t1 = (hi - origin) * inverse;
+	T const enter = max(max(max(min(t0.x, t1.x), min(t0.y, t1.y)), min(t0.z, t1.z)), T(0));
+	T const leave = min(min(max(t0.x, t1.x), max(t0.y, t1.y)), max(t0.z, t1.z));
+	if (enter <= leave && enter < t)
+	{
+		t = enter;
+		return true;
+	}
+	return false;
+}
+
+}
+
+template <typename T>
+inline bool intersects(basic_ray3<T> const& r, basic_vec3<T> const& a, basic_vec3<T> const& b, basic_vec3<T> const& c, T& t, T& u, T& v)
+{
+	basic_vec3<T> const e1 = b - a;
+	basic_vec3<T> const e2 = c - a;
+	basic_vec3<T> const p = cross(r.direction, e2);
+	T const inv = 1 / dot(e1, p);
+	basic_vec3<T> const s = r.origin - a;
+	basic_vec3<T> const q = cross(s, e1);
+	T const hu = dot(s, p) * inv;
+	T const hv = dot(r.direction, q) * inv;
+	T const ht = dot(e2, q) * inv;
+	if (0 <= hu && 0 <= hv && hu + hv <= 1 && 0 <= ht && ht < t)
+	{
+		t = ht;
+		u = hu;
+		v = hv;
+		return true;
+	}
+	return false;
+}
+
+template <typename T>
+inline bool intersects(basic_ray3<T> const& r, basic_vec3<T> const& a, basic_vec3<T> const& b, basic_vec3<T> const& c, T& t)
+{
+	T u, v;
+	return intersects(r, a, b, c, t, u, v);
+}
+
+template <typename T>
+inline bool intersects(basic_ray3<T> const& r, basic_aabb3<T> const& b, T& t)
+{
+	basic_vec3<T> const inverse(1 / r.direction.x, 1 / r.direction.y, 1 / r.direction.z);
+	return !b.is_empty() && detail::slab(r.origin, inverse, b.min, b.max, t);
+}
+
+template <typename T>
+inline bool intersects(basic_ray3<T> const& r, basic_sphere3<T> const& s, T& t)
+{
+	if (s.is_empty())
+	{
+		return false;
+	}
+	basic_vec3<T> const o = r.origin - s.center;
+	T const a = dot(r.direction, r.direction);
+	T const b = dot(o, r.direction);
+	T const c = dot(o, o) - s.radius * s.radius;
+	T const d = sqrt(b * b - a * c);
+	T const t0 = -(b + d) / a;
+	T const t1 = (d - b) / a;
+	if (0 <= t0 && t0 < t)
+	{
+		t = t0;
+		return true;
+	}
+	if (t0 < 0 && 0 <= t1 && t1 < t)
+	{
+		t = t1;
+		return true;
+	}
+	return false;
+}
+
+template <typename T>
+inline bool intersects(basic_ray3<T> const& r, basic_vec4<T> const& plane, T& t)
+{
+	basic_vec3<T> const& o = r.origin;
+	T const height = o.z * plane.z + (o.y * plane.y + (o.x * plane.x + plane.w));
+	T const ht = height / -dot(plane.to_vec3(), r.direction);
+	if (0 <= ht && ht < t)
+	{
+		t = ht;
+		return true;
+	}
+	return false;
+}
+
+// N rays (at most 32) in SoA form, traced together against one primitive at a
+// time with a SIMD lane per ray, which pays off where the rays are coherent:
+// camera or shadow rays through neighbouring pixels, lightmap texels. Set rays
+// through set() or the constructor, which also keep the reciprocal directions
+// the box test uses.
+template <size_t N>
+struct ray_packet
+{
+	static_assert(N > 0 && N <= 32, "hit masks have a bit per ray in 32 bits");
+
+	float ox[N], oy[N], oz[N];
+	float dx[N], dy[N], dz[N];
+	float ix[N], iy[N], iz[N];
+
+	ray_packet() = default;
+
+	explicit ray_packet(ray3 const* rays)
+	{
+		for (size_t i = 0; i < N; ++i)
+		{
+			set(i, rays[i]);
+		}
+	}
+
+	void set(size_t i, ray3 const& r)
+	{
+		ox[i] = r.origin.x;
+		oy[i] = r.origin.y;
+		oz[i] = r.origin.z;
+		dx[i] = r.direction.x;
+		dy[i] = r.direction.y;
+		dz[i] = r.direction.z;
+		ix[i] = 1 / r.direction.x;
+		iy[i] = 1 / r.direction.y;
+		iz[i] = 1 / r.direction.z;
+	}
+
+	ray3 get(size_t i) const
+	{
+		return ray3(vec3(ox[i], oy[i], oz[i]), vec3(dx[i], dy[i], dz[i]));
+	}
+};
+
+typedef ray_packet<4> ray_packet4;
+typedef ray_packet<8> ray_packet8;
+
+namespace detail
+{
+
+template <typename P>
+inline P dot3(P ax, P ay, P az, P bx, P by, P bz)
+{
+	return simd::madd(az, bz, simd::madd(ay, by, simd::mul(ax, bx)));
+}
+
+// out[l] = lane l of v for the lanes set in mask.
+template <typename P>
+inline void store_lanes(float* out, P v, int mask)
+{
+	float lanes[sizeof(P) / sizeof(float)];
+	simd::store(lanes, v);
+	for (size_t l = 0; l < sizeof(P) / sizeof(float); ++l)
+	{
+		if (mask & (1 << l))
+		{
+			out[l] = lanes[l];
+		}
+	}
+}
+
+// Each op tests rays [i, i + lanes of P) of a packet and returns their hit
+// mask, updating t (and u, v) for the hits, in the order of the single-ray
+// tests above.
+
+struct triangle_op
+{
+	vec3 a, e1, e2;
+	float* u;
+	float* v;
+
+	template <typename P, typename R>
+	int test(R const& r, size_t i, float* t) const
+	{
+		P const dx = simd::load<P>(r.dx + i), dy = simd::load<P>(r.dy + i), dz = simd::load<P>(r.dz + i);
+		P const e1x = simd::splat<P>(e1.x), e1y = simd::splat<P>(e1.y), e1z = simd::splat<P>(e1.z);
+		P const e2x = simd::splat<P>(e2.x), e2y = simd::splat<P>(e2.y), e2z = simd::splat<P>(e2.z);
+		P const px = simd::sub(simd::mul(dy, e2z), simd::mul(dz, e2y));
+		P const py = simd::sub(simd::mul(dz, e2x), simd::mul(dx, e2z));
+		P const pz = simd::sub(simd::mul(dx, e2y), simd::mul(dy, e2x));
+		P const inv = simd::div(simd::splat<P>(1), dot3(e1x, e1y, e1z, px, py, pz));
+		P const sx = simd::sub(simd::load<P>(r.ox + i), simd::splat<P>(a.x));
+		P const sy = simd::sub(simd::load<P>(r.oy + i), simd::splat<P>(a.y));
+		P const sz = simd::sub(simd::load<P>(r.oz + i), simd::splat<P>(a.z));
+		P const qx = simd::sub(simd::mul(sy, e1z), simd::mul(sz, e1y));
+		P const qy = simd::sub(simd::mul(sz, e1x), simd::mul(sx, e1z));
+		P const qz = simd::sub(simd::mul(sx, e1y), simd::mul(sy, e1x));
+		P const hu = simd::mul(dot3(sx, sy, sz, px, py, pz), inv);
+		P const hv = simd::mul(dot3(dx, dy, dz, qx, qy, qz), inv);
+		P const ht = simd::mul(dot3(e2x, e2y, e2z, qx, qy, qz), inv);
+		P const zero = simd::splat<P>(0);
+		int const mask = simd::less_equal_mask(zero, hu) & simd::less_equal_mask(zero, hv)
+			& simd::less_equal_mask(simd::add(hu, hv), simd::splat<P>(1))
+			& simd::less_equal_mask(zero, ht) & simd::less_mask(ht, simd::load<P>(t + i));
+		if (mask)
+		{
+			store_lanes(t + i, ht, mask);
+			if (u)
+			{
+				store_lanes(u + i, hu, mask);
+				store_lanes(v + i, hv, mask);
+			}
+		}
+		return mask;
+	}
+};
+
+// Hit mask of rays [i, i + lanes of P) against b, with their entry distances.
+template <typename P, typename R>
+inline int slab_mask(R const& r, size_t i, aabb3 const& b, float const* t, P& enter)
+{
+	P const t0x = simd::mul(simd::sub(simd::splat<P>(b.min.x), simd::load<P>(r.ox + i)), simd::load<P>(r.ix + i));
+	P const t0y = simd::mul(simd::sub(simd::splat<P>(b.min.y), simd::load<P>(r.oy + i)), simd::load<P>(r.iy + i));
+	P const t0z = simd::mul(simd::sub(simd::splat<P>(b.min.z), simd::load<P>(r.oz + i)), simd::load<P>(r.iz + i));
+	P const t1x = simd::mul(simd::sub(simd::splat<P>(b.max.x), simd::load<P>(r.ox + i)), simd::load<P>(r.ix + i));
+	P const t1y = simd::mul(simd::sub(simd::splat<P>(b.max.y), simd::load<P>(r.oy + i)), simd::load<P>(r.iy + i));
+	P const t1z = simd::mul(simd::sub(simd::splat<P>(b.max.z), simd::load<P>(r.oz + i)), simd::load<P>(r.iz + i));
+	enter = simd::max(simd::max(simd::max(simd::min(t0x, t1x), simd::min(t0y, t1y)), simd::min(t0z, t1z)), simd::splat<P>(0));
+	P const leave = simd::min(simd::min(simd::max(t0x, t1x), simd::max(t0y, t1y)), simd::max(t0z, t1z));
+	return simd::less_equal_mask(enter, leave) & simd::less_mask(enter, simd::load<P>(t + i));
+}
+
+struct box_op
+{
+	aabb3 b;
+
+	template <typename P, typename R>
+	int test(R const& r, size_t i, float* t) const
+	{
+		P enter;
+		int const mask = slab_mask(r, i, b, t, enter);
+		if (mask)
+		{
+			store_lanes(t + i, enter, mask);
+		}
+		return mask;
+	}
+};
+
+struct sphere_op
+{
+	sphere3 s;
+
+	template <typename P, typename R>
+	int test(R const& r, size_t i, float* t) const
+	{
+		P const dx = simd::load<P>(r.dx + i), dy = simd::load<P>(r.dy + i), dz = simd::load<P>(r.dz + i);
+		P const ox = simd::sub(simd::load<P>(r.ox + i), simd::splat<P>(s.center.x));
+		P const oy = simd::sub(simd::load<P>(r.oy + i), simd::splat<P>(s.center.y));
+		P const oz = simd::sub(simd::load<P>(r.oz + i), simd::splat<P>(s.center.z));
+		P const a = dot3(dx, dy, dz, dx, dy, dz);
+		P const b = dot3(ox, oy, oz, dx, dy, dz);
+		P const c = simd::sub(dot3(ox, oy, oz, ox, oy, oz), simd::splat<P>(s.radius * s.radius));
+		P const d = simd::sqrt(simd::sub(simd::mul(b, b), simd::mul(a, c)));
+		P const zero = simd::splat<P>(0);
+		P const t0 = simd::div(simd::sub(zero, simd::add(b, d)), a);
+		P const t1 = simd::div(simd::sub(d, b), a);
+		P const tmax = simd::load<P>(t + i);
+		int const mask0 = simd::less_equal_mask(zero, t0) & simd::less_mask(t0, tmax);
+		int const mask1 = simd::less_mask(t0, zero) & simd::less_equal_mask(zero, t1) & simd::less_mask(t1, tmax);
+		if (mask0 | mask1)
+		{
+			store_lanes(t + i, t0, mask0);
+			store_lanes(t + i, t1, mask1);
+		}
+		return mask0 | mask1;
+	}
+};
+
+struct plane_op
+{
+	vec4 plane;
+
+	template <typename P, typename R>
+	int test(R const& r, size_t i, float* t) const
+	{
+		P const px = simd::splat<P>(plane.x), py = simd::splat<P>(plane.y), pz = simd::splat<P>(plane.z);
+		P const height = simd::madd(simd::load<P>(r.oz + i), pz,
+			simd::madd(simd::load<P>(r.oy + i), py, simd::madd(simd::load<P>(r.ox + i), px, simd::splat<P>(plane.w))));
+		P const denominator = dot3(px, py, pz, simd::load<P>(r.dx + i), simd::load<P>(r.dy + i), simd::load<P>(r.dz + i));
+		P const ht = simd::div(height, simd::sub(simd::splat<P>(0), denominator));
+		int const mask = simd::less_equal_mask(simd::splat<P>(0), ht) & simd::less_mask(ht, simd::load<P>(t + i));
+		if (mask)
+		{
+			store_lanes(t + i, ht, mask);
+		}
+		return mask;
+	}
+};
+
+template <size_t N, typename Op>
+inline uint32_t trace(ray_packet<N> const& r, Op const& op, float* t)
+{
+	uint32_t mask = 0;
+	size_t i = 0;
+
+#if defined(XXX_AVX)
+	for (; i + 8 <= N; i += 8)
+	{
+		mask |= static_cast<uint32_t>(op.template test<simd::float8>(r, i, t)) << i;
+	}
+#endif
+
+#if defined(XXX_SSE)
+	for (; i + 4 <= N; i += 4)
+	{
+		mask |= static_cast<uint32_t>(op.template test<simd::float4>(r, i, t)) << i;
+	}
+#endif
+
+	for (; i < N; ++i)
+	{
+		mask |= static_cast<uint32_t>(op.template test<float>(r, i, t)) << i;
+	}
+	return mask;
+}
+
+}
+
+// Packet forms: the tests above for every ray of r against one primitive, with
+// t (and u, v) arrays of N values. They return a mask with bit i set where ray
+// i hit, and give the single-ray results (see mat4.hpp for the FMA caveat).
+
+template <size_t N>
+inline uint32_t intersects(ray_packet<N> const& r, vec3 const& a, vec3 const& b, vec3 const& c, float* t, float* u, float* v)
+{
+	detail::triangle_op const op = { a, b - a, c - a, u, v };
+	return detail::trace(r, op, t);
+}
+
+template <size_t N>
+inline uint32_t intersects(ray_packet<N> const& r, vec3 const& a, vec3 const& b, vec3 const& c, float* t)
+{
+	detail::triangle_op const op = { a, b - a, c - a, 0, 0 };
+	return detail::trace(r, op, t);
+}
+
+template <size_t N>
+inline uint32_t intersects(ray_packet<N> const& r, aabb3 const& b, float* t)
+{
+	detail::box_op const op = { b };
+	return b.is_empty() ? 0 : detail::trace(r, op, t);
+}
+
+template <size_t N>
+inline uint32_t intersects(ray_packet<N> const& r, sphere3 const& s, float* t)
+{
+	detail::sphere_op const op = { s };
+	return s.is_empty() ? 0 : detail::trace(r, op, t);
+}
+
+template <size_t N>
+inline uint32_t intersects(ray_packet<N> const& r, vec4 const& plane, float* t)
+{
+	detail::plane_op const op = { plane };
+	return detail::trace(r, op, t);
+}
+
+}
+
+#endif
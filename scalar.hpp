@@ -10,30 +10,64 @@
 #endif
 
 #include <math.h>
+#include <stddef.h>
+#include <limits>
+#include <type_traits>
+
+#include "simd.hpp"
 
 namespace xxx
 {
 
+// Default scalar of the vec/mat/quaternion/transform aliases. Every type is a
+// template over its scalar (basic_vec3<T>...), so double precision is available
+// alongside through the d-prefixed aliases (dvec3, dmat4, dquaternion...).
 typedef float scalar_t;
 
-static const scalar_t pi = static_cast<scalar_t>(3.1415926535897932384626433832795);
+static constexpr scalar_t pi = static_cast<scalar_t>(3.1415926535897932384626433832795);
+
+namespace detail
+{
 
-inline scalar_t degrees(scalar_t rad)
+// T as a non-deduced parameter: the type comes from the first argument and
+// the others convert to it, so clamp(v, 0, 1) works for any v.
+template <typename T>
+struct scalar
 {
-	return rad * 180 / pi;
+	typedef T type;
+};
+
+// Type angles of T are converted in: T itself, or scalar_t for integers.
+template <typename T>
+struct real
+{
+	typedef typename std::conditional<std::is_floating_point<T>::value, T, scalar_t>::type type;
+};
+
 }
 
-inline scalar_t radians(scalar_t deg)
+template <typename T>
+inline constexpr typename detail::real<T>::type degrees(T rad)
 {
-	return deg * pi / 180;
+	typedef typename detail::real<T>::type R;
+	return static_cast<R>(rad) * 180 / static_cast<R>(3.1415926535897932384626433832795);
 }
 
-inline scalar_t min(scalar_t a, scalar_t b)
+template <typename T>
+inline constexpr typename detail::real<T>::type radians(T deg)
+{
+	typedef typename detail::real<T>::type R;
+	return static_cast<R>(deg) * static_cast<R>(3.1415926535897932384626433832795) / 180;
+}
+
+template <typename T>
+inline constexpr T min(T a, typename detail::scalar<T>::type b)
 {
 	return a < b ? a : b;
 }
 
-inline scalar_t max(scalar_t a, scalar_t b)
+template <typename T>
+inline constexpr T max(T a, typename detail::scalar<T>::type b)
 {
 	return a > b ? a : b;
 }
@@ -48,7 +82,8 @@ inline double abs(double s)
 	return fabs(s);
 }
 
-inline scalar_t clamp(scalar_t v, scalar_t minimum, scalar_t maximum)
+template <typename T>
+inline constexpr T clamp(T v, typename detail::scalar<T>::type minimum, typename detail::scalar<T>::type maximum)
 {
 	return min(max(v, minimum), maximum);
 }
@@ -103,12 +138,189 @@ inline double cos(double s)
 	return ::cos(s);
 }
 
-inline void sincos(scalar_t v, scalar_t& s, scalar_t& c)
+// Accuracy tiers for functions that have approximate versions. full is the C
+// library, high stays close to it over the documented input range, with each
+// function giving its bound, and fast trades accuracy (about 1e-3) for
+// throughput.
+enum class precision
+{
+	full,
+	high,
+	fast
+};
+
+// Precision used by normalize() and friends when the call site does not pick
+// one, e.g. -DXXX_DEFAULT_PRECISION=high.
+#if !defined(XXX_DEFAULT_PRECISION)
+#define XXX_DEFAULT_PRECISION full
+#endif
+
+static constexpr precision default_precision = precision::XXX_DEFAULT_PRECISION;
+
+namespace detail
+{
+
+// Hardware estimate, refined by one Newton-Raphson step for high.
+template <precision Q, typename P>
+inline P rsqrt(P v)
+{
+	if (Q == precision::full)
+	{
+		return simd::div(simd::splat<P>(1), simd::sqrt(v));
+	}
+	P const y = simd::rsqrt(v);
+	if (Q == precision::fast)
+	{
+		return y;
+	}
+	return simd::mul(y, simd::madd(simd::mul(v, simd::splat<P>(-0.5f)), simd::mul(y, y), simd::splat<P>(1.5f)));
+}
+
+}
+
+// 1 / sqrt(v). The relative error is below 2.5e-7 for high and 3.7e-4 for
+// fast; zero gives infinity for full and fast, NaN for high. Double precision
+// is always full.
+template <precision Q = default_precision>
+inline float rsqrt(float v)
+{
+	return detail::rsqrt<Q>(v);
+}
+
+template <precision Q = default_precision>
+inline double rsqrt(double v)
+{
+	return 1 / sqrt(v);
+}
+
+template <typename T>
+inline void sincos(T v, T& s, T& c)
 {
 	s = sin(v);
 	c = cos(v);
 }
 
+namespace detail
+{
+
+// Shared range reduction for sin and cos: v = q * pi/2 + r with |r| <= pi/4
+// (Cody-Waite, with pi/2 split in parts whose products with q are exact), then
+// one polynomial each for sin(r) and cos(r). Everything is plain arithmetic so
+// the same code runs on float, float4 and float8.
+template <precision Q, typename P>
+inline P sincos_reduce(P v, P& sr, P& cr)
+{
+	P const one = simd::splat<P>(1);
+	P const q = simd::round(simd::mul(v, simd::splat<P>(0.636619772367581343f)));
+
+	P r = simd::madd(q, simd::splat<P>(-1.5703125f), v);
+	if (Q == precision::fast)
+	{
+		r = simd::madd(q, simd::splat<P>(-4.8382679e-4f), r);
+	}
+	else
+	{
+		r = simd::madd(q, simd::splat<P>(-4.837512969970703125e-4f), r);
+		r = simd::madd(q, simd::splat<P>(-7.54978995489188216e-8f), r);
+	}
+	P const r2 = simd::mul(r, r);
+
+	if (Q == precision::fast)
+	{
+		// Minimax on [-pi/4, pi/4]: 3.2e-4 and 1.3e-5.
+		sr = simd::madd(simd::mul(r2, r), simd::splat<P>(-0.162259f), r);
+		cr = simd::madd(simd::madd(r2, simd::splat<P>(0.040480f), simd::splat<P>(-0.499770f)), r2, one);
+	}
+	else
+	{
+		// Cephes sinf/cosf.
+		P ps = simd::madd(r2, simd::splat<P>(-1.9515295891e-4f), simd::splat<P>(8.3321608736e-3f));
+		ps = simd::madd(ps, r2, simd::splat<P>(-1.6666654611e-1f));
+		sr = simd::madd(simd::mul(ps, r2), r, r);
+		P pc = simd::madd(r2, simd::splat<P>(2.443315711809948e-5f), simd::splat<P>(-1.388731625493765e-3f));
+		pc = simd::madd(pc, r2, simd::splat<P>(4.166664568298827e-2f));
+		cr = simd::madd(simd::mul(pc, r2), r2, simd::madd(r2, simd::splat<P>(-0.5f), one));
+	}
+	return q;
+}
+
+// Quadrant fix-up without integer lanes: m = q mod 4 is split into its bits;
+// odd quadrants swap sin and cos, sin is negative in quadrants 2 and 3 and cos
+// in quadrants 1 and 2. Only multiplies by 0, 1 and -1, so the result is
+// exactly that of the scalar switch below.
+template <precision Q, typename P>
+inline void sincos_poly(P v, P& s, P& c)
+{
+	P sr, cr;
+	P const q = sincos_reduce<Q>(v, sr, cr);
+
+	P const one = simd::splat<P>(1);
+	P const m = simd::madd(simd::round(simd::sub(simd::mul(q, simd::splat<P>(0.25f)), simd::splat<P>(0.375f))), simd::splat<P>(-4), q);
+	P const hi = simd::round(simd::sub(simd::mul(m, simd::splat<P>(0.5f)), simd::splat<P>(0.25f)));
+	P const lo = simd::madd(hi, simd::splat<P>(-2), m);
+	P const nlo = simd::sub(one, lo);
+	P const sign_s = simd::madd(hi, simd::splat<P>(-2), one);
+	P const sign_c = simd::mul(sign_s, simd::madd(lo, simd::splat<P>(-2), one));
+	s = simd::mul(simd::add(simd::mul(sr, nlo), simd::mul(cr, lo)), sign_s);
+	c = simd::mul(simd::add(simd::mul(cr, nlo), simd::mul(sr, lo)), sign_c);
+}
+
+}
+
+// sincos with a selectable precision. high is within 1e-7 absolute of the
+// exact values for |v| <= 8192 and within 1e-6 up to 2^16; fast is within
+// 3.6e-4 up to 2^16. The error is absolute: close to the zeros of sin and cos
+// it is many ULP, so use full where relative accuracy matters there, or beyond
+// 2^16. Double precision is always full.
+template <precision Q>
+inline void sincos(float v, float& s, float& c)
+{
+	if (Q == precision::full)
+	{
+		sincos(v, s, c);
+		return;
+	}
+
+	float sr, cr;
+	switch (static_cast<int>(detail::sincos_reduce<Q>(v, sr, cr)) & 3)
+	{
+	case 0: s = sr;  c = cr;  break;
+	case 1: s = cr;  c = -sr; break;
+	case 2: s = -sr; c = -cr; break;
+	default: s = -cr; c = sr; break;
+	}
+}
+
+template <precision Q>
+inline void sincos(double v, double& s, double& c)
+{
+	sincos(v, s, c);
+}
+
+// sincos<Q>(v[i], s[i], c[i]) for every element, 4 or 8 at a time for high and
+// fast. Full precision calls the C library per element.
+template <precision Q>
+inline void sincos_n(float const* v, float* s, float* c, size_t n)
+{
+	size_t i = 0;
+#if defined(XXX_SSE)
+	if (Q != precision::full)
+	{
+		for (; i + simd::width <= n; i += simd::width)
+		{
+			simd::floatn vs, vc;
+			detail::sincos_poly<Q>(simd::load<simd::floatn>(v + i), vs, vc);
+			simd::store(s + i, vs);
+			simd::store(c + i, vc);
+		}
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		sincos<Q>(v[i], s[i], c[i]);
+	}
+}
+
 inline float atan(float v)
 {
 	return atanf(v);
@@ -116,7 +328,7 @@ inline float atan(float v)
 
 inline double atan(double v)
 {
-	return atan(v);
+	return ::atan(v);
 }
 
 inline float atan(float x, float y)
@@ -126,17 +338,29 @@ inline float atan(float x, float y)
 
 inline double atan(double x, double y)
 {
-	return atan2(x, y);
+	return ::atan2(x, y);
+}
+
+inline float tan(float s)
+{
+	return ::tanf(s);
+}
+
+inline double tan(double s)
+{
+	return ::tan(s);
 }
 
-inline scalar_t mix(scalar_t a, scalar_t b, scalar_t t)
+template <typename T>
+inline constexpr T mix(T a, typename detail::scalar<T>::type b, typename detail::scalar<T>::type t)
 {
 	return a + (b - a) * t;
 }
 
-inline scalar_t sign(scalar_t s)
+template <typename T>
+inline constexpr T sign(T s)
 {
-	return s < 0 ? static_cast<scalar_t>(-1) : s > 0 ? static_cast<scalar_t>(1) : 0;
+	return s < 0 ? static_cast<T>(-1) : s > 0 ? static_cast<T>(1) : 0;
 }
 
 }
@@ -0,0 +1,448 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// SIMD backend selection. The instruction set is picked from the compiler's
+// target flags (-msse2, -mavx, -mfma, /arch:AVX2...); define XXX_NO_SIMD to
+// force the scalar code paths everywhere.
+
+#if !defined(XXX_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define XXX_SSE
+#endif
+#if defined(XXX_SSE) && defined(__AVX__)
+#define XXX_AVX
+#endif
+#if defined(XXX_SSE) && (defined(__FMA__) || defined(__AVX2__))
+#define XXX_FMA
+#endif
+#if defined(XXX_SSE) && (defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__)))
+#define XXX_F16C
+#endif
+#endif
+
+#if defined(XXX_SSE)
+#include <immintrin.h>
+#endif
+
+// SIMD overloads of constexpr functions use XXX_CONSTANT_EVALUATED() to fall
+// back to the generic code during constant evaluation. Compilers without the
+// builtin get non-constexpr SIMD overloads (XXX_SIMD_CONSTEXPR is empty).
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define XXX_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#endif
+#if !defined(XXX_CONSTANT_EVALUATED) && ((defined(__GNUC__) && __GNUC__ >= 9) || (defined(_MSC_VER) && _MSC_VER >= 1925))
+#define XXX_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+
+#if defined(XXX_CONSTANT_EVALUATED)
+#define XXX_SIMD_CONSTEXPR constexpr
+#else
+#define XXX_SIMD_CONSTEXPR
+#endif
+
+#include <math.h>
+#include <stddef.h>
+
+namespace xxx
+{
+
+namespace simd
+{
+
+// Every operation is provided for float (the scalar fallback), float4 (SSE)
+// and float8 (AVX) so kernels can be written once over the native pack type.
+
+template <typename P>
+P splat(float s);
+
+template <typename P>
+P load(float const* p);
+
+template <>
+inline float splat<float>(float s)
+{
+	return s;
+}
+
+template <>
+inline float load<float>(float const* p)
+{
+	return *p;
+}
+
+inline void store(float* p, float v)
+{
+	*p = v;
+}
+
+inline float add(float a, float b)
+{
+	return a + b;
+}
+
+inline float sub(float a, float b)
+{
+	return a - b;
+}
+
+inline float mul(float a, float b)
+{
+	return a * b;
+}
+
+inline float div(float a, float b)
+{
+	return a / b;
+}
+
+inline float madd(float a, float b, float c)
+{
+	return a * b + c;
+}
+
+inline float min(float a, float b)
+{
+	return a < b ? a : b;
+}
+
+inline float max(float a, float b)
+{
+	return a > b ? a : b;
+}
+
+inline float sqrt(float v)
+{
+	return ::sqrtf(v);
+}
+
+inline float abs(float v)
+{
+	return ::fabsf(v);
+}
+
+// Approximate 1 / sqrt(v), relative error at most 1.5 * 2^-12 (exact where
+// there is no hardware estimate).
+inline float rsqrt(float v)
+{
+#if defined(XXX_SSE)
+	return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(v)));
+#else
+	return 1 / ::sqrtf(v);
+#endif
+}
+
+// Rounds to the nearest integer, ties to even. The SSE versions are only valid
+// for |v| < 2^31.
+inline float round(float v)
+{
+#if defined(XXX_SSE)
+	return static_cast<float>(_mm_cvtss_si32(_mm_set_ss(v)));
+#else
+	return ::nearbyintf(v);
+#endif
+}
+
+// a with its sign flipped where b has the sign bit set.
+inline float flipsign(float a, float b)
+{
+	return signbit(b) ? -a : a;
+}
+
+// Bit i set where lane i of a is less than lane i of b. Comparisons with NaN
+// are false.
+inline int less_mask(float a, float b)
+{
+	return a < b ? 1 : 0;
+}
+
+inline int less_equal_mask(float a, float b)
+{
+	return a <= b ? 1 : 0;
+}
+
+#if defined(XXX_SSE)
+
+typedef __m128 float4;
+
+inline float4 load(float const* p)
+{
+	return _mm_loadu_ps(p);
+}
+
+template <>
+inline float4 load<float4>(float const* p)
+{
+	return _mm_loadu_ps(p);
+}
+
+inline void store(float* p, float4 v)
+{
+	_mm_storeu_ps(p, v);
+}
+
+template <>
+inline float4 splat<float4>(float s)
+{
+	return _mm_set1_ps(s);
+}
+
+template <int i>
+inline float4 splat(float4 v)
+{
+	return _mm_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i));
+}
+
+inline float4 add(float4 a, float4 b)
+{
+	return _mm_add_ps(a, b);
+}
+
+inline float4 sub(float4 a, float4 b)
+{
+	return _mm_sub_ps(a, b);
+}
+
+inline float4 mul(float4 a, float4 b)
+{
+	return _mm_mul_ps(a, b);
+}
+
+inline float4 div(float4 a, float4 b)
+{
+	return _mm_div_ps(a, b);
+}
+
+inline float4 min(float4 a, float4 b)
+{
+	return _mm_min_ps(a, b);
+}
+
+inline float4 max(float4 a, float4 b)
+{
+	return _mm_max_ps(a, b);
+}
+
+inline float4 sqrt(float4 v)
+{
+	return _mm_sqrt_ps(v);
+}
+
+inline float4 abs(float4 v)
+{
+	return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+inline float4 rsqrt(float4 v)
+{
+	return _mm_rsqrt_ps(v);
+}
+
+inline float4 round(float4 v)
+{
+	return _mm_cvtepi32_ps(_mm_cvtps_epi32(v));
+}
+
+inline float4 flipsign(float4 a, float4 b)
+{
+	return _mm_xor_ps(a, _mm_and_ps(b, _mm_set1_ps(-0.0f)));
+}
+
+inline int less_mask(float4 a, float4 b)
+{
+	return _mm_movemask_ps(_mm_cmplt_ps(a, b));
+}
+
+inline int less_equal_mask(float4 a, float4 b)
+{
+	return _mm_movemask_ps(_mm_cmple_ps(a, b));
+}
+
+// a * b + c. With XXX_FMA this is a single fused operation and skips the
+// intermediate rounding of the product, so sums built from it may differ from
+// the scalar code in the last bits.
+inline float4 madd(float4 a, float4 b, float4 c)
+{
+#if defined(XXX_FMA)
+	return _mm_fmadd_ps(a, b, c);
+#else
+	return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+// Loads four packed xyz triples (12 floats) and deinterleaves them.
+inline void load3(float const* p, float4& x, float4& y, float4& z)
+{
+	float4 const a = _mm_loadu_ps(p);     // x0 y0 z0 x1
+	float4 const b = _mm_loadu_ps(p + 4); // y1 z1 x2 y2
+	float4 const c = _mm_loadu_ps(p + 8); // z2 x3 y3 z3
+	float4 const t = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2)); // x2 y2 x3 y3
+	float4 const u = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1)); // y0 z0 y1 z1
+	x = _mm_shuffle_ps(a, t, _MM_SHUFFLE(2, 0, 3, 0));
+	y = _mm_shuffle_ps(u, t, _MM_SHUFFLE(3, 1, 2, 0));
+	z = _mm_shuffle_ps(u, c, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+// Inverse of load3.
+inline void store3(float* p, float4 x, float4 y, float4 z)
+{
+	float4 const xy01 = _mm_unpacklo_ps(x, y); // x0 y0 x1 y1
+	float4 const xy23 = _mm_unpackhi_ps(x, y); // x2 y2 x3 y3
+	float4 const t = _mm_shuffle_ps(z, xy01, _MM_SHUFFLE(2, 2, 0, 0)); // z0 z0 x1 x1
+	float4 const s = _mm_shuffle_ps(xy01, z, _MM_SHUFFLE(1, 1, 3, 3)); // y1 y1 z1 z1
+	float4 const r = _mm_shuffle_ps(z, xy23, _MM_SHUFFLE(2, 2, 2, 2)); // z2 z2 x3 x3
+	float4 const q = _mm_shuffle_ps(xy23, z, _MM_SHUFFLE(3, 3, 3, 3)); // y3 y3 z3 z3
+	_mm_storeu_ps(p, _mm_shuffle_ps(xy01, t, _MM_SHUFFLE(2, 0, 1, 0)));
+	_mm_storeu_ps(p + 4, _mm_shuffle_ps(s, xy23, _MM_SHUFFLE(1, 0, 2, 0)));
+	_mm_storeu_ps(p + 8, _mm_shuffle_ps(r, q, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+// Transposes the 4x4 block held in a, b, c, d.
+inline void transpose(float4& a, float4& b, float4& c, float4& d)
+{
+	_MM_TRANSPOSE4_PS(a, b, c, d);
+}
+
+#endif
+
+#if defined(XXX_AVX)
+
+typedef __m256 float8;
+
+template <>
+inline float8 load<float8>(float const* p)
+{
+	return _mm256_loadu_ps(p);
+}
+
+inline void store(float* p, float8 v)
+{
+	_mm256_storeu_ps(p, v);
+}
+
+template <>
+inline float8 splat<float8>(float s)
+{
+	return _mm256_set1_ps(s);
+}
+
+// Broadcasts lane i within each 128-bit half.
+template <int i>
+inline float8 splat(float8 v)
+{
+	return _mm256_permute_ps(v, _MM_SHUFFLE(i, i, i, i));
+}
+
+inline float8 combine(float4 lo, float4 hi)
+{
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+inline float8 combine(float4 v)
+{
+	return combine(v, v);
+}
+
+inline float4 low(float8 v)
+{
+	return _mm256_castps256_ps128(v);
+}
+
+inline float4 high(float8 v)
+{
+	return _mm256_extractf128_ps(v, 1);
+}
+
+inline float8 add(float8 a, float8 b)
+{
+	return _mm256_add_ps(a, b);
+}
+
+inline float8 sub(float8 a, float8 b)
+{
+	return _mm256_sub_ps(a, b);
+}
+
+inline float8 mul(float8 a, float8 b)
+{
+	return _mm256_mul_ps(a, b);
+}
+
+inline float8 div(float8 a, float8 b)
+{
+	return _mm256_div_ps(a, b);
+}
+
+inline float8 min(float8 a, float8 b)
+{
+	return _mm256_min_ps(a, b);
+}
+
+inline float8 max(float8 a, float8 b)
+{
+	return _mm256_max_ps(a, b);
+}
+
+inline float8 sqrt(float8 v)
+{
+	return _mm256_sqrt_ps(v);
+}
+
+inline float8 abs(float8 v)
+{
+	return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v);
+}
+
+inline float8 rsqrt(float8 v)
+{
+	return _mm256_rsqrt_ps(v);
+}
+
+inline float8 round(float8 v)
+{
+	return _mm256_round_ps(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+
+inline float8 flipsign(float8 a, float8 b)
+{
+	return _mm256_xor_ps(a, _mm256_and_ps(b, _mm256_set1_ps(-0.0f)));
+}
+
+inline int less_mask(float8 a, float8 b)
+{
+	return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ));
+}
+
+inline int less_equal_mask(float8 a, float8 b)
+{
+	return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ));
+}
+
+inline float8 madd(float8 a, float8 b, float8 c)
+{
+#if defined(XXX_FMA)
+	return _mm256_fmadd_ps(a, b, c);
+#else
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+#endif
+
+// Widest pack type enabled for this build.
+#if defined(XXX_AVX)
+typedef float8 floatn;
+#elif defined(XXX_SSE)
+typedef float4 floatn;
+#else
+typedef float floatn;
+#endif
+
+static size_t const width = sizeof(floatn) / sizeof(float);
+
+}
+
+}
+
+#endif
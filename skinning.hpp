@@ -0,0 +1,308 @@
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mat4.hpp"
+#include "affine3.hpp"
+#include "soa.hpp"
+#include "executor.hpp"
+#include "simd.hpp"
+
+namespace xxx
+{
+
+// Linear blend skinning of SoA vertex streams. Vertex i has K influences:
+// palette entries indices[i * K + k] with weights[i * K + k], which should
+// sum to 1. The palette is affine3 or mat4, a mat4 bone m acting as
+// affine3(m). Each vertex is transformed by its blended bone matrix
+// B = sum of weight * bone:
+//
+//   out_positions[i] = transform_point(B, positions[i])
+//   out_normals[i] = transform_vector(B, normals[i])
+//
+// in that operation order (see mat4.hpp for the FMA caveat). Normals are not
+// renormalized; use normalize(vec3_soa) afterwards where scaled bones or the
+// blend shorten them. The outputs are resized to match and may be the inputs.
+
+namespace detail
+{
+
+// Offsets of the affine3 elements (x.x, x.y, x.z, y.x ... w.z) in a bone.
+inline size_t bone_element(affine3 const*, size_t e)
+{
+	return e;
+}
+
+inline size_t bone_element(mat4 const*, size_t e)
+{
+	return e / 3 * 4 + e % 3;
+}
+
+template <size_t K, typename Bone>
+inline void blend_bones(Bone const* palette, uint16_t const* indices, float const* weights, float* b)
+{
+	float const* m = &palette[indices[0]].x.x;
+	for (size_t e = 0; e < 12; ++e)
+	{
+		b[e] = m[bone_element(palette, e)] * weights[0];
+	}
+	for (size_t k = 1; k < K; ++k)
+	{
+		m = &palette[indices[k]].x.x;
+		for (size_t e = 0; e < 12; ++e)
+		{
+			b[e] = m[bone_element(palette, e)] * weights[k] + b[e];
+		}
+	}
+}
+
+#if defined(XXX_SSE)
+
+// Blended bones of the 4 vertices from indices and weights, as 12 packs of
+// the affine3 elements. Each vertex's bones are blended as float4 rows, which
+// are then transposed into vertex lanes.
+template <size_t K>
+inline void blend_bones(affine3 const* palette, uint16_t const* indices, float const* weights, simd::float4* b)
+{
+	simd::float4 r[4][3];
+	for (size_t j = 0; j < 4; ++j)
+	{
+		float const* m = &palette[indices[j * K]].x.x;
+		simd::float4 w = simd::splat<simd::float4>(weights[j * K]);
+		for (size_t c = 0; c < 3; ++c)
+		{
+			r[j][c] = simd::mul(simd::load(m + 4 * c), w);
+		}
+		for (size_t k = 1; k < K; ++k)
+		{
+			m = &palette[indices[j * K + k]].x.x;
+			w = simd::splat<simd::float4>(weights[j * K + k]);
+			for (size_t c = 0; c < 3; ++c)
+			{
+				r[j][c] = simd::madd(simd::load(m + 4 * c), w, r[j][c]);
+			}
+		}
+	}
+	for (size_t c = 0; c < 3; ++c)
+	{
+		simd::transpose(r[0][c], r[1][c], r[2][c], r[3][c]);
+		for (size_t l = 0; l < 4; ++l)
+		{
+			b[4 * c + l] = r[l][c];
+		}
+	}
+}
+
+template <size_t K>
+inline void blend_bones(mat4 const* palette, uint16_t const* indices, float const* weights, simd::float4* b)
+{
+	simd::float4 r[4][4];
+	for (size_t j = 0; j < 4; ++j)
+	{
+		float const* m = &palette[indices[j * K]].x.x;
+		simd::float4 w = simd::splat<simd::float4>(weights[j * K]);
+		for (size_t c = 0; c < 4; ++c)
+		{
+			r[j][c] = simd::mul(simd::load(m + 4 * c), w);
+		}
+		for (size_t k = 1; k < K; ++k)
+		{
+			m = &palette[indices[j * K + k]].x.x;
+			w = simd::splat<simd::float4>(weights[j * K + k]);
+			for (size_t c = 0; c < 4; ++c)
+			{
+				r[j][c] = simd::madd(simd::load(m + 4 * c), w, r[j][c]);
+			}
+		}
+	}
+	for (size_t c = 0; c < 4; ++c)
+	{
+		simd::transpose(r[0][c], r[1][c], r[2][c], r[3][c]);
+		for (size_t l = 0; l < 3; ++l)
+		{
+			b[3 * c + l] = r[l][c];
+		}
+	}
+}
+
+#endif
+
+template <typename P>
+inline void skin_point(P const* b, P& x, P& y, P& z)
+{
+	P const ox = simd::add(simd::madd(z, b[6], simd::madd(y, b[3], simd::mul(x, b[0]))), b[9]);
+	P const oy = simd::add(simd::madd(z, b[7], simd::madd(y, b[4], simd::mul(x, b[1]))), b[10]);
+	P const oz = simd::add(simd::madd(z, b[8], simd::madd(y, b[5], simd::mul(x, b[2]))), b[11]);
+	x = ox;
+	y = oy;
+	z = oz;
+}
+
+template <typename P>
+inline void skin_vector(P const* b, P& x, P& y, P& z)
+{
+	P const ox = simd::madd(z, b[6], simd::madd(y, b[3], simd::mul(x, b[0])));
+	P const oy = simd::madd(z, b[7], simd::madd(y, b[4], simd::mul(x, b[1])));
+	P const oz = simd::madd(z, b[8], simd::madd(y, b[5], simd::mul(x, b[2])));
+	x = ox;
+	y = oy;
+	z = oz;
+}
+
+template <typename P>
+inline void skin_stream(P const* b, vec3_soa const& in, vec3_soa& out, size_t i, bool point)
+{
+	P x = simd::load<P>(in.x() + i);
+	P y = simd::load<P>(in.y() + i);
+	P z = simd::load<P>(in.z() + i);
+	if (point)
+	{
+		skin_point(b, x, y, z);
+	}
+	else
+	{
+		skin_vector(b, x, y, z);
+	}
+	simd::store(out.x() + i, x);
+	simd::store(out.y() + i, y);
+	simd::store(out.z() + i, z);
+}
+
+// Vertices [begin, end); normals may be null.
+template <size_t K, typename Bone>
+inline void skin_range(Bone const* palette, uint16_t const* indices, float const* weights,
+	vec3_soa const& positions, vec3_soa const* normals, vec3_soa& out_positions, vec3_soa* out_normals, size_t begin, size_t end)
+{
+	size_t i = begin;
+
+#if defined(XXX_AVX)
+	for (; i + 8 <= end; i += 8)
+	{
+		simd::float4 lo[12], hi[12];
+		blend_bones<K>(palette, indices + i * K, weights + i * K, lo);
+		blend_bones<K>(palette, indices + (i + 4) * K, weights + (i + 4) * K, hi);
+		simd::float8 b[12];
+		for (size_t e = 0; e < 12; ++e)
+		{
+			b[e] = simd::combine(lo[e], hi[e]);
+		}
+		skin_stream(b, positions, out_positions, i, true);
+		if (normals)
+		{
+			skin_stream(b, *normals, *out_normals, i, false);
+		}
+	}
+#endif
+
+#if defined(XXX_SSE)
+	for (; i + 4 <= end; i += 4)
+	{
+		simd::float4 b[12];
+		blend_bones<K>(palette, indices + i * K, weights + i * K, b);
+		skin_stream(b, positions, out_positions, i, true);
+		if (normals)
+		{
+			skin_stream(b, *normals, *out_normals, i, false);
+		}
+	}
+#endif
+
+	for (; i < end; ++i)
+	{
+		float b[12];
+		blend_bones<K>(palette, indices + i * K, weights + i * K, b);
+		skin_stream(b, positions, out_positions, i, true);
+		if (normals)
+		{
+			skin_stream(b, *normals, *out_normals, i, false);
+		}
+	}
+}
+
+template <size_t K, typename Bone>
+inline void skin(executor* ex, Bone const* palette, uint16_t const* indices, float const* weights,
+	vec3_soa const& positions, vec3_soa const* normals, vec3_soa& out_positions, vec3_soa* out_normals)
+{
+	static_assert(K > 0, "vertices need at least one bone influence");
+
+	size_t const n = positions.size();
+	out_positions.resize(n);
+	if (normals)
+	{
+		out_normals->resize(n);
+	}
+
+	if (ex)
+	{
+		size_t const bytes = K * (sizeof(*indices) + sizeof(*weights)) + (normals ? 4 : 2) * 3 * sizeof(float);
+		parallel_for(*ex, n, parallel_grain(bytes), [&](size_t begin, size_t end) {
+			skin_range<K>(palette, indices, weights, positions, normals, out_positions, out_normals, begin, end);
+		});
+	}
+	else
+	{
+		skin_range<K>(palette, indices, weights, positions, normals, out_positions, out_normals, 0, n);
+	}
+}
+
+}
+
+template <size_t K>
+inline void skin(affine3 const* palette, uint16_t const* indices, float const* weights, vec3_soa const& positions, vec3_soa& out_positions)
+{
+	detail::skin<K>(0, palette, indices, weights, positions, 0, out_positions, 0);
+}
+
+template <size_t K>
+inline void skin(affine3 const* palette, uint16_t const* indices, float const* weights,
+	vec3_soa const& positions, vec3_soa const& normals, vec3_soa& out_positions, vec3_soa& out_normals)
+{
+	detail::skin<K>(0, palette, indices, weights, positions, &normals, out_positions, &out_normals);
+}
+
+template <size_t K>
+inline void skin(mat4 const* palette, uint16_t const* indices, float const* weights, vec3_soa const& positions, vec3_soa& out_positions)
+{
+	detail::skin<K>(0, palette, indices, weights, positions, 0, out_positions, 0);
+}
+
+template <size_t K>
+inline void skin(mat4 const* palette, uint16_t const* indices, float const* weights,
+	vec3_soa const& positions, vec3_soa const& normals, vec3_soa& out_positions, vec3_soa& out_normals)
+{
+	detail::skin<K>(0, palette, indices, weights, positions, &normals, out_positions, &out_normals);
+}
+
+// Executor forms (see executor.hpp); results are identical.
+
+template <size_t K>
+inline void skin(executor& ex, affine3 const* palette, uint16_t const* indices, float const* weights, vec3_soa const& positions, vec3_soa& out_positions)
+{
+	detail::skin<K>(&ex, palette, indices, weights, positions, 0, out_positions, 0);
+}
+
+template <size_t K>
+inline void skin(executor& ex, affine3 const* palette, uint16_t const* indices, float const* weights,
+	vec3_soa const& positions, vec3_soa const& normals, vec3_soa& out_positions, vec3_soa& out_normals)
+{
+	detail::skin<K>(&ex, palette, indices, weights, positions, &normals, out_positions, &out_normals);
+}
+
+template <size_t K>
+inline void skin(executor& ex, mat4 const* palette, uint16_t const* indices, float const* weights, vec3_soa const& positions, vec3_soa& out_positions)
+{
+	detail::skin<K>(&ex, palette, indices, weights, positions, 0, out_positions, 0);
+}
+
+template <size_t K>
+inline void skin(executor& ex, mat4 const* palette, uint16_t const* indices, float const* weights,
+	vec3_soa const& positions, vec3_soa const& normals, vec3_soa& out_positions, vec3_soa& out_normals)
+{
+	detail::skin<K>(&ex, palette, indices, weights, positions, &normals, out_positions, &out_normals);
+}
+
+}
+
+#endif
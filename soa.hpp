@@ -0,0 +1,684 @@
+#ifndef SOA_H
+#define SOA_H
+
+#include <stddef.h>
+#include <string.h>
+#include <new>
+
+#include "vec4.hpp"
+#include "simd.hpp"
+
+namespace xxx
+{
+
+namespace detail
+{
+
+// N float streams sharing one allocation. Every stream starts on a 32-byte
+// boundary and is padded to a multiple of 8 elements, so the kernels below run
+// full-width SIMD over padded_size() without tail loops. The padding contents
+// are unspecified; elements added by resize() are zero.
+template <size_t N>
+class soa_storage
+{
+public:
+	static size_t const alignment = 32;
+	static size_t const granularity = 8;
+
+	soa_storage() : block(0), base(0), count(0), stride(0) {}
+
+	explicit soa_storage(size_t n) : block(0), base(0), count(0), stride(0)
+	{
+		resize(n);
+	}
+
+	soa_storage(soa_storage const& s) : block(0), base(0), count(0), stride(0)
+	{
+		*this = s;
+	}
+
+	soa_storage(soa_storage&& s) : block(s.block), base(s.base), count(s.count), stride(s.stride)
+	{
+		s.block = 0;
+		s.base = 0;
+		s.count = 0;
+		s.stride = 0;
+	}
+
+	~soa_storage()
+	{
+		::operator delete(block);
+	}
+
+	soa_storage& operator = (soa_storage const& s)
+	{
+		if (this != &s)
+		{
+			resize(s.count);
+			if (stride != 0)
+			{
+				memcpy(base, s.base, N * stride * sizeof(float));
+			}
+		}
+		return *this;
+	}
+
+	soa_storage& operator = (soa_storage&& s)
+	{
+		swap(s);
+		return *this;
+	}
+
+	void swap(soa_storage& s)
+	{
+		void* b = block; block = s.block; s.block = b;
+		float* p = base; base = s.base; s.base = p;
+		size_t c = count; count = s.count; s.count = c;
+		size_t t = stride; stride = s.stride; s.stride = t;
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+	size_t padded_size() const
+	{
+		return stride;
+	}
+
+	bool empty() const
+	{
+		return count == 0;
+	}
+
+	float* stream(size_t k)
+	{
+		return base + k * stride;
+	}
+
+	float const* stream(size_t k) const
+	{
+		return base + k * stride;
+	}
+
+	void resize(size_t n)
+	{
+		size_t const padded = (n + granularity - 1) / granularity * granularity;
+		if (padded != stride)
+		{
+			void* const b = ::operator new(N * padded * sizeof(float) + alignment);
+			float* const p = reinterpret_cast<float*>((reinterpret_cast<size_t>(b) + alignment - 1) & ~(alignment - 1));
+			size_t const keep = n < count ? n : count;
+			for (size_t k = 0; k < N; ++k)
+			{
+				if (keep != 0)
+				{
+					memcpy(p + k * padded, base + k * stride, keep * sizeof(float));
+				}
+				memset(p + k * padded + keep, 0, (padded - keep) * sizeof(float));
+			}
+			::operator delete(block);
+			block = b;
+			base = p;
+			stride = padded;
+		}
+		else
+		{
+			for (size_t k = 0; k < N; ++k)
+			{
+				float* const p = base + k * stride;
+				for (size_t i = count; i < n; ++i)
+				{
+					p[i] = 0;
+				}
+			}
+		}
+		count = n;
+	}
+
+	void clear()
+	{
+		resize(0);
+	}
+
+private:
+	void*  block;
+	float* base;
+	size_t count;
+	size_t stride;
+};
+
+}
+
+struct scalar_soa : detail::soa_storage<1>
+{
+	scalar_soa() {}
+	explicit scalar_soa(size_t n) : detail::soa_storage<1>(n) {}
+
+	float* data() { return stream(0); }
+	float const* data() const { return stream(0); }
+
+	float& operator [] (size_t i) { return stream(0)[i]; }
+	float operator [] (size_t i) const { return stream(0)[i]; }
+};
+
+struct vec3_soa : detail::soa_storage<3>
+{
+	vec3_soa() {}
+	explicit vec3_soa(size_t n) : detail::soa_storage<3>(n) {}
+
+	float* x() { return stream(0); }
+	float* y() { return stream(1); }
+	float* z() { return stream(2); }
+	float const* x() const { return stream(0); }
+	float const* y() const { return stream(1); }
+	float const* z() const { return stream(2); }
+
+	vec3 get(size_t i) const
+	{
+		return vec3(x()[i], y()[i], z()[i]);
+	}
+
+	void set(size_t i, vec3 const& v)
+	{
+		x()[i] = v.x;
+		y()[i] = v.y;
+		z()[i] = v.z;
+	}
+};
+
+struct vec4_soa : detail::soa_storage<4>
+{
+	vec4_soa() {}
+	explicit vec4_soa(size_t n) : detail::soa_storage<4>(n) {}
+
+	float* x() { return stream(0); }
+	float* y() { return stream(1); }
+	float* z() { return stream(2); }
+	float* w() { return stream(3); }
+	float const* x() const { return stream(0); }
+	float const* y() const { return stream(1); }
+	float const* z() const { return stream(2); }
+	float const* w() const { return stream(3); }
+
+	vec4 get(size_t i) const
+	{
+		return vec4(x()[i], y()[i], z()[i], w()[i]);
+	}
+
+	void set(size_t i, vec4 const& v)
+	{
+		x()[i] = v.x;
+		y()[i] = v.y;
+		z()[i] = v.z;
+		w()[i] = v.w;
+	}
+};
+
+// Whole-array kernels. Operands must have the same size; out is resized to
+// match and may alias any operand. Per element they compute exactly what the
+// vec3/vec4 functions of the same name compute (see mat4.hpp for the FMA caveat).
+
+namespace detail
+{
+
+typedef simd::floatn pack;
+
+template <size_t N>
+inline void load(soa_storage<N> const& s, size_t i, pack* v)
+{
+	for (size_t k = 0; k < N; ++k)
+	{
+		v[k] = simd::load<pack>(s.stream(k) + i);
+	}
+}
+
+template <size_t N>
+inline void store(soa_storage<N>& s, size_t i, pack const* v)
+{
+	for (size_t k = 0; k < N; ++k)
+	{
+		simd::store(s.stream(k) + i, v[k]);
+	}
+}
+
+template <size_t N>
+inline pack dot(pack const* a, pack const* b)
+{
+	pack d = simd::mul(a[0], b[0]);
+	for (size_t k = 1; k < N; ++k)
+	{
+		d = simd::madd(a[k], b[k], d);
+	}
+	return d;
+}
+
+template <size_t N, typename F>
+inline void unary(soa_storage<N> const& a, soa_storage<N>& out, F f)
+{
+	out.resize(a.size());
+	for (size_t i = 0, n = a.padded_size(); i < n; i += simd::width)
+	{
+		pack v[N];
+		load(a, i, v);
+		f(v);
+		store(out, i, v);
+	}
+}
+
+template <size_t N, typename F>
+inline void binary(soa_storage<N> const& a, soa_storage<N> const& b, soa_storage<N>& out, F f)
+{
+	out.resize(a.size());
+	for (size_t i = 0, n = a.padded_size(); i < n; i += simd::width)
+	{
+		pack u[N], v[N];
+		load(a, i, u);
+		load(b, i, v);
+		f(u, v);
+		store(out, i, u);
+	}
+}
+
+template <size_t N>
+inline void dot(soa_storage<N> const& a, soa_storage<N> const& b, scalar_soa& out)
+{
+	out.resize(a.size());
+	for (size_t i = 0, n = a.padded_size(); i < n; i += simd::width)
+	{
+		pack u[N], v[N];
+		load(a, i, u);
+		load(b, i, v);
+		simd::store(out.data() + i, dot<N>(u, v));
+	}
+}
+
+template <size_t N>
+inline void length(soa_storage<N> const& a, scalar_soa& out)
+{
+	out.resize(a.size());
+	for (size_t i = 0, n = a.padded_size(); i < n; i += simd::width)
+	{
+		pack v[N];
+		load(a, i, v);
+		simd::store(out.data() + i, simd::sqrt(dot<N>(v, v)));
+	}
+}
+
+template <size_t N>
+struct add_op
+{
+	void operator () (pack* u, pack const* v) const
+	{
+		for (size_t k = 0; k < N; ++k)
+		{
+			u[k] = simd::add(u[k], v[k]);
+		}
+	}
+};
+
+template <size_t N>
+struct sub_op
+{
+	void operator () (pack* u, pack const* v) const
+	{
+		for (size_t k = 0; k < N; ++k)
+		{
+			u[k] = simd::sub(u[k], v[k]);
+		}
+	}
+};
+
+template <size_t N>
+struct mul_op
+{
+	void operator () (pack* u, pack const* v) const
+	{
+		for (size_t k = 0; k < N; ++k)
+		{
+			u[k] = simd::mul(u[k], v[k]);
+		}
+	}
+};
+
+template <size_t N>
+struct scale_op
+{
+	pack s;
+	void operator () (pack* u) const
+	{
+		for (size_t k = 0; k < N; ++k)
+		{
+			u[k] = simd::mul(u[k], s);
+		}
+	}
+};
+
+template <size_t N>
+struct min_op
+{
+	void operator () (pack* u, pack const* v) const
+	{
+		for (size_t k = 0; k < N; ++k)
+		{
+			u[k] = simd::min(u[k], v[k]);
+		}
+	}
+};
+
+template <size_t N>
+struct max_op
+{
+	void operator () (pack* u, pack const* v) const
+	{
+		for (size_t k = 0; k < N; ++k)
+		{
+			u[k] = simd::max(u[k], v[k]);
+		}
+	}
+};
+
+template <size_t N>
+struct abs_op
+{
+	void operator () (pack* u) const
+	{
+		for (size_t k = 0; k < N; ++k)
+		{
+			u[k] = simd::abs(u[k]);
+		}
+	}
+};
+
+template <size_t N, precision Q>
+struct normalize_op
+{
+	void operator () (pack* u) const
+	{
+		pack const i = rsqrt<Q>(dot<N>(u, u));
+		for (size_t k = 0; k < N; ++k)
+		{
+			u[k] = simd::mul(u[k], i);
+		}
+	}
+};
+
+template <size_t N>
+struct mix_op
+{
+	pack t;
+	void operator () (pack* u, pack const* v) const
+	{
+		for (size_t k = 0; k < N; ++k)
+		{
+			u[k] = simd::add(u[k], simd::mul(simd::sub(v[k], u[k]), t));
+		}
+	}
+};
+
+// i - n * dot(n, i) * 2, with i in u
+template <size_t N>
+struct reflect_op
+{
+	void operator () (pack* u, pack const* v) const
+	{
+		pack const d = simd::mul(dot<N>(v, u), simd::splat<pack>(2));
+		for (size_t k = 0; k < N; ++k)
+		{
+			u[k] = simd::sub(u[k], simd::mul(v[k], d));
+		}
+	}
+};
+
+}
+
+inline void add(vec3_soa const& a, vec3_soa const& b, vec3_soa& out)
+{
+	detail::binary(a, b, out, detail::add_op<3>());
+}
+
+inline void sub(vec3_soa const& a, vec3_soa const& b, vec3_soa& out)
+{
+	detail::binary(a, b, out, detail::sub_op<3>());
+}
+
+inline void mul(vec3_soa const& a, vec3_soa const& b, vec3_soa& out)
+{
+	detail::binary(a, b, out, detail::mul_op<3>());
+}
+
+inline void min(vec3_soa const& a, vec3_soa const& b, vec3_soa& out)
+{
+	detail::binary(a, b, out, detail::min_op<3>());
+}
+
+inline void max(vec3_soa const& a, vec3_soa const& b, vec3_soa& out)
+{
+	detail::binary(a, b, out, detail::max_op<3>());
+}
+
+inline void abs(vec3_soa const& a, vec3_soa& out)
+{
+	detail::unary(a, out, detail::abs_op<3>());
+}
+
+inline void dot(vec3_soa const& a, vec3_soa const& b, scalar_soa& out)
+{
+	detail::dot(a, b, out);
+}
+
+inline void length(vec3_soa const& a, scalar_soa& out)
+{
+	detail::length(a, out);
+}
+
+template <precision Q = default_precision>
+inline void normalize(vec3_soa const& a, vec3_soa& out)
+{
+	detail::unary(a, out, detail::normalize_op<3, Q>());
+}
+
+inline void reflect(vec3_soa const& i, vec3_soa const& n, vec3_soa& out)
+{
+	detail::binary(i, n, out, detail::reflect_op<3>());
+}
+
+inline void mul(vec3_soa const& a, float s, vec3_soa& out)
+{
+	detail::scale_op<3> op = { simd::splat<detail::pack>(s) };
+	detail::unary(a, out, op);
+}
+
+inline void mix(vec3_soa const& a, vec3_soa const& b, float t, vec3_soa& out)
+{
+	detail::mix_op<3> op = { simd::splat<detail::pack>(t) };
+	detail::binary(a, b, out, op);
+}
+
+inline void cross(vec3_soa const& a, vec3_soa const& b, vec3_soa& out)
+{
+	out.resize(a.size());
+	for (size_t i = 0, n = a.padded_size(); i < n; i += simd::width)
+	{
+		detail::pack u[3], v[3], c[3];
+		detail::load(a, i, u);
+		detail::load(b, i, v);
+		c[0] = simd::sub(simd::mul(u[1], v[2]), simd::mul(u[2], v[1]));
+		c[1] = simd::sub(simd::mul(u[2], v[0]), simd::mul(u[0], v[2]));
+		c[2] = simd::sub(simd::mul(u[0], v[1]), simd::mul(u[1], v[0]));
+		detail::store(out, i, c);
+	}
+}
+
+inline void add(vec4_soa const& a, vec4_soa const& b, vec4_soa& out)
+{
+	detail::binary(a, b, out, detail::add_op<4>());
+}
+
+inline void sub(vec4_soa const& a, vec4_soa const& b, vec4_soa& out)
+{
+	detail::binary(a, b, out, detail::sub_op<4>());
+}
+
+inline void mul(vec4_soa const& a, vec4_soa const& b, vec4_soa& out)
+{
+	detail::binary(a, b, out, detail::mul_op<4>());
+}
+
+inline void min(vec4_soa const& a, vec4_soa const& b, vec4_soa& out)
+{
+	detail::binary(a, b, out, detail::min_op<4>());
+}
+
+inline void max(vec4_soa const& a, vec4_soa const& b, vec4_soa& out)
+{
+	detail::binary(a, b, out, detail::max_op<4>());
+}
+
+inline void abs(vec4_soa const& a, vec4_soa& out)
+{
+	detail::unary(a, out, detail::abs_op<4>());
+}
+
+inline void dot(vec4_soa const& a, vec4_soa const& b, scalar_soa& out)
+{
+	detail::dot(a, b, out);
+}
+
+inline void length(vec4_soa const& a, scalar_soa& out)
+{
+	detail::length(a, out);
+}
+
+template <precision Q = default_precision>
+inline void normalize(vec4_soa const& a, vec4_soa& out)
+{
+	detail::unary(a, out, detail::normalize_op<4, Q>());
+}
+
+inline void reflect(vec4_soa const& i, vec4_soa const& n, vec4_soa& out)
+{
+	detail::binary(i, n, out, detail::reflect_op<4>());
+}
+
+inline void mul(vec4_soa const& a, float s, vec4_soa& out)
+{
+	detail::scale_op<4> op = { simd::splat<detail::pack>(s) };
+	detail::unary(a, out, op);
+}
+
+inline void mix(vec4_soa const& a, vec4_soa const& b, float t, vec4_soa& out)
+{
+	detail::mix_op<4> op = { simd::splat<detail::pack>(t) };
+	detail::binary(a, b, out, op);
+}
+
+// AoS <-> SoA conversion.
+
+inline void to_soa(vec3 const* in, size_t n, vec3_soa& out)
+{
+	out.resize(n);
+	float* const x = out.x();
+	float* const y = out.y();
+	float* const z = out.z();
+	size_t i = 0;
+#if defined(XXX_SSE)
+	for (; i + 4 <= n; i += 4)
+	{
+		simd::float4 a, b, c;
+		simd::load3(&in[i].x, a, b, c);
+		simd::store(x + i, a);
+		simd::store(y + i, b);
+		simd::store(z + i, c);
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		x[i] = in[i].x;
+		y[i] = in[i].y;
+		z[i] = in[i].z;
+	}
+}
+
+inline void to_aos(vec3_soa const& in, vec3* out)
+{
+	float const* const x = in.x();
+	float const* const y = in.y();
+	float const* const z = in.z();
+	size_t const n = in.size();
+	size_t i = 0;
+#if defined(XXX_SSE)
+	for (; i + 4 <= n; i += 4)
+	{
+		simd::store3(&out[i].x, simd::load(x + i), simd::load(y + i), simd::load(z + i));
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = vec3(x[i], y[i], z[i]);
+	}
+}
+
+inline void to_soa(vec4 const* in, size_t n, vec4_soa& out)
+{
+	out.resize(n);
+	float* const x = out.x();
+	float* const y = out.y();
+	float* const z = out.z();
+	float* const w = out.w();
+	size_t i = 0;
+#if defined(XXX_SSE)
+	for (; i + 4 <= n; i += 4)
+	{
+		simd::float4 a = simd::load(&in[i].x);
+		simd::float4 b = simd::load(&in[i + 1].x);
+		simd::float4 c = simd::load(&in[i + 2].x);
+		simd::float4 d = simd::load(&in[i + 3].x);
+		simd::transpose(a, b, c, d);
+		simd::store(x + i, a);
+		simd::store(y + i, b);
+		simd::store(z + i, c);
+		simd::store(w + i, d);
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		x[i] = in[i].x;
+		y[i] = in[i].y;
+		z[i] = in[i].z;
+		w[i] = in[i].w;
+	}
+}
+
+inline void to_aos(vec4_soa const& in, vec4* out)
+{
+	float const* const x = in.x();
+	float const* const y = in.y();
+	float const* const z = in.z();
+	float const* const w = in.w();
+	size_t const n = in.size();
+	size_t i = 0;
+#if defined(XXX_SSE)
+	for (; i + 4 <= n; i += 4)
+	{
+		simd::float4 a = simd::load(x + i);
+		simd::float4 b = simd::load(y + i);
+		simd::float4 c = simd::load(z + i);
+		simd::float4 d = simd::load(w + i);
+		simd::transpose(a, b, c, d);
+		simd::store(&out[i].x, a);
+		simd::store(&out[i + 1].x, b);
+		simd::store(&out[i + 2].x, c);
+		simd::store(&out[i + 3].x, d);
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		out[i] = vec4(x[i], y[i], z[i], w[i]);
+	}
+}
+
+}
+
+#endif
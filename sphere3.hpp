@@ -0,0 +1,323 @@
+#ifndef SPHERE3_H
+#define SPHERE3_H
+
+#include <stddef.h>
+
+#include "vec3.hpp"
+#include "mat4.hpp"
+#include "affine3.hpp"
+#include "transform.hpp"
+#include "aabb3.hpp"
+#include "soa.hpp"
+#include "executor.hpp"
+#include "simd.hpp"
+
+namespace xxx
+{
+
+// Ball around center, radius inclusive. A negative radius contains nothing;
+// empty() is the one that merges into anything without changing it.
+template <typename T>
+struct basic_sphere3
+{
+	typedef T value_type;
+
+	basic_vec3<T> center;
+	T radius;
+
+	basic_sphere3() = default;
+	explicit constexpr basic_sphere3(basic_vec3<T> const& center, T radius) : center(center), radius(radius) {}
+	template <typename U>
+	explicit constexpr basic_sphere3(basic_sphere3<U> const& s) : center(s.center), radius(static_cast<T>(s.radius)) {}
+
+	// The sphere around b's corners.
+	explicit basic_sphere3(basic_aabb3<T> const& b)
+		: center(b.center()), radius(b.is_empty() ? -1 : length(b.extent()))
+	{
+	}
+
+	constexpr bool is_empty() const
+	{
+		return radius < 0;
+	}
+
+	basic_aabb3<T> to_aabb3() const
+	{
+		return is_empty() ? basic_aabb3<T>::empty() : basic_aabb3<T>(center - radius, center + radius);
+	}
+
+	static constexpr basic_sphere3 empty()
+	{
+		return basic_sphere3(basic_vec3<T>(0), -1);
+	}
+};
+
+typedef basic_sphere3<scalar_t> sphere3;
+typedef basic_sphere3<double> dsphere3;
+
+// The smallest sphere containing both.
+template <typename T>
+inline basic_sphere3<T> merge(basic_sphere3<T> const& a, basic_sphere3<T> const& b)
+{
+	if (a.is_empty())
+	{
+		return b;
+	}
+	if (b.is_empty())
+	{
+		return a;
+	}
+	T const d = distance(a.center, b.center);
+	if (d + b.radius <= a.radius)
+	{
+		return a;
+	}
+	if (d + a.radius <= b.radius)
+	{
+		return b;
+	}
+	T const r = (d + a.radius + b.radius) * static_cast<T>(0.5);
+	return basic_sphere3<T>(a.center + (b.center - a.center) * ((r - a.radius) / d), r);
+}
+
+template <typename T>
+inline basic_sphere3<T> merge(basic_sphere3<T> const& a, basic_vec3<T> const& p)
+{
+	return merge(a, basic_sphere3<T>(p, 0));
+}
+
+// A sphere around the lens where a and b overlap: the one through the circle
+// where their surfaces meet, or the smaller input where that is smaller or
+// the lens holds more than half of it. Empty where they are disjoint.
+template <typename T>
+inline basic_sphere3<T> intersection(basic_sphere3<T> const& a, basic_sphere3<T> const& b)
+{
+	if (a.is_empty() || b.is_empty())
+	{
+		return basic_sphere3<T>::empty();
+	}
+	T const d = distance(a.center, b.center);
+	if (d > a.radius + b.radius)
+	{
+		return basic_sphere3<T>::empty();
+	}
+	basic_sphere3<T> const& smaller = a.radius < b.radius ? a : b;
+	if (d + smaller.radius <= (a.radius < b.radius ? b.radius : a.radius))
+	{
+		return smaller;
+	}
+
+	// Distance of the circle's plane from a.center.
+	T const x = (d * d + a.radius * a.radius - b.radius * b.radius) / (2 * d);
+	if (x <= 0 || x >= d)
+	{
+		return smaller;
+	}
+	T const h = sqrt(a.radius * a.radius - x * x);
+	return h < smaller.radius ? basic_sphere3<T>(a.center + (b.center - a.center) * (x / d), h) : smaller;
+}
+
+template <typename T>
+inline bool overlaps(basic_sphere3<T> const& a, basic_sphere3<T> const& b)
+{
+	if (a.is_empty() || b.is_empty())
+	{
+		return false;
+	}
+	T const r = a.radius + b.radius;
+	basic_vec3<T> const v = b.center - a.center;
+	return dot(v, v) <= r * r;
+}
+
+template <typename T>
+inline bool contains(basic_sphere3<T> const& s, basic_vec3<T> const& p)
+{
+	basic_vec3<T> const v = p - s.center;
+	return dot(v, v) <= s.radius * s.radius && !s.is_empty();
+}
+
+// The center is transformed and the radius scaled by a bound on the largest
+// stretch of the linear part: the largest row sum of the absolute dot products
+// of its axes (Gershgorin's bound on the eigenvalues of its Gram matrix), which
+// is the longest axis where the axes are orthogonal, as under rotation and
+// per-axis scale, and grows with shear.
+template <typename T>
+inline basic_sphere3<T> transform_bounds(basic_affine3<T> const& m, basic_sphere3<T> const& s)
+{
+	if (s.is_empty())
+	{
+		return s;
+	}
+	T const xy = abs(dot(m.x, m.y));
+	T const xz = abs(dot(m.x, m.z));
+	T const yz = abs(dot(m.y, m.z));
+	T const x = dot(m.x, m.x) + xy + xz;
+	T const y = dot(m.y, m.y) + xy + yz;
+	T const z = dot(m.z, m.z) + xz + yz;
+	T const scale = sqrt(x > y ? (x > z ? x : z) : (y > z ? y : z));
+	return basic_sphere3<T>(transform_point(m, s.center), s.radius * scale);
+}
+
+// m must be affine, with a last row of (0, 0, 0, 1).
+template <typename T>
+inline basic_sphere3<T> transform_bounds(basic_mat4<T> const& m, basic_sphere3<T> const& s)
+{
+	return transform_bounds(basic_affine3<T>(m), s);
+}
+
+template <typename T>
+inline basic_sphere3<T> transform_bounds(basic_transform<T> const& t, basic_sphere3<T> const& s)
+{
+	return s.is_empty() ? s : basic_sphere3<T>(rotate(s.center, t.rotation) + t.position, s.radius);
+}
+
+// compute_sphere: a sphere around points[0, n) or the points of a vec3_soa,
+// empty() where there are none. It is centered on their box (compute_aabb),
+// with the distance to the farthest point, rounded up so that contains() holds
+// for every point, as radius: two SIMD reductions rather than the minimal
+// sphere, and at most sqrt(3) times its radius.
+
+namespace detail
+{
+
+template <typename T>
+inline T max_distance2(basic_vec3<T> const& c, basic_vec3<T> const* p, size_t begin, size_t end)
+{
+	T r = 0;
+	for (size_t i = begin; i < end; ++i)
+	{
+		basic_vec3<T> const v = p[i] - c;
+		T const d = dot(v, v);
+		r = d > r ? d : r;
+	}
+	return r;
+}
+
+inline float max_distance2(vec3 const& c, vec3 const* p, size_t begin, size_t end)
+{
+	float r = 0;
+	size_t i = begin;
+
+#if defined(XXX_SSE)
+	if (end - i >= 4)
+	{
+		simd::float4 const cx = simd::splat<simd::float4>(c.x);
+		simd::float4 const cy = simd::splat<simd::float4>(c.y);
+		simd::float4 const cz = simd::splat<simd::float4>(c.z);
+		simd::float4 m = simd::splat<simd::float4>(0);
+		for (; i + 4 <= end; i += 4)
+		{
+			simd::float4 x, y, z;
+			simd::load3(&p[i].x, x, y, z);
+			x = simd::sub(x, cx);
+			y = simd::sub(y, cy);
+			z = simd::sub(z, cz);
+			m = simd::max(m, simd::madd(z, z, simd::madd(y, y, simd::mul(x, x))));
+		}
+		r = max_lanes(m);
+	}
+#endif
+
+	for (; i < end; ++i)
+	{
+		vec3 const v = p[i] - c;
+		float const d = dot(v, v);
+		r = d > r ? d : r;
+	}
+	return r;
+}
+
+inline float max_distance2(vec3 const& c, vec3_soa const& s, size_t begin, size_t end)
+{
+	float r = 0;
+	size_t i = begin;
+
+	if (end - i >= simd::width)
+	{
+		pack const cx = simd::splat<pack>(c.x);
+		pack const cy = simd::splat<pack>(c.y);
+		pack const cz = simd::splat<pack>(c.z);
+		pack m = simd::splat<pack>(0);
+		for (; i + simd::width <= end; i += simd::width)
+		{
+			pack const x = simd::sub(simd::load<pack>(s.x() + i), cx);
+			pack const y = simd::sub(simd::load<pack>(s.y() + i), cy);
+			pack const z = simd::sub(simd::load<pack>(s.z() + i), cz);
+			m = simd::max(m, simd::madd(z, z, simd::madd(y, y, simd::mul(x, x))));
+		}
+		r = max_lanes(m);
+	}
+
+	for (; i < end; ++i)
+	{
+		vec3 const v = s.get(i) - c;
+		float const d = dot(v, v);
+		r = d > r ? d : r;
+	}
+	return r;
+}
+
+template <typename T>
+inline T max_value(T a, T b)
+{
+	return a > b ? a : b;
+}
+
+// The radius is rounded up so that contains() holds for the farthest point,
+// and one ulp more as contains() may round its distance up where the
+// compiler contracts it into FMAs differently (see mat4.hpp).
+template <typename T>
+inline basic_sphere3<T> sphere(basic_aabb3<T> const& b, T r2)
+{
+	if (b.is_empty())
+	{
+		return basic_sphere3<T>::empty();
+	}
+	T const inf = std::numeric_limits<T>::infinity();
+	T r = sqrt(r2);
+	if (r * r < r2)
+	{
+		r = nextafter(r, inf);
+	}
+	return basic_sphere3<T>(b.center(), nextafter(r, inf));
+}
+
+}
+
+template <typename T>
+inline basic_sphere3<T> compute_sphere(basic_vec3<T> const* points, size_t n)
+{
+	basic_aabb3<T> const b = compute_aabb(points, n);
+	return detail::sphere(b, detail::max_distance2(b.center(), points, 0, n));
+}
+
+inline sphere3 compute_sphere(vec3_soa const& points)
+{
+	aabb3 const b = compute_aabb(points);
+	return detail::sphere(b, detail::max_distance2(b.center(), points, 0, points.size()));
+}
+
+// Executor forms (see executor.hpp); results are identical.
+
+template <typename T>
+inline basic_sphere3<T> compute_sphere(executor& ex, basic_vec3<T> const* points, size_t n)
+{
+	basic_aabb3<T> const b = compute_aabb(ex, points, n);
+	basic_vec3<T> const c = b.center();
+	return detail::sphere(b, parallel_reduce(ex, n, detail::parallel_grain(sizeof(*points)), T(0), [&](size_t begin, size_t end) {
+		return detail::max_distance2(c, points, begin, end);
+	}, detail::max_value<T>));
+}
+
+inline sphere3 compute_sphere(executor& ex, vec3_soa const& points)
+{
+	aabb3 const b = compute_aabb(ex, points);
+	vec3 const c = b.center();
+	return detail::sphere(b, parallel_reduce(ex, points.size(), detail::parallel_grain(3 * sizeof(float)), 0.0f, [&](size_t begin, size_t end) {
+		return detail::max_distance2(c, points, begin, end);
+	}, detail::max_value<float>));
+}
+
+}
+
+#endif
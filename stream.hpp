@@ -0,0 +1,535 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "vec3.hpp"
+#include "quaternion.hpp"
+#include "mat4.hpp"
+#include "transform.hpp"
+#include "aabb3.hpp"
+#include "quantize.hpp"
+#include "executor.hpp"
+
+namespace xxx
+{
+
+// Binary stream of float arrays: a stream_header, then any number of chunks,
+// each a stream_chunk_header and a payload of count elements of one format.
+// The headers are 64 bytes and every payload is padded to a multiple of 64, so
+// each chunk starts on a 64-byte boundary of the stream, and a stream mapped
+// at a page boundary (mapped_file.hpp) can be read in place through
+// stream_chunk::view(). Chunks carry an id of the writer's choosing; a long
+// recording can be written as many chunks with the same id.
+//
+// Everything is stored in the byte order of the writer, recorded in the
+// header. Readers of the other order get the values byte-swapped by
+// stream_chunk::read() but no view(). Element layouts are those of the types
+// (vec3 is 3 floats, transform a vec3 then a quaternion...); their sizes are
+// recorded and checked.
+
+enum class stream_format : uint32_t
+{
+	raw_vec3 = 1,
+	raw_quaternion = 2,
+	raw_mat4 = 3,
+	raw_transform = 4,
+	fixed_vec3 = 5,
+	quaternion48 = 6,
+	fixed_transform = 7
+};
+
+struct stream_header
+{
+	static uint32_t const current_version = 1;
+	static uint32_t const alignment = 64;
+
+	char magic[4];
+	uint32_t endian;
+	uint32_t version;
+	uint32_t header_size;
+	uint8_t reserved[48];
+};
+
+struct stream_chunk_header
+{
+	uint32_t format;
+	uint32_t id;
+	uint32_t element_size;
+	uint32_t reserved0;
+	uint64_t count;
+	uint64_t size;
+	// The box of fixed_vec3 and fixed_transform positions: min, then max.
+	float range[6];
+	uint8_t reserved1[8];
+};
+
+namespace detail
+{
+
+static char const stream_magic[4] = { 'X', 'M', 'S', 'F' };
+static uint32_t const stream_endian = 0x01020304;
+
+// Bytes encoded or decoded at a time on the stack.
+static size_t const stream_block = 4096;
+
+// Format, element word size and encoded form of every type a stream holds.
+template <typename T>
+struct stream_element;
+
+template <>
+struct stream_element<vec3>
+{
+	static constexpr stream_format format = stream_format::raw_vec3;
+	static size_t const word = 4;
+	typedef fixed_vec3 encoded;
+};
+
+template <>
+struct stream_element<quaternion>
+{
+	static constexpr stream_format format = stream_format::raw_quaternion;
+	static size_t const word = 4;
+	typedef quaternion48 encoded;
+};
+
+template <>
+struct stream_element<mat4>
+{
+	static constexpr stream_format format = stream_format::raw_mat4;
+	static size_t const word = 4;
+	typedef mat4 encoded;
+};
+
+template <>
+struct stream_element<transform>
+{
+	static constexpr stream_format format = stream_format::raw_transform;
+	static size_t const word = 4;
+	typedef fixed_transform encoded;
+};
+
+template <>
+struct stream_element<fixed_vec3>
+{
+	static constexpr stream_format format = stream_format::fixed_vec3;
+	static size_t const word = 2;
+};
+
+template <>
+struct stream_element<quaternion48>
+{
+	static constexpr stream_format format = stream_format::quaternion48;
+	static size_t const word = 2;
+};
+
+template <>
+struct stream_element<fixed_transform>
+{
+	static constexpr stream_format format = stream_format::fixed_transform;
+	static size_t const word = 2;
+};
+
+inline size_t stream_element_size(uint32_t format)
+{
+	switch (static_cast<stream_format>(format))
+	{
+	case stream_format::raw_vec3:
+		return sizeof(vec3);
+	case stream_format::raw_quaternion:
+		return sizeof(quaternion);
+	case stream_format::raw_mat4:
+		return sizeof(mat4);
+	case stream_format::raw_transform:
+		return sizeof(transform);
+	case stream_format::fixed_vec3:
+		return sizeof(fixed_vec3);
+	case stream_format::quaternion48:
+		return sizeof(quaternion48);
+	case stream_format::fixed_transform:
+		return sizeof(fixed_transform);
+	default:
+		return 0;
+	}
+}
+
+// Reverses the bytes of every word of the given size.
+inline void swap_bytes(void* data, size_t size, size_t word)
+{
+	unsigned char* const p = static_cast<unsigned char*>(data);
+	for (size_t i = 0; i + word <= size; i += word)
+	{
+		for (size_t a = i, b = i + word - 1; a < b; ++a, --b)
+		{
+			unsigned char const t = p[a];
+			p[a] = p[b];
+			p[b] = t;
+		}
+	}
+}
+
+inline void stream_decode(fixed_vec3 const* in, aabb3 const& range, vec3* out, size_t n)
+{
+	decode_n(in, range, out, n);
+}
+
+inline void stream_decode(quaternion48 const* in, aabb3 const&, quaternion* out, size_t n)
+{
+	decode_n(in, out, n);
+}
+
+inline void stream_decode(fixed_transform const* in, aabb3 const& range, transform* out, size_t n)
+{
+	decode_n(in, range, out, n);
+}
+
+inline void stream_decode(mat4 const* in, aabb3 const&, mat4* out, size_t n)
+{
+	memcpy(out, in, n * sizeof(mat4));
+}
+
+}
+
+// Appends a stream to a file, from where it is positioned, or to a byte
+// vector. Writes go straight through, chunk by chunk; good() turns false
+// after the first one that fails, and every write after it does nothing.
+class stream_writer
+{
+public:
+	explicit stream_writer(FILE* f) : file(f), bytes(0), offset(0), ok(true)
+	{
+		write_header();
+	}
+
+	explicit stream_writer(std::vector<unsigned char>& out) : file(0), bytes(&out), offset(0), ok(true)
+	{
+		write_header();
+	}
+
+	bool good() const
+	{
+		return ok;
+	}
+
+	// Bytes written so far.
+	uint64_t size() const
+	{
+		return offset;
+	}
+
+	// Writes data[0, n) as they are, as a chunk of the format of T, one of
+	// vec3, quaternion, mat4, transform or the encodings of quantize.hpp.
+	// range is the one fixed_vec3 and fixed_transform were encoded with.
+	template <typename T>
+	bool write(uint32_t id, T const* data, size_t n, aabb3 const& range = aabb3(vec3(0), vec3(0)))
+	{
+		begin_chunk(detail::stream_element<T>::format, id, sizeof(T), n, range);
+		put(data, n * sizeof(T));
+		return end_chunk(n * sizeof(T));
+	}
+
+	// Quantizing forms: write data[0, n) encoded as fixed_vec3, quaternion48
+	// or fixed_transform (quantize.hpp), over range, or over the bounds of the
+	// positions where there is none. Readers decode them back with
+	// stream_chunk::read().
+	bool write_quantized(uint32_t id, vec3 const* data, size_t n, aabb3 const& range)
+	{
+		return write_encoded<fixed_vec3>(id, data, n, range);
+	}
+
+	bool write_quantized(uint32_t id, vec3 const* data, size_t n)
+	{
+		return write_quantized(id, data, n, compute_aabb(data, n));
+	}
+
+	bool write_quantized(uint32_t id, quaternion const* data, size_t n)
+	{
+		return write_encoded<quaternion48>(id, data, n, aabb3(vec3(0), vec3(0)));
+	}
+
+	bool write_quantized(uint32_t id, transform const* data, size_t n, aabb3 const& range)
+	{
+		return write_encoded<fixed_transform>(id, data, n, range);
+	}
+
+	bool write_quantized(uint32_t id, transform const* data, size_t n)
+	{
+		aabb3 range = aabb3::empty();
+		for (size_t i = 0; i < n; ++i)
+		{
+			range = merge(range, data[i].position);
+		}
+		return write_quantized(id, data, n, range);
+	}
+
+private:
+	FILE* file;
+	std::vector<unsigned char>* bytes;
+	uint64_t offset;
+	bool ok;
+
+	void put(void const* data, size_t size)
+	{
+		if (!ok || size == 0)
+		{
+			return;
+		}
+		if (file)
+		{
+			ok = fwrite(data, 1, size, file) == size;
+		}
+		else
+		{
+			unsigned char const* const p = static_cast<unsigned char const*>(data);
+			bytes->insert(bytes->end(), p, p + size);
+		}
+		offset += size;
+	}
+
+	void write_header()
+	{
+		stream_header h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, detail::stream_magic, sizeof(h.magic));
+		h.endian = detail::stream_endian;
+		h.version = stream_header::current_version;
+		h.header_size = sizeof(stream_header);
+		put(&h, sizeof(h));
+	}
+
+	void begin_chunk(stream_format format, uint32_t id, size_t element_size, size_t n, aabb3 const& range)
+	{
+		uint64_t const size = (static_cast<uint64_t>(n) * element_size + stream_header::alignment - 1) / stream_header::alignment * stream_header::alignment;
+		stream_chunk_header h;
+		memset(&h, 0, sizeof(h));
+		h.format = static_cast<uint32_t>(format);
+		h.id = id;
+		h.element_size = static_cast<uint32_t>(element_size);
+		h.count = n;
+		h.size = size;
+		memcpy(h.range, &range.min.x, 3 * sizeof(float));
+		memcpy(h.range + 3, &range.max.x, 3 * sizeof(float));
+		put(&h, sizeof(h));
+	}
+
+	// Pads the payload of used bytes to the alignment.
+	bool end_chunk(size_t used)
+	{
+		static unsigned char const zero[stream_header::alignment] = {};
+		put(zero, (stream_header::alignment - used % stream_header::alignment) % stream_header::alignment);
+		return ok;
+	}
+
+	template <typename E, typename T>
+	bool write_encoded(uint32_t id, T const* data, size_t n, aabb3 const& range)
+	{
+		begin_chunk(detail::stream_element<E>::format, id, sizeof(E), n, range);
+		E buffer[detail::stream_block / sizeof(E)];
+		size_t const block = sizeof(buffer) / sizeof(E);
+		for (size_t i = 0; i < n && ok; i += block)
+		{
+			size_t const m = n - i < block ? n - i : block;
+			encode(data + i, range, buffer, m);
+			put(buffer, m * sizeof(E));
+		}
+		return end_chunk(n * sizeof(E));
+	}
+
+	static void encode(vec3 const* in, aabb3 const& range, fixed_vec3* out, size_t n)
+	{
+		encode_n(in, range, out, n);
+	}
+
+	static void encode(quaternion const* in, aabb3 const&, quaternion48* out, size_t n)
+	{
+		encode_n(in, out, n);
+	}
+
+	static void encode(transform const* in, aabb3 const& range, fixed_transform* out, size_t n)
+	{
+		encode_n(in, range, out, n);
+	}
+};
+
+// One chunk of a stream, as stream_reader::next() finds it.
+struct stream_chunk
+{
+	stream_format format;
+	uint32_t id;
+	size_t count;
+	aabb3 range;
+	// The payload, count elements of format in the byte order of the writer.
+	void const* data;
+	bool swapped;
+
+	// The payload as count elements of T, read in place: null unless the
+	// chunk holds T in this machine's byte order and data is aligned for it.
+	template <typename T>
+	T const* view() const
+	{
+		if (format != detail::stream_element<T>::format || swapped || reinterpret_cast<uintptr_t>(data) % alignof(T) != 0)
+		{
+			return 0;
+		}
+		return static_cast<T const*>(data);
+	}
+
+	// Copies elements [begin, end) to out, one of vec3, quaternion, mat4 or
+	// transform, byte-swapped where the stream is of the other byte order and
+	// decoded where the chunk holds their encoding (stream_writer::
+	// write_quantized). Returns false and copies nothing where the chunk holds
+	// neither T nor its encoding.
+	template <typename T>
+	bool read(T* out, size_t begin, size_t end) const
+	{
+		typedef typename detail::stream_element<T>::encoded E;
+		if (format == detail::stream_element<T>::format)
+		{
+			memcpy(out, static_cast<unsigned char const*>(data) + begin * sizeof(T), (end - begin) * sizeof(T));
+			if (swapped)
+			{
+				detail::swap_bytes(out, (end - begin) * sizeof(T), detail::stream_element<T>::word);
+			}
+			return true;
+		}
+		if (format != detail::stream_element<E>::format)
+		{
+			return false;
+		}
+
+		E buffer[detail::stream_block / sizeof(E)];
+		size_t const block = sizeof(buffer) / sizeof(E);
+		for (size_t i = begin; i < end; i += block)
+		{
+			size_t const m = end - i < block ? end - i : block;
+			memcpy(buffer, static_cast<unsigned char const*>(data) + i * sizeof(E), m * sizeof(E));
+			if (swapped)
+			{
+				detail::swap_bytes(buffer, m * sizeof(E), detail::stream_element<E>::word);
+			}
+			detail::stream_decode(buffer, range, out + (i - begin), m);
+		}
+		return true;
+	}
+
+	template <typename T>
+	bool read(T* out) const
+	{
+		return read(out, 0, count);
+	}
+
+	// Executor form (see executor.hpp); results are identical.
+	template <typename T>
+	bool read(executor& ex, T* out) const
+	{
+		typedef typename detail::stream_element<T>::encoded E;
+		if (format != detail::stream_element<T>::format && format != detail::stream_element<E>::format)
+		{
+			return false;
+		}
+		parallel_for(ex, count, detail::parallel_grain(sizeof(E) + sizeof(T)), [&](size_t begin, size_t end) {
+			read(out + begin, begin, end);
+		});
+		return true;
+	}
+};
+
+// Reads a stream from memory, such as a mapped_file (mapped_file.hpp), chunk
+// by chunk; the chunks point into that memory. valid() tells whether it starts
+// with a stream header this reader understands. next() stops at the end of
+// the data, and also at the first chunk that does not fit in it or has a
+// format or element size that does not match this build; complete() tells
+// these apart.
+class stream_reader
+{
+public:
+	stream_reader(void const* data, size_t size) : base(static_cast<unsigned char const*>(data)), length(size), offset(0), swapped(false), ok(false)
+	{
+		stream_header h;
+		if (size < sizeof(h))
+		{
+			return;
+		}
+		memcpy(&h, data, sizeof(h));
+		if (memcmp(h.magic, detail::stream_magic, sizeof(h.magic)) != 0)
+		{
+			return;
+		}
+		swapped = h.endian != detail::stream_endian;
+		if (swapped)
+		{
+			detail::swap_bytes(&h.endian, 3 * sizeof(uint32_t), sizeof(uint32_t));
+		}
+		if (h.endian != detail::stream_endian || h.version == 0 || h.version > stream_header::current_version || h.header_size != sizeof(h))
+		{
+			return;
+		}
+		offset = sizeof(h);
+		ok = true;
+	}
+
+	bool valid() const
+	{
+		return ok;
+	}
+
+	// Whether the stream is in the other byte order than this machine.
+	bool is_swapped() const
+	{
+		return swapped;
+	}
+
+	// Whether next() has reached the end of the data.
+	bool complete() const
+	{
+		return ok && offset == length;
+	}
+
+	// Moves to the next chunk and describes it in c; false where there is none
+	// (see above).
+	bool next(stream_chunk& c)
+	{
+		stream_chunk_header h;
+		if (!ok || length - offset < sizeof(h))
+		{
+			return false;
+		}
+		memcpy(&h, base + offset, sizeof(h));
+		if (swapped)
+		{
+			detail::swap_bytes(&h.format, 4 * sizeof(uint32_t), sizeof(uint32_t));
+			detail::swap_bytes(&h.count, 2 * sizeof(uint64_t), sizeof(uint64_t));
+			detail::swap_bytes(h.range, sizeof(h.range), sizeof(float));
+		}
+		uint64_t const available = length - offset - sizeof(h);
+		if (h.element_size == 0 || h.element_size != detail::stream_element_size(h.format) || h.size > available || h.size % stream_header::alignment != 0 || h.count > h.size / h.element_size)
+		{
+			return false;
+		}
+
+		c.format = static_cast<stream_format>(h.format);
+		c.id = h.id;
+		c.count = static_cast<size_t>(h.count);
+		c.range = aabb3(vec3(h.range[0], h.range[1], h.range[2]), vec3(h.range[3], h.range[4], h.range[5]));
+		c.data = base + offset + sizeof(h);
+		c.swapped = swapped;
+		offset += sizeof(h) + static_cast<size_t>(h.size);
+		return true;
+	}
+
+private:
+	unsigned char const* base;
+	size_t length;
+	size_t offset;
+	bool swapped;
+	bool ok;
+};
+
+}
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "executor.hpp"
+
+namespace xxx
+{
+
+// Work-stealing executor on std::thread. The calling thread takes part in
+// run(): each of the concurrency() threads starts on its own contiguous share
+// of the indices and, once that is done, steals the remaining indices of the
+// others one at a time. Needs the platform thread library (Threads::Threads
+// in CMake).
+//
+// Concurrent calls to run() are serialized; a run() made from inside a task
+// executes on the calling thread.
+class thread_pool : public executor
+{
+public:
+	// concurrency counts the calling thread; 0 uses every hardware thread.
+	explicit thread_pool(size_t concurrency = 0)
+		: slots(new slot[concurrency ? concurrency : hardware_concurrency()])
+		, slot_count(concurrency ? concurrency : hardware_concurrency())
+		, task(0)
+		, context(0)
+		, generation(0)
+		, active(0)
+		, stop(false)
+	{
+		for (size_t i = 0; i < slot_count; ++i)
+		{
+			slots[i].next.store(0, std::memory_order_relaxed);
+			slots[i].end = 0;
+		}
+		for (size_t i = 1; i < slot_count; ++i)
+		{
+			workers.push_back(std::thread(&thread_pool::worker, this, i));
+		}
+	}
+
+	~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); ++i)
+		{
+			workers[i].join();
+		}
+	}
+
+	thread_pool(thread_pool const&) = delete;
+	thread_pool& operator = (thread_pool const&) = delete;
+
+	void run(size_t count, void (*f)(void*, size_t), void* c)
+	{
+		if (workers.empty() || count == 1 || current() == this)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				f(c, i);
+			}
+			return;
+		}
+		if (count == 0)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> serial(submit);
+
+		for (size_t i = 0; i < slot_count; ++i)
+		{
+			slots[i].next.store(count * i / slot_count, std::memory_order_relaxed);
+			slots[i].end = count * (i + 1) / slot_count;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			task = f;
+			context = c;
+			active = workers.size();
+			++generation;
+		}
+		wake.notify_all();
+
+		thread_pool* const outer = current();
+		current() = this;
+		work(0);
+		current() = outer;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return active == 0; });
+	}
+
+	size_t concurrency() const
+	{
+		return slot_count;
+	}
+
+	static size_t hardware_concurrency()
+	{
+		unsigned const n = std::thread::hardware_concurrency();
+		return n ? n : 1;
+	}
+
+private:
+	// Padded so the counters of different threads do not share a cache line.
+	struct slot
+	{
+		std::atomic<size_t> next;
+		size_t end;
+		char padding[64];
+	};
+
+	static thread_pool*& current()
+	{
+		static thread_local thread_pool* pool = 0;
+		return pool;
+	}
+
+	void work(size_t self)
+	{
+		for (size_t k = 0; k < slot_count; ++k)
+		{
+			slot& s = slots[(self + k) % slot_count];
+			for (;;)
+			{
+				size_t const i = s.next.fetch_add(1, std::memory_order_relaxed);
+				if (i >= s.end)
+				{
+					break;
+				}
+				task(context, i);
+			}
+		}
+	}
+
+	void worker(size_t self)
+	{
+		current() = this;
+		size_t seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return stop || generation != seen; });
+				if (stop)
+				{
+					return;
+				}
+				seen = generation;
+			}
+
+			work(self);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--active == 0)
+			{
+				done.notify_one();
+			}
+		}
+	}
+
+	std::unique_ptr<slot[]> slots;
+	size_t const slot_count;
+	std::vector<std::thread> workers;
+
+	std::mutex submit;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	void (*task)(void*, size_t);
+	void* context;
+	size_t generation;
+	size_t active;
+	bool stop;
+};
+
+}
+
+#endif
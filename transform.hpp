@@ -1,60 +1,62 @@
 #ifndef TRANSFORM_H
 #define TRANSFORM_H
 
-#include "vec3.h"
-#include "quaternion.h"
-#include "mat4.h"
+#include "vec3.hpp"
+#include "quaternion.hpp"
+#include "mat4.hpp"
 
 namespace xxx
 {
 
-struct transform
+template <typename T>
+struct basic_transform
 {
-	vec3       position;
-	quaternion rotation;
+	typedef T value_type;
 
-	transform()
-	{
-		position = vec3(0, 0, 0);
-		rotation = quaternion::identity();
-	}
+	basic_vec3<T>       position;
+	basic_quaternion<T> rotation;
 
-	explicit transform(vec3 const& v, quaternion const& q)
-	{
-		position = v;
-		rotation = q;
-	}
+	constexpr basic_transform() : position(0, 0, 0), rotation(basic_quaternion<T>::identity()) {}
+	explicit constexpr basic_transform(basic_vec3<T> const& v, basic_quaternion<T> const& q) : position(v), rotation(q) {}
+	template <typename U>
+	explicit constexpr basic_transform(basic_transform<U> const& t) : position(t.position), rotation(t.rotation) {}
 
-	mat4 model_matrix() const
+	basic_mat4<T> model_matrix() const
 	{
-		return mat4(rotation.to_matrix(), vec4(position, 1));
+		return basic_mat4<T>(rotation.to_matrix(), basic_vec4<T>(position, 1));
 	}
 
-	mat4 view_matrix() const
+	basic_mat4<T> view_matrix() const
 	{
-		mat4 p = mat4::identity();
+		basic_mat4<T> p = basic_mat4<T>::identity();
 		p.w.x = -position.x;
 		p.w.y = -position.y;
 		p.w.z = -position.z;
-		mat4 r = mat4(rotation.to_matrix(), vec4(0, 0, 0, 1));
+		basic_mat4<T> r = basic_mat4<T>(rotation.to_matrix(), basic_vec4<T>(0, 0, 0, 1));
 		return p * r;
 	}
 };
 
-inline transform inverse(transform const& t)
+typedef basic_transform<scalar_t> transform;
+typedef basic_transform<double> dtransform;
+
+template <typename T>
+inline basic_transform<T> inverse(basic_transform<T> const& t)
 {
-	quaternion q = inverse(t.rotation);
-	return transform(rotate(inverse(t.position), q), q);
+	basic_quaternion<T> q = inverse(t.rotation);
+	return basic_transform<T>(rotate(inverse(t.position), q), q);
 }
 
-inline vec3 operator * (transform const& t, vec3 const& v)
+template <typename T>
+inline constexpr basic_vec3<T> operator * (basic_transform<T> const& t, basic_vec3<T> const& v)
 {
 	return rotate(v, t.rotation) + t.position;
 }
 
-inline transform operator * (transform const& a, transform const& b)
+template <typename T>
+inline constexpr basic_transform<T> operator * (basic_transform<T> const& a, basic_transform<T> const& b)
 {
-	return transform(b * a.position, a.rotation * b.rotation);
+	return basic_transform<T>(b * a.position, b.rotation * a.rotation);
 }
 
 }
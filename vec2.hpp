@@ -1,71 +1,76 @@
 #ifndef VEC2_H
 #define VEC2_H
 
-#include "scalar.h"
+#include "scalar.hpp"
 
 namespace xxx
 {
 
-struct vec2
+template <typename T>
+struct basic_vec2
 {
-	scalar_t x, y;
+	typedef T value_type;
 
-	vec2() {}
-	explicit vec2(scalar_t s) : x(s), y(s) {}
-	explicit vec2(scalar_t x, scalar_t y) : x(x), y(y) {}
-	vec2(vec2 const& v) : x(v.x), y(v.y) {}
+	T x, y;
 
-	vec2& operator += (scalar_t s)
+	basic_vec2() = default;
+	explicit constexpr basic_vec2(T s) : x(s), y(s) {}
+	explicit constexpr basic_vec2(T x, T y) : x(x), y(y) {}
+	basic_vec2(basic_vec2 const& v) = default;
+	template <typename U>
+	explicit constexpr basic_vec2(basic_vec2<U> const& v) : x(static_cast<T>(v.x)), y(static_cast<T>(v.y)) {}
+
+	constexpr basic_vec2& operator += (T s)
 	{
 		x += s;
 		y += s;
 		return *this;
 	}
 
-	vec2& operator -= (scalar_t s)
+	constexpr basic_vec2& operator -= (T s)
 	{
 		x -= s;
 		y -= s;
 		return *this;
 	}
 
-	vec2& operator *= (scalar_t s)
+	constexpr basic_vec2& operator *= (T s)
 	{
 		x *= s;
 		y *= s;
 		return *this;
 	}
 
-	vec2& operator /= (scalar_t s)
+	constexpr basic_vec2& operator /= (T s)
 	{
-		scalar_t const i = 1 / s;
+		T const i = 1 / s;
 		x *= i;
 		y *= i;
 		return *this;
 	}
 
-	vec2& operator += (vec2 const& v)
+	constexpr basic_vec2& operator += (basic_vec2 const& v)
 	{
 		x += v.x;
 		y += v.y;
 		return *this;
 	}
 
-	vec2& operator -= (vec2 const& v)
+	constexpr basic_vec2& operator -= (basic_vec2 const& v)
 	{
 		x -= v.x;
 		y -= v.y;
 		return *this;
 	}
 
-	vec2& operator *= (vec2 const& v)
+	constexpr basic_vec2& operator *= (basic_vec2 const& v)
 	{
 		x *= v.x;
 		y *= v.y;
 		return *this;
 	}
 
-	vec2& operator /= (vec2 const& v)
+	constexpr basic_vec2& operator /= (basic_vec2 const& v)
 	{
 		x /= v.x;
 		y /= v.y;
@@ -73,102 +78,146 @@ struct vec2
 	}
 };
 
-inline vec2 operator + (vec2 const& v, scalar_t s)
+typedef basic_vec2<scalar_t> vec2;
+typedef basic_vec2<double> dvec2;
+
+template <typename T>
+inline constexpr basic_vec2<T> operator + (basic_vec2<T> const& v, typename basic_vec2<T>::value_type s)
 {
-	return vec2(v.x + s, v.y + s);
+	return basic_vec2<T>(v.x + s, v.y + s);
 }
 
-inline vec2 operator - (vec2 const& v, scalar_t s)
+template <typename T>
+inline constexpr basic_vec2<T> operator - (basic_vec2<T> const& v, typename basic_vec2<T>::value_type s)
 {
-	return vec2(v.x - s, v.y - s);
+	return basic_vec2<T>(v.x - s, v.y - s);
 }
 
-inline vec2 operator * (vec2 const& v, scalar_t s)
+template <typename T>
+inline constexpr basic_vec2<T> operator * (basic_vec2<T> const& v, typename basic_vec2<T>::value_type s)
 {
-	return vec2(v.x * s, v.y * s);
+	return basic_vec2<T>(v.x * s, v.y * s);
 }
 
-inline vec2 operator / (vec2 const& v, scalar_t s)
+template <typename T>
+inline constexpr basic_vec2<T> operator / (basic_vec2<T> const& v, typename basic_vec2<T>::value_type s)
 {
-	scalar_t const i = 1 / s;
-	return vec2(v.x * i, v.y * i);
+	T const i = 1 / s;
+	return basic_vec2<T>(v.x * i, v.y * i);
 }
 
-inline vec2 operator + (vec2 const& a, vec2 const& b)
+template <typename T>
+inline constexpr basic_vec2<T> operator + (basic_vec2<T> const& a, basic_vec2<T> const& b)
 {
-	return vec2(a.x + b.x, a.y + b.y);
+	return basic_vec2<T>(a.x + b.x, a.y + b.y);
 }
 
-inline vec2 operator - (vec2 const& a, vec2 const& b)
+template <typename T>
+inline constexpr basic_vec2<T> operator - (basic_vec2<T> const& a, basic_vec2<T> const& b)
 {
-	return vec2(a.x - b.x, a.y - b.y);
+	return basic_vec2<T>(a.x - b.x, a.y - b.y);
 }
 
-inline vec2 operator * (vec2 const& a, vec2 const& b)
+template <typename T>
+inline constexpr basic_vec2<T> operator * (basic_vec2<T> const& a, basic_vec2<T> const& b)
 {
-	return vec2(a.x * b.x, a.y * b.y);
+	return basic_vec2<T>(a.x * b.x, a.y * b.y);
 }
 
-inline vec2 operator / (vec2 const& a, vec2 const& b)
+template <typename T>
+inline constexpr basic_vec2<T> operator / (basic_vec2<T> const& a, basic_vec2<T> const& b)
 {
-	return vec2(a.x / b.x, a.y / b.y);
+	return basic_vec2<T>(a.x / b.x, a.y / b.y);
 }
 
-inline vec2 inverse(vec2 const& v)
+template <typename T>
+inline constexpr basic_vec2<T> inverse(basic_vec2<T> const& v)
 {
-	return vec2(-v.x, -v.y);
+	return basic_vec2<T>(-v.x, -v.y);
 }
 
-inline vec2 min(vec2 const& a, vec2 const& b)
+template <typename T>
+inline constexpr basic_vec2<T> min(basic_vec2<T> const& a, basic_vec2<T> const& b)
 {
-	return vec2(min(a.x, b.x), min(a.y, b.y));
+	return basic_vec2<T>(min(a.x, b.x), min(a.y, b.y));
 }
 
-inline vec2 max(vec2 const& a, vec2 const& b)
+template <typename T>
+inline constexpr basic_vec2<T> max(basic_vec2<T> const& a, basic_vec2<T> const& b)
 {
-	return vec2(max(a.x, b.x), max(a.y, b.y));
+	return basic_vec2<T>(max(a.x, b.x), max(a.y, b.y));
 }
 
-inline vec2 abs(vec2 const& v)
+template <typename T>
+inline basic_vec2<T> abs(basic_vec2<T> const& v)
 {
-	return vec2(abs(v.x), abs(v.y));
+	return basic_vec2<T>(abs(v.x), abs(v.y));
 }
 
-inline scalar_t dot(vec2 const& a, vec2 const& b)
+template <typename T>
+inline constexpr T dot(basic_vec2<T> const& a, basic_vec2<T> const& b)
 {
 	return a.x * b.x + a.y * b.y;
 }
 
-inline scalar_t length(vec2 const& v)
+template <typename T>
+inline T length(basic_vec2<T> const& v)
 {
 	return sqrt(dot(v, v));
 }
 
-inline scalar_t distance(vec2 const& a, vec2 const& b)
+template <typename T>
+inline T distance(basic_vec2<T> const& a, basic_vec2<T> const& b)
 {
 	return length(a - b);
 }
 
-inline vec2 normalize(vec2 const& v)
+// The precision is used for the inverse length, see rsqrt().
+template <precision Q = default_precision, typename T>
+inline basic_vec2<T> normalize(basic_vec2<T> const& v)
 {
-	return v / length(v);
+	if (Q == precision::full)
+	{
+		return v / length(v);
+	}
+	return v * rsqrt<Q>(dot(v, v));
+}
+
+// Returns fallback instead of NaNs when v is zero or too short for its
+// squared length to be a normal number.
+template <precision Q = default_precision, typename T>
+inline basic_vec2<T> safe_normalize(basic_vec2<T> const& v, basic_vec2<T> const& fallback = basic_vec2<T>(0))
+{
+	T const d = dot(v, v);
+	if (!(d >= std::numeric_limits<T>::min()))
+	{
+		return fallback;
+	}
+	if (Q == precision::full)
+	{
+		return v / sqrt(d);
+	}
+	return v * rsqrt<Q>(d);
 }
 
-inline vec2 mix(vec2 const& a, vec2 const& b, scalar_t t)
+template <typename T>
+inline constexpr basic_vec2<T> mix(basic_vec2<T> const& a, basic_vec2<T> const& b, typename basic_vec2<T>::value_type t)
 {
-	return vec2(mix(a.x, b.x, t), mix(a.y, b.y, t));
+	return basic_vec2<T>(mix(a.x, b.x, t), mix(a.y, b.y, t));
 }
 
-inline vec2 reflect(vec2 const& i, vec2 const& n)
+template <typename T>
+inline constexpr basic_vec2<T> reflect(basic_vec2<T> const& i, basic_vec2<T> const& n)
 {
 	return i - n * dot(n, i) * 2;
 }
 
-inline vec2 refract(vec2 const& i, vec2 const& n, scalar_t eta)
+template <typename T>
+inline basic_vec2<T> refract(basic_vec2<T> const& i, basic_vec2<T> const& n, typename basic_vec2<T>::value_type eta)
 {
-	scalar_t const dni = dot(n, i);
-	scalar_t const k = 1 - eta * eta * (1 - dni * dni);
-	return k < 0 ? vec2(0) : (i * eta - n * (eta * dni + sqrt(k)));
+	T const dni = dot(n, i);
+	T const k = 1 - eta * eta * (1 - dni * dni);
+	return k < 0 ? basic_vec2<T>(0) : (i * eta - n * (eta * dni + sqrt(k)));
 }
 
 }
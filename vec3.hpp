@@ -1,27 +1,32 @@
 #ifndef VEC3_H
 #define VEC3_H
 
-#include "vec2.h"
+#include "vec2.hpp"
 
 namespace xxx
 {
 
-struct vec3
+template <typename T>
+struct basic_vec3
 {
-	scalar_t x, y, z;
+	typedef T value_type;
 
-	vec3() {}
-	explicit vec3(scalar_t s) : x(s), y(s), z(s) {}
-	explicit vec3(scalar_t x, scalar_t y, scalar_t z) : x(x), y(y), z(z) {}
-	explicit vec3(vec2 const& v, scalar_t z) : x(v.x), y(v.y), z(z) {}
-	vec3(vec3 const& v) : x(v.x), y(v.y), z(v.z) {}
+	T x, y, z;
 
-	vec2 to_vec2() const
+	basic_vec3() = default;
+	explicit constexpr basic_vec3(T s) : x(s), y(s), z(s) {}
+	explicit constexpr basic_vec3(T x, T y, T z) : x(x), y(y), z(z) {}
+	explicit constexpr basic_vec3(basic_vec2<T> const& v, T z) : x(v.x), y(v.y), z(z) {}
+	basic_vec3(basic_vec3 const& v) = default;
+	template <typename U>
+	explicit constexpr basic_vec3(basic_vec3<U> const& v) : x(static_cast<T>(v.x)), y(static_cast<T>(v.y)), z(static_cast<T>(v.z)) {}
+
+	constexpr basic_vec2<T> to_vec2() const
 	{
-		return vec2(x, y);
+		return basic_vec2<T>(x, y);
 	}
 
-	vec3& operator += (scalar_t s)
+	constexpr basic_vec3& operator += (T s)
 	{
 		x += s;
 		y += s;
@@ -29,7 +34,7 @@ struct vec3
 		return *this;
 	}
 
-	vec3& operator -= (scalar_t s)
+	constexpr basic_vec3& operator -= (T s)
 	{
 		x -= s;
 		y -= s;
@@ -37,7 +42,7 @@ struct vec3
 		return *this;
 	}
 
-	vec3& operator *= (scalar_t s)
+	constexpr basic_vec3& operator *= (T s)
 	{
 		x *= s;
 		y *= s;
@@ -45,16 +50,16 @@ struct vec3
 		return *this;
 	}
 
-	vec3& operator /= (scalar_t s)
+	constexpr basic_vec3& operator /= (T s)
 	{
-		scalar_t const i = 1 / s;
+		T const i = 1 / s;
 		x *= i;
 		y *= i;
 		z *= i;
 		return *this;
 	}
 
-	vec3& operator += (vec3 const& v)
+	constexpr basic_vec3& operator += (basic_vec3 const& v)
 	{
 		x += v.x;
 		y += v.y;
@@ -62,7 +67,7 @@ struct vec3
 		return *this;
 	}
 
-	vec3& operator -= (vec3 const& v)
+	constexpr basic_vec3& operator -= (basic_vec3 const& v)
 	{
 		x -= v.x;
 		y -= v.y;
@@ -70,7 +75,7 @@ struct vec3
 		return *this;
 	}
 
-	vec3& operator *= (vec3 const& v)
+	constexpr basic_vec3& operator *= (basic_vec3 const& v)
 	{
 		x *= v.x;
 		y *= v.y;
@@ -78,7 +83,7 @@ struct vec3
 		return *this;
 	}
 
-	vec3& operator /= (vec3 const& v)
+	constexpr basic_vec3& operator /= (basic_vec3 const& v)
 	{
 		x /= v.x;
 		y /= v.y;
@@ -87,110 +92,155 @@ struct vec3
 	}
 };
 
-inline vec3 operator + (vec3 const& v, scalar_t s)
+typedef basic_vec3<scalar_t> vec3;
+typedef basic_vec3<double> dvec3;
+
+template <typename T>
+inline constexpr basic_vec3<T> operator + (basic_vec3<T> const& v, typename basic_vec3<T>::value_type s)
 {
-	return vec3(v.x + s, v.y + s, v.z + s);
+	return basic_vec3<T>(v.x + s, v.y + s, v.z + s);
 }
 
-inline vec3 operator - (vec3 const& v, scalar_t s)
+template <typename T>
+inline constexpr basic_vec3<T> operator - (basic_vec3<T> const& v, typename basic_vec3<T>::value_type s)
 {
-	return vec3(v.x - s, v.y - s, v.z - s);
+	return basic_vec3<T>(v.x - s, v.y - s, v.z - s);
 }
 
-inline vec3 operator * (vec3 const& v, scalar_t s)
+template <typename T>
+inline constexpr basic_vec3<T> operator * (basic_vec3<T> const& v, typename basic_vec3<T>::value_type s)
 {
-	return vec3(v.x * s, v.y * s, v.z * s);
+	return basic_vec3<T>(v.x * s, v.y * s, v.z * s);
 }
 
-inline vec3 operator / (vec3 const& v, scalar_t s)
+template <typename T>
+inline constexpr basic_vec3<T> operator / (basic_vec3<T> const& v, typename basic_vec3<T>::value_type s)
 {
-	scalar_t const i = 1 / s;
-	return vec3(v.x * i, v.y * i, v.z * i);
+	T const i = 1 / s;
+	return basic_vec3<T>(v.x * i, v.y * i, v.z * i);
 }
 
-inline vec3 operator + (vec3 const& a, vec3 const& b)
+template <typename T>
+inline constexpr basic_vec3<T> operator + (basic_vec3<T> const& a, basic_vec3<T> const& b)
 {
-	return vec3(a.x + b.x, a.y + b.y, a.z + b.z);
+	return basic_vec3<T>(a.x + b.x, a.y + b.y, a.z + b.z);
 }
 
-inline vec3 operator - (vec3 const& a, vec3 const& b)
+template <typename T>
+inline constexpr basic_vec3<T> operator - (basic_vec3<T> const& a, basic_vec3<T> const& b)
 {
-	return vec3(a.x - b.x, a.y - b.y, a.z - b.z);
+	return basic_vec3<T>(a.x - b.x, a.y - b.y, a.z - b.z);
 }
 
-inline vec3 operator * (vec3 const& a, vec3 const& b)
+template <typename T>
+inline constexpr basic_vec3<T> operator * (basic_vec3<T> const& a, basic_vec3<T> const& b)
 {
-	return vec3(a.x * b.x, a.y * b.y, a.z * b.z);
+	return basic_vec3<T>(a.x * b.x, a.y * b.y, a.z * b.z);
 }
 
-inline vec3 operator / (vec3 const& a, vec3 const& b)
+template <typename T>
+inline constexpr basic_vec3<T> operator / (basic_vec3<T> const& a, basic_vec3<T> const& b)
 {
-	return vec3(a.x / b.x, a.y / b.y, a.z / b.z);
+	return basic_vec3<T>(a.x / b.x, a.y / b.y, a.z / b.z);
 }
 
-inline vec3 inverse(vec3 const& v)
+template <typename T>
+inline constexpr basic_vec3<T> inverse(basic_vec3<T> const& v)
 {
-	return vec3(-v.x, -v.y, -v.z);
+	return basic_vec3<T>(-v.x, -v.y, -v.z);
 }
 
-inline vec3 min(vec3 const& a, vec3 const& b)
+template <typename T>
+inline constexpr basic_vec3<T> min(basic_vec3<T> const& a, basic_vec3<T> const& b)
 {
-	return vec3(min(a.x, b.x), min(a.y, b.y), min(a.z, b.z));
+	return basic_vec3<T>(min(a.x, b.x), min(a.y, b.y), min(a.z, b.z));
 }
 
-inline vec3 max(vec3 const& a, vec3 const& b)
+template <typename T>
+inline constexpr basic_vec3<T> max(basic_vec3<T> const& a, basic_vec3<T> const& b)
 {
-	return vec3(max(a.x, b.x), max(a.y, b.y), max(a.z, b.z));
+	return basic_vec3<T>(max(a.x, b.x), max(a.y, b.y), max(a.z, b.z));
 }
 
-inline vec3 abs(vec3 const& v)
+template <typename T>
+inline basic_vec3<T> abs(basic_vec3<T> const& v)
 {
-	return vec3(abs(v.x), abs(v.y), abs(v.z));
+	return basic_vec3<T>(abs(v.x), abs(v.y), abs(v.z));
 }
 
-inline scalar_t dot(vec3 const& a, vec3 const& b)
+template <typename T>
+inline constexpr T dot(basic_vec3<T> const& a, basic_vec3<T> const& b)
 {
 	return a.x * b.x + a.y * b.y + a.z * b.z;
 }
 
-inline scalar_t length(vec3 const& v)
+template <typename T>
+inline T length(basic_vec3<T> const& v)
 {
 	return sqrt(dot(v, v));
 }
 
-inline scalar_t distance(vec3 const& a, vec3 const& b)
+template <typename T>
+inline T distance(basic_vec3<T> const& a, basic_vec3<T> const& b)
 {
 	return length(a - b);
 }
 
-inline vec3 normalize(vec3 const& v)
+// The precision is used for the inverse length, see rsqrt().
+template <precision Q = default_precision, typename T>
+inline basic_vec3<T> normalize(basic_vec3<T> const& v)
 {
-	return v / length(v);
+	if (Q == precision::full)
+	{
+		return v / length(v);
+	}
+	return v * rsqrt<Q>(dot(v, v));
+}
+
+// Returns fallback instead of NaNs when v is zero or too short for its
+// squared length to be a normal number.
+template <precision Q = default_precision, typename T>
+inline basic_vec3<T> safe_normalize(basic_vec3<T> const& v, basic_vec3<T> const& fallback = basic_vec3<T>(0))
+{
+	T const d = dot(v, v);
+	if (!(d >= std::numeric_limits<T>::min()))
+	{
+		return fallback;
+	}
+	if (Q == precision::full)
+	{
+		return v / sqrt(d);
+	}
+	return v * rsqrt<Q>(d);
 }
 
-inline vec3 cross(vec3 const& a, vec3 const& b)
+template <typename T>
+inline constexpr basic_vec3<T> cross(basic_vec3<T> const& a, basic_vec3<T> const& b)
 {
-	return vec3(
+	return basic_vec3<T>(
 		a.y * b.z - a.z * b.y,
 		a.z * b.x - a.x * b.z,
 		a.x * b.y - a.y * b.x);
 }
 
-inline vec3 mix(vec3 const& a, vec3 const& b, scalar_t t)
+template <typename T>
+inline constexpr basic_vec3<T> mix(basic_vec3<T> const& a, basic_vec3<T> const& b, typename basic_vec3<T>::value_type t)
 {
-	return vec3(mix(a.x, b.x, t), mix(a.y, b.y, t), mix(a.z, b.z, t));
+	return basic_vec3<T>(mix(a.x, b.x, t), mix(a.y, b.y, t), mix(a.z, b.z, t));
 }
 
-inline vec3 reflect(vec3 const& i, vec3 const& n)
+template <typename T>
+inline constexpr basic_vec3<T> reflect(basic_vec3<T> const& i, basic_vec3<T> const& n)
 {
 	return i - n * dot(n, i) * 2;
 }
 
-inline vec3 refract(vec3 const& i, vec3 const& n, scalar_t eta)
+template <typename T>
+inline basic_vec3<T> refract(basic_vec3<T> const& i, basic_vec3<T> const& n, typename basic_vec3<T>::value_type eta)
 {
-	scalar_t const dni = dot(n, i);
-	scalar_t const k = 1 - eta * eta * (1 - dni * dni);
-	return k < 0 ? vec3(0) : (i * eta - n * (eta * dni + sqrt(k)));
+	T const dni = dot(n, i);
+	T const k = 1 - eta * eta * (1 - dni * dni);
+	return k < 0 ? basic_vec3<T>(0) : (i * eta - n * (eta * dni + sqrt(k)));
 }
 
 }
@@ -1,33 +1,38 @@
 #ifndef VEC4_H
 #define VEC4_H
 
-#include "vec3.h"
+#include "vec3.hpp"
 
 namespace xxx
 {
 
-struct vec4
+template <typename T>
+struct basic_vec4
 {
-	scalar_t x, y, z, w;
+	typedef T value_type;
 
-	vec4() {}
-	explicit vec4(scalar_t s) : x(s), y(s), z(s), w(s) {}
-	explicit vec4(scalar_t x, scalar_t y, scalar_t z, scalar_t w) : x(x), y(y), z(z), w(w) {}
-	explicit vec4(vec2 const& v, scalar_t z, scalar_t w) : x(v.x), y(v.y), z(z), w(w) {}
-	explicit vec4(vec3 const& v, scalar_t w) : x(v.x), y(v.y), z(v.z), w(w) {}
-	vec4(vec4 const& v) : x(v.x), y(v.y), z(v.z), w(v.w) {}
+	T x, y, z, w;
 
-	vec2 to_vec2() const
+	basic_vec4() = default;
+	explicit constexpr basic_vec4(T s) : x(s), y(s), z(s), w(s) {}
+	explicit constexpr basic_vec4(T x, T y, T z, T w) : x(x), y(y), z(z), w(w) {}
+	explicit constexpr basic_vec4(basic_vec2<T> const& v, T z, T w) : x(v.x), y(v.y), z(z), w(w) {}
+	explicit constexpr basic_vec4(basic_vec3<T> const& v, T w) : x(v.x), y(v.y), z(v.z), w(w) {}
+	basic_vec4(basic_vec4 const& v) = default;
+	template <typename U>
+	explicit constexpr basic_vec4(basic_vec4<U> const& v) : x(static_cast<T>(v.x)), y(static_cast<T>(v.y)), z(static_cast<T>(v.z)), w(static_cast<T>(v.w)) {}
+
+	constexpr basic_vec2<T> to_vec2() const
 	{
-		return vec2(x, y);
+		return basic_vec2<T>(x, y);
 	}
 
-	vec3 to_vec3() const
+	constexpr basic_vec3<T> to_vec3() const
 	{
-		return vec3(x, y, z);
+		return basic_vec3<T>(x, y, z);
 	}
 
-	vec4& operator += (scalar_t s)
+	constexpr basic_vec4& operator += (T s)
 	{
 		x += s;
 		y += s;
@@ -36,7 +41,7 @@ struct vec4
 		return *this;
 	}
 
-	vec4& operator -= (scalar_t s)
+	constexpr basic_vec4& operator -= (T s)
 	{
 		x -= s;
 		y -= s;
@@ -45,7 +50,7 @@ struct vec4
 		return *this;
 	}
 
-	vec4& operator *= (scalar_t s)
+	constexpr basic_vec4& operator *= (T s)
 	{
 		x *= s;
 		y *= s;
@@ -54,9 +59,9 @@ struct vec4
 		return *this;
 	}
 
-	vec4& operator /= (scalar_t s)
+	constexpr basic_vec4& operator /= (T s)
 	{
-		scalar_t const i = 1 / s;
+		T const i = 1 / s;
 		x *= i;
 		y *= i;
 		z *= i;
@@ -64,7 +69,7 @@ struct vec4
 		return *this;
 	}
 
-	vec4& operator += (vec4 const& v)
+	constexpr basic_vec4& operator += (basic_vec4 const& v)
 	{
 		x += v.x;
 		y += v.y;
@@ -73,7 +78,7 @@ struct vec4
 		return *this;
 	}
 
-	vec4& operator -= (vec4 const& v)
+	constexpr basic_vec4& operator -= (basic_vec4 const& v)
 	{
 		x -= v.x;
 		y -= v.y;
@@ -82,7 +87,7 @@ struct vec4
 		return *this;
 	}
 
-	vec4& operator *= (vec4 const& v)
+	constexpr basic_vec4& operator *= (basic_vec4 const& v)
 	{
 		x *= v.x;
 		y *= v.y;
@@ -91,7 +96,7 @@ struct vec4
 		return *this;
 	}
 
-	vec4& operator /= (vec4 const& v)
+	constexpr basic_vec4& operator /= (basic_vec4 const& v)
 	{
 		x /= v.x;
 		y /= v.y;
@@ -101,102 +106,146 @@ struct vec4
 	}
 };
 
-inline vec4 operator + (vec4 const& v, scalar_t s)
+typedef basic_vec4<scalar_t> vec4;
+typedef basic_vec4<double> dvec4;
+
+template <typename T>
+inline constexpr basic_vec4<T> operator + (basic_vec4<T> const& v, typename basic_vec4<T>::value_type s)
 {
-	return vec4(v.x + s, v.y + s, v.z + s, v.w + s);
+	return basic_vec4<T>(v.x + s, v.y + s, v.z + s, v.w + s);
 }
 
-inline vec4 operator - (vec4 const& v, scalar_t s)
+template <typename T>
+inline constexpr basic_vec4<T> operator - (basic_vec4<T> const& v, typename basic_vec4<T>::value_type s)
 {
-	return vec4(v.x - s, v.y - s, v.z - s, v.w - s);
+	return basic_vec4<T>(v.x - s, v.y - s, v.z - s, v.w - s);
 }
 
-inline vec4 operator * (vec4 const& v, scalar_t s)
+template <typename T>
+inline constexpr basic_vec4<T> operator * (basic_vec4<T> const& v, typename basic_vec4<T>::value_type s)
 {
-	return vec4(v.x * s, v.y * s, v.z * s, v.w * s);
+	return basic_vec4<T>(v.x * s, v.y * s, v.z * s, v.w * s);
 }
 
-inline vec4 operator / (vec4 const& v, scalar_t s)
+template <typename T>
+inline constexpr basic_vec4<T> operator / (basic_vec4<T> const& v, typename basic_vec4<T>::value_type s)
 {
-	scalar_t const i = 1 / s;
-	return vec4(v.x * i, v.y * i, v.z * i, v.w * i);
+	T const i = 1 / s;
+	return basic_vec4<T>(v.x * i, v.y * i, v.z * i, v.w * i);
 }
 
-inline vec4 operator + (vec4 const& a, vec4 const& b)
+template <typename T>
+inline constexpr basic_vec4<T> operator + (basic_vec4<T> const& a, basic_vec4<T> const& b)
 {
-	return vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+	return basic_vec4<T>(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
 }
 
-inline vec4 operator - (vec4 const& a, vec4 const& b)
+template <typename T>
+inline constexpr basic_vec4<T> operator - (basic_vec4<T> const& a, basic_vec4<T> const& b)
 {
-	return vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+	return basic_vec4<T>(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
 }
 
-inline vec4 operator * (vec4 const& a, vec4 const& b)
+template <typename T>
+inline constexpr basic_vec4<T> operator * (basic_vec4<T> const& a, basic_vec4<T> const& b)
 {
-	return vec4(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w);
+	return basic_vec4<T>(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w);
 }
 
-inline vec4 operator / (vec4 const& a, vec4 const& b)
+template <typename T>
+inline constexpr basic_vec4<T> operator / (basic_vec4<T> const& a, basic_vec4<T> const& b)
 {
-	return vec4(a.x / b.x, a.y / b.y, a.z / b.z, a.w / b.w);
+	return basic_vec4<T>(a.x / b.x, a.y / b.y, a.z / b.z, a.w / b.w);
 }
 
-inline vec4 inverse(vec4 const& v)
+template <typename T>
+inline constexpr basic_vec4<T> inverse(basic_vec4<T> const& v)
 {
-	return vec4(-v.x, -v.y, -v.z, -v.w);
+	return basic_vec4<T>(-v.x, -v.y, -v.z, -v.w);
 }
 
-inline vec4 min(vec4 const& a, vec4 const& b)
+template <typename T>
+inline constexpr basic_vec4<T> min(basic_vec4<T> const& a, basic_vec4<T> const& b)
 {
-	return vec4(min(a.x, b.x), min(a.y, b.y), min(a.z, b.z), min(a.w, b.w));
+	return basic_vec4<T>(min(a.x, b.x), min(a.y, b.y), min(a.z, b.z), min(a.w, b.w));
 }
 
-inline vec4 max(vec4 const& a, vec4 const& b)
+template <typename T>
+inline constexpr basic_vec4<T> max(basic_vec4<T> const& a, basic_vec4<T> const& b)
 {
-	return vec4(max(a.x, b.x), max(a.y, b.y), max(a.z, b.z), max(a.w, b.w));
+	return basic_vec4<T>(max(a.x, b.x), max(a.y, b.y), max(a.z, b.z), max(a.w, b.w));
 }
 
-inline vec4 abs(vec4 const& v)
+template <typename T>
+inline basic_vec4<T> abs(basic_vec4<T> const& v)
 {
-	return vec4(abs(v.x), abs(v.y), abs(v.z), abs(v.w));
+	return basic_vec4<T>(abs(v.x), abs(v.y), abs(v.z), abs(v.w));
 }
 
-inline scalar_t dot(vec4 const& a, vec4 const& b)
+template <typename T>
+inline constexpr T dot(basic_vec4<T> const& a, basic_vec4<T> const& b)
 {
 	return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
 }
 
-inline scalar_t length(vec4 const& v)
+template <typename T>
+inline T length(basic_vec4<T> const& v)
 {
 	return sqrt(dot(v, v));
 }
 
-inline scalar_t distance(vec4 const& a, vec4 const& b)
+template <typename T>
+inline T distance(basic_vec4<T> const& a, basic_vec4<T> const& b)
 {
 	return length(a - b);
 }
 
-inline vec4 normalize(vec4 const& v)
+// The precision is used for the inverse length, see rsqrt().
+template <precision Q = default_precision, typename T>
+inline basic_vec4<T> normalize(basic_vec4<T> const& v)
 {
-	return v / length(v);
+	if (Q == precision::full)
+	{
+		return v / length(v);
+	}
+	return v * rsqrt<Q>(dot(v, v));
+}
+
+// Returns fallback instead of NaNs when v is zero or too short for its
+// squared length to be a normal number.
+template <precision Q = default_precision, typename T>
+inline basic_vec4<T> safe_normalize(basic_vec4<T> const& v, basic_vec4<T> const& fallback = basic_vec4<T>(0))
+{
+	T const d = dot(v, v);
+	if (!(d >= std::numeric_limits<T>::min()))
+	{
+		return fallback;
+	}
+	if (Q == precision::full)
+	{
+		return v / sqrt(d);
+	}
+	return v * rsqrt<Q>(d);
 }
 
-inline vec4 mix(vec4 const& a, vec4 const& b, scalar_t t)
+template <typename T>
+inline constexpr basic_vec4<T> mix(basic_vec4<T> const& a, basic_vec4<T> const& b, typename basic_vec4<T>::value_type t)
 {
-	return vec4(mix(a.x, b.x, t), mix(a.y, b.y, t), mix(a.z, b.z, t), mix(a.w, b.w, t));
+	return basic_vec4<T>(mix(a.x, b.x, t), mix(a.y, b.y, t), mix(a.z, b.z, t), mix(a.w, b.w, t));
 }
 
-inline vec4 reflect(vec4 const& i, vec4 const& n)
+template <typename T>
+inline constexpr basic_vec4<T> reflect(basic_vec4<T> const& i, basic_vec4<T> const& n)
 {
 	return i - n * dot(n, i) * 2;
 }
 
-inline vec4 refract(vec4 const& i, vec4 const& n, scalar_t eta)
+template <typename T>
+inline basic_vec4<T> refract(basic_vec4<T> const& i, basic_vec4<T> const& n, typename basic_vec4<T>::value_type eta)
 {
-	scalar_t const dni = dot(n, i);
-	scalar_t const k = 1 - eta * eta * (1 - dni * dni);
-	return k < 0 ? vec4(0) : (i * eta - n * (eta * dni + sqrt(k)));
+	T const dni = dot(n, i);
+	T const k = 1 - eta * eta * (1 - dni * dni);
+	return k < 0 ? basic_vec4<T>(0) : (i * eta - n * (eta * dni + sqrt(k)));
 }
 
 }